@@ -22,8 +22,11 @@
  */
 
 #include "MainDialog.h"
+#include "trace.h"
+#include <algorithm>
+#include <ctime>
 #include <functional>
-#include <fstream>
+#include <wx/numdlg.h>
 #include <boost/filesystem.hpp>
 
 namespace fs = boost::filesystem;
@@ -32,20 +35,64 @@ wxDEFINE_EVENT(ON_MSG_FRAME_READY, wxCommandEvent);
 wxDEFINE_EVENT(ON_MSG_CONNECTION_STATUS_CHANGE, wxCommandEvent);
 wxDEFINE_EVENT(ON_MSG_STREAMING_STATUS_CHANGE, wxCommandEvent);
 
+static const int PREVIEW_REFRESH_MS = 16;	// The profile editor preview is rendered at most once per display refresh
+
+static const size_t CLIP_BUFFER_BYTES = 64 << 20;	// About 1000 frames, almost two minutes at full rate
+static const int CLIP_PRE_SECONDS = 30;				// A clip starts this long before it's triggered...
+static const int CLIP_POST_SECONDS = 10;			// ...and ends this long after
+
+enum
+{
+	ID_MENU_HIGHLIGHT_ABOVE = wxID_HIGHEST + 1,
+	ID_MENU_HIGHLIGHT_BELOW,
+	ID_MENU_CLEAR_HIGHLIGHTS,
+	ID_MENU_PIPELINE_STATS,
+	ID_MENU_TIMING_OVERLAY,
+	ID_MENU_ADAPTIVE_QUALITY,
+	ID_MENU_SAVE_TIMINGS,
+	ID_MENU_SAVE_TRACE,
+	ID_MENU_RESET_ZOOM,
+	ID_MENU_RECORD,
+	ID_MENU_SHARE_FRAMES,
+	ID_MENU_OPEN_RECORDING,
+	ID_MENU_CLOSE_RECORDING,
+	ID_MENU_PLAY_PAUSE,
+	ID_MENU_STEP_FORWARD,
+	ID_MENU_STEP_BACK,
+	ID_MENU_PLAYBACK_SPEED,
+	ID_MENU_GO_TO,
+	ID_MENU_CLIP_BUFFER,
+	ID_MENU_SAVE_CLIP,
+	ID_MENU_CLIP_ON_HIGHLIGHT
+};
+
 MainDialog::MainDialog(wxWindow* parent)
     : MainDialogBaseClass(parent),
-	m_profile_editor(this)
+	m_profile_editor(this),
+	m_preview_timer(this)
 {
 	SetIcon(wxIcon("aaaFirstIcon", wxBITMAP_TYPE_ICO_RESOURCE));
+
+	TRACE_THREAD_NAME("UI");
+
+	m_title = GetTitle();
 	
-	m_get_extra_cal		= false;
 	m_use_extra_cal		= false;
-	m_first_after_cal	= false;
 	m_get_one_after_cal	= false;
 	m_got_image			= false;
 	m_auto_range		= true;
 	m_manual_min		= 2000;
 	m_manual_max		= 18000;
+	m_frame_pending		= false;
+	m_clip_on_highlight	= false;
+	m_highlight_active	= false;
+	m_timing_overlay	= false;
+	m_adaptive_quality	= true;
+	m_ui_busy			= TimingClock::duration::zero();
+	m_ui_frames			= 0;
+	m_quality_arrived	= 0;
+	m_histogram_skipped	= 0;
+	m_picture_skipped	= 0;
 
 	m_use_preview_profile = false;
 	
@@ -54,7 +101,7 @@ MainDialog::MainDialog(wxWindow* parent)
 	for (auto & file : fs::directory_iterator("profiles"))
 	{
 		if (fs::is_regular_file(file))
-			m_profiles.push_back(std::unique_ptr<ColorProfile>(new GradientProfile(file.path().string())));
+			m_profiles.push_back(std::make_shared<GradientProfile>(file.path().string()));
 	}
 
 	assert(!m_profiles.empty());
@@ -64,14 +111,42 @@ MainDialog::MainDialog(wxWindow* parent)
 	Bind(ON_MSG_FRAME_READY, &MainDialog::OnMsgFrameReady, this);
 	Bind(ON_MSG_CONNECTION_STATUS_CHANGE, &MainDialog::OnMsgConnectionStatusChange, this);
 	Bind(ON_MSG_STREAMING_STATUS_CHANGE, &MainDialog::OnMsgStreamingStatusChange, this);
+	Bind(wxEVT_TIMER, &MainDialog::OnPreviewTimer, this, m_preview_timer.GetId());
+
+	// The picture context menu isn't part of the wxCrafter design, so we hook it up manually
+	m_picture->Bind(wxEVT_CONTEXT_MENU, &MainDialog::OnPictureContextMenu, this);
+	Bind(wxEVT_COMMAND_MENU_SELECTED, &MainDialog::OnMenuHighlightAbove, this, ID_MENU_HIGHLIGHT_ABOVE);
+	Bind(wxEVT_COMMAND_MENU_SELECTED, &MainDialog::OnMenuHighlightBelow, this, ID_MENU_HIGHLIGHT_BELOW);
+	Bind(wxEVT_COMMAND_MENU_SELECTED, &MainDialog::OnMenuClearHighlights, this, ID_MENU_CLEAR_HIGHLIGHTS);
+	Bind(wxEVT_COMMAND_MENU_SELECTED, &MainDialog::OnMenuPipelineStats, this, ID_MENU_PIPELINE_STATS);
+	Bind(wxEVT_COMMAND_MENU_SELECTED, &MainDialog::OnMenuTimingOverlay, this, ID_MENU_TIMING_OVERLAY);
+	Bind(wxEVT_COMMAND_MENU_SELECTED, &MainDialog::OnMenuAdaptiveQuality, this, ID_MENU_ADAPTIVE_QUALITY);
+	Bind(wxEVT_COMMAND_MENU_SELECTED, &MainDialog::OnMenuSaveTimings, this, ID_MENU_SAVE_TIMINGS);
+	Bind(wxEVT_COMMAND_MENU_SELECTED, &MainDialog::OnMenuSaveTrace, this, ID_MENU_SAVE_TRACE);
+	Bind(wxEVT_COMMAND_MENU_SELECTED, &MainDialog::OnMenuResetZoom, this, ID_MENU_RESET_ZOOM);
+	Bind(wxEVT_COMMAND_MENU_SELECTED, &MainDialog::OnMenuRecord, this, ID_MENU_RECORD);
+	Bind(wxEVT_COMMAND_MENU_SELECTED, &MainDialog::OnMenuShareFrames, this, ID_MENU_SHARE_FRAMES);
+	Bind(wxEVT_COMMAND_MENU_SELECTED, &MainDialog::OnMenuOpenRecording, this, ID_MENU_OPEN_RECORDING);
+	Bind(wxEVT_COMMAND_MENU_SELECTED, &MainDialog::OnMenuCloseRecording, this, ID_MENU_CLOSE_RECORDING);
+	Bind(wxEVT_COMMAND_MENU_SELECTED, &MainDialog::OnMenuPlayPause, this, ID_MENU_PLAY_PAUSE);
+	Bind(wxEVT_COMMAND_MENU_SELECTED, &MainDialog::OnMenuStepForward, this, ID_MENU_STEP_FORWARD);
+	Bind(wxEVT_COMMAND_MENU_SELECTED, &MainDialog::OnMenuStepBack, this, ID_MENU_STEP_BACK);
+	Bind(wxEVT_COMMAND_MENU_SELECTED, &MainDialog::OnMenuPlaybackSpeed, this, ID_MENU_PLAYBACK_SPEED);
+	Bind(wxEVT_COMMAND_MENU_SELECTED, &MainDialog::OnMenuGoTo, this, ID_MENU_GO_TO);
+	Bind(wxEVT_COMMAND_MENU_SELECTED, &MainDialog::OnMenuClipBuffer, this, ID_MENU_CLIP_BUFFER);
+	Bind(wxEVT_COMMAND_MENU_SELECTED, &MainDialog::OnMenuSaveClip, this, ID_MENU_SAVE_CLIP);
+	Bind(wxEVT_COMMAND_MENU_SELECTED, &MainDialog::OnMenuClipOnHighlight, this, ID_MENU_CLIP_ON_HIGHLIGHT);
 
 	// Connect SeekThermal events
-	m_thermal.onNewFrame.connect(std::bind(&MainDialog::OnNewFrame, this, std::placeholders::_1));
+	m_thermal.onNewFrame.connect(std::bind(&MainDialog::OnNewFrame, this, std::placeholders::_1, std::placeholders::_2));
 	m_thermal.onConnecting.connect(std::bind(&MainDialog::OnConnectionStatusChange, this));
 	m_thermal.onDisconnected.connect(std::bind(&MainDialog::OnConnectionStatusChange, this));
 	m_thermal.onStreamingStart.connect(std::bind(&MainDialog::OnStreamingStatusChange, this));
 	m_thermal.onStreamingStop.connect(std::bind(&MainDialog::OnStreamingStatusChange, this));
 
+	// Recordings are played back through the same path as the camera frames
+	m_player.onNewFrame.connect(std::bind(&MainDialog::OnNewFrame, this, std::placeholders::_1, std::placeholders::_2));
+
 	// Connect Profile Editor events
 	m_profile_editor.onUpdated.connect(std::bind(&MainDialog::OnProfileEditorUpdate, this));
 	m_profile_editor.onApply.connect(std::bind(&MainDialog::OnProfileEditorApply, this));
@@ -98,7 +173,22 @@ MainDialog::MainDialog(wxWindow* parent)
 	
 	// Set the gradient image
 	m_gradient->setZoomType(wxImageView::ZOOM_STRETCH);
-	m_gradient->setImage(m_profiles[m_sel_profile]->getGradient());
+	ShowGradient(*m_profiles[m_sel_profile]);
+
+	// Hand the settings and the custom stages over to the processing threads, and start them
+	PublishConfig();
+	LoadStages();
+
+	m_frames.onResult.connect(std::bind(&MainDialog::PostFrameReady, this));
+	m_frames.onResult.connect([this](const PFrameResult & result)
+	{
+		m_shared_frames.writeCalibrated(*result->frame_extra, !!result->extra_cal);
+	});
+	m_frames.start();
+
+
+	// The picture can be zoomed in with the mouse wheel and panned by dragging
+	m_picture->setZoomable(true);
 
 
 	// Set the histogram zoom mode
@@ -115,7 +205,10 @@ MainDialog::MainDialog(wxWindow* parent)
 
 	// Try to connect to the camera
 	if (m_thermal.connect())
+	{
+		m_frames.getProcessor().loadCalibration(m_thermal.getDeviceId());
 		m_thermal.getStream();
+	}
 }
 
 MainDialog::~MainDialog()
@@ -123,6 +216,17 @@ MainDialog::~MainDialog()
 	m_profile_editor.Close();
 
 	m_thermal.close();
+	m_player.close();
+
+	m_recorder.close();
+	m_clip_recorder.close();
+	m_frames.stop();
+	m_shared_frames.close();
+
+#ifdef THERMALVIEW_TRACE
+	// Everything the threads did up to the end
+	Trace::write("thermalview_trace.json");
+#endif
 }
 
 
@@ -168,23 +272,88 @@ void MainDialog::OnMsgStreamingStatusChange(wxCommandEvent &)
 	if (m_thermal.isStreaming())
 		m_button_stop->SetLabel("Stop");
 	else
+	{
 		m_button_stop->SetLabel("Start");
+
+		// The last frame may have been one the picture skipped
+		if (m_shown && m_picture_skipped)
+		{
+			m_picture->setFrame(m_shown->frame_extra->m_pixels, 206, 156, m_shown->lut);
+			m_picture_skipped = 0;
+		}
+	}
 }
 
 void MainDialog::OnMsgFrameReady(wxCommandEvent &)
 {
-	std::lock_guard<std::recursive_mutex> lck(m_mx);
-	
-	m_picture->setImage(m_new_img);
-	m_histogram->setImage(m_new_historgram);
+	TRACE_SCOPE("Frame ready");
+
+	// Anything published from now on needs a new event
+	m_frame_pending = false;
+
+	PFrameResult result = m_frames.getResult();
+
+	if (!result)
+		return;
+
+	auto begin = TimingClock::now();
+
+	const ThermalFrame & frame = *result->frame_extra;
+
+	// When behind, the picture isn't redrawn for every new frame either, the rest still sees every one of them.
+	// Re-renders of the frame on display always are, they come from the settings changing.
+	if (!m_shown || m_shown->seq == result->seq || ++m_picture_skipped >= m_quality_control.getLevel().picture_every)
+	{
+		m_picture->setFrame(frame.m_pixels, 206, 156, result->lut);
+		m_picture_skipped = 0;
+
+		// The frame is scaled by now, only the blit is left
+		m_frames.resultShown(*result);
+	}
+
+	if (m_timing_overlay)
+		UpdateTimingOverlay();
+
+	// The histogram only changes with the frame, not with the colors. When behind, it's not drawn for every frame.
+	if (!m_shown || m_shown->histogram != result->histogram)
+	{
+		if (++m_histogram_skipped >= m_quality_control.getLevel().histogram_every)
+		{
+			m_histogram->setImage(DrawHistogram(*result->histogram));
+			m_histogram_skipped = 0;
+		}
+	}
+
+	m_shown = result;
+
+	// The highlight alarm fires when a highlight starts matching, not on every frame it matches
+	bool highlighted = std::any_of(result->isotherm_counts.begin(), result->isotherm_counts.end(), [](uint32_t count) { return count > 0; });
+
+	if (highlighted && !m_highlight_active)
+	{
+		m_frames.alarmRaised(*result);
+
+		if (m_clip_on_highlight)
+			SaveClip();
+	}
+
+	m_highlight_active = highlighted;
+
+	if (m_player.isOpen())
+	{
+		double position = m_player.getPosition() / 1e9;
+		double duration = m_player.getDuration() / 1e9;
+
+		SetTitle(wxString::Format("%s - %.1f / %.1f s", m_title, position, duration));
+	}
 
-	m_slider_low->SetSelection(m_frame_extra.m_min_val, m_frame_extra.m_max_val);
-	m_slider_high->SetSelection(m_frame_extra.m_min_val, m_frame_extra.m_max_val);
+	m_slider_low->SetSelection(frame.m_min_val, frame.m_max_val);
+	m_slider_high->SetSelection(frame.m_min_val, frame.m_max_val);
 
 	if (m_auto_range)
 	{
-		m_slider_low->SetValue(m_frame_extra.m_min_val);
-		m_slider_high->SetValue(m_frame_extra.m_max_val);
+		m_slider_low->SetValue(frame.m_min_val);
+		m_slider_high->SetValue(frame.m_max_val);
 	}
 	
 	if (!m_got_image)
@@ -192,6 +361,12 @@ void MainDialog::OnMsgFrameReady(wxCommandEvent &)
 		m_got_image = true;
 		m_button_save->Enable();
 	}
+
+	m_ui_busy += TimingClock::now() - begin;
+	m_ui_frames++;
+
+	if (m_adaptive_quality)
+		UpdateQualityLevel();
 }
 
 
@@ -200,39 +375,79 @@ void MainDialog::OnMsgFrameReady(wxCommandEvent &)
 //////////////////////////////////////////////////////////////////////////
 void MainDialog::OnProfileEditorUpdate()
 {
-	std::lock_guard<std::recursive_mutex> lck(m_mx);
+	// Every keystroke or color picker move ends up here, so bursts of edits get rendered only once
+	if (!m_preview_timer.IsRunning())
+		m_preview_timer.Start(PREVIEW_REFRESH_MS, wxTIMER_ONE_SHOT);
+}
 
+
+void MainDialog::OnPreviewTimer(wxTimerEvent &)
+{
 	bool old_state = m_use_preview_profile;
 	m_use_preview_profile = m_profile_editor.IsPreview();
 
 	if (m_use_preview_profile)
 	{
-		// Generate the new profile
-		m_preview_profile = PGradientProfile(new GradientProfile("preview", "preview", m_profile_editor.GetPattern(), m_profile_editor.GetGranularity()));
+		// If we were already previewing, only the part of the palette that changed has to be redone
+		if (m_preview_profile && old_state)
+		{
+			auto profile = std::dynamic_pointer_cast<GradientProfile>(m_preview_profile->clone());
+			auto changed = profile->setPattern(m_profile_editor.GetPattern(), m_profile_editor.GetGranularity());
+
+			if (changed.first != changed.second)
+			{
+				m_preview_profile = profile;
+				PublishConfig();
+
+				ShowGradient(*m_preview_profile);
+				RenderPreview(changed);
+			}
+
+			return;
+		}
+
+		// Generate the new profile, or update a copy of the one we already have so its gradient image is only partially redrawn
+		if (m_preview_profile)
+		{
+			auto profile = std::dynamic_pointer_cast<GradientProfile>(m_preview_profile->clone());
+
+			profile->setPattern(m_profile_editor.GetPattern(), m_profile_editor.GetGranularity());
+			m_preview_profile = profile;
+		}
+		else
+		{
+			m_preview_profile = std::make_shared<GradientProfile>("preview", "preview", m_profile_editor.GetPattern(), m_profile_editor.GetGranularity());
+			m_preview_profile->setIsotherms(m_isotherms);
+		}
 
 		// Update the gradient
-		m_gradient->setImage(m_preview_profile->getGradient());
+		ShowGradient(*m_preview_profile);
 	}
 	// If before this event we were in preview mode, we have to restore the default gradient, which is currently
 	// showing the m_preview_profile gradient
 	else if (old_state)
 	{
-		m_gradient->setImage(m_profiles[m_sel_profile]->getGradient());
+		ShowGradient(*m_profiles[m_sel_profile]);
 	}
+	else
+		return;
 
-	UpdateFrame();
+	// While streaming, the next frame picks up the new profile anyway
+	if (m_thermal.isStreaming())
+		PublishConfig();
+	else
+		UpdateFrame();
 }
 
 
 void MainDialog::OnProfileEditorApply()
 {
-	std::lock_guard<std::recursive_mutex> lck(m_mx);
-
 	assert(m_profiles[m_sel_profile]->getType() == ColorProfile::TYPE_GRADIENT);
 
-	auto profile = dynamic_cast<GradientProfile*>(m_profiles[m_sel_profile].get());
+	auto profile = std::dynamic_pointer_cast<GradientProfile>(m_profiles[m_sel_profile]->clone());
 
-	m_profiles[m_sel_profile] = PGradientProfile(new GradientProfile(profile->getFile(), profile->getName(), m_profile_editor.GetPattern(), m_profile_editor.GetGranularity()));
+	profile->setPattern(m_profile_editor.GetPattern(), m_profile_editor.GetGranularity());
+	m_profiles[m_sel_profile] = profile;
 
 	UpdateFrame();
 }
@@ -240,8 +455,6 @@ void MainDialog::OnProfileEditorApply()
 
 void MainDialog::OnProfileEditorSave()
 {
-	std::lock_guard<std::recursive_mutex> lck(m_mx);
-
 	assert(m_profiles[m_sel_profile]->getType() == ColorProfile::TYPE_GRADIENT);
 
 	OnProfileEditorApply();
@@ -267,11 +480,10 @@ void MainDialog::OnProfileEditorSaveAs()
 			return;
 
 		// Alright, let's save and set it
-		std::lock_guard<std::recursive_mutex> lck(m_mx);
-
-		PGradientProfile profile(new GradientProfile(fd.GetPath().ToStdString(), name, m_profile_editor.GetPattern(), m_profile_editor.GetGranularity()));
+		auto profile = std::make_shared<GradientProfile>(fd.GetPath().ToStdString(), name, m_profile_editor.GetPattern(), m_profile_editor.GetGranularity());
 
 		profile->save();
+		profile->setIsotherms(m_isotherms);
 
 
 		// Add it to the list
@@ -288,6 +500,479 @@ void MainDialog::OnProfileEditorSaveAs()
 	}
 }
 
+//////////////////////////////////////////////////////////////////////////
+// Picture context menu
+//////////////////////////////////////////////////////////////////////////
+void MainDialog::OnPictureContextMenu(wxContextMenuEvent &)
+{
+	wxMenu menu;
+
+	menu.Append(ID_MENU_HIGHLIGHT_ABOVE, "Highlight Above...");
+	menu.Append(ID_MENU_HIGHLIGHT_BELOW, "Highlight Below...");
+	menu.Append(ID_MENU_CLEAR_HIGHLIGHTS, "Clear Highlights");
+
+	wxMenu * playback = new wxMenu;
+
+	playback->Append(ID_MENU_PLAY_PAUSE, m_player.isPlaying() ? "Pause" : "Play");
+	playback->Append(ID_MENU_STEP_FORWARD, "Step Forward");
+	playback->Append(ID_MENU_STEP_BACK, "Step Back");
+	playback->Append(ID_MENU_GO_TO, "Go To...");
+	playback->Append(ID_MENU_PLAYBACK_SPEED, "Speed...");
+	playback->AppendSeparator();
+	playback->Append(ID_MENU_CLOSE_RECORDING, "Close Recording");
+
+	menu.AppendSeparator();
+	menu.Append(ID_MENU_OPEN_RECORDING, "Open Recording...");
+
+	if (m_player.isOpen())
+		menu.AppendSubMenu(playback, "Playback");
+	else
+		delete playback;
+
+	menu.Append(ID_MENU_RECORD, m_recorder.isOpen() ? "Stop Recording" : "Start Recording...");
+	menu.AppendCheckItem(ID_MENU_SHARE_FRAMES, "Share Frames");
+	menu.AppendSeparator();
+	menu.AppendCheckItem(ID_MENU_CLIP_BUFFER, "Keep Clip Buffer...");
+	menu.Append(ID_MENU_SAVE_CLIP, "Save Clip");
+	menu.AppendCheckItem(ID_MENU_CLIP_ON_HIGHLIGHT, "Save Clip on Highlight");
+	menu.AppendSeparator();
+	menu.Append(ID_MENU_RESET_ZOOM, "Reset Zoom");
+	menu.Append(ID_MENU_PIPELINE_STATS, "Pipeline Statistics...");
+	menu.AppendCheckItem(ID_MENU_TIMING_OVERLAY, "Show Timings");
+	menu.AppendCheckItem(ID_MENU_ADAPTIVE_QUALITY, "Adaptive Quality");
+	menu.Append(ID_MENU_SAVE_TIMINGS, "Save Timings...");
+#ifdef THERMALVIEW_TRACE
+	menu.Append(ID_MENU_SAVE_TRACE, "Save Trace...");
+#endif
+
+	menu.Enable(ID_MENU_RESET_ZOOM, m_picture->getZoom() > 1);
+
+	menu.Enable(ID_MENU_CLEAR_HIGHLIGHTS, !m_isotherms.empty());
+
+	menu.Check(ID_MENU_CLIP_BUFFER, m_clip_recorder.isOpen());
+	menu.Check(ID_MENU_CLIP_ON_HIGHLIGHT, m_clip_on_highlight);
+	menu.Check(ID_MENU_SHARE_FRAMES, m_shared_frames.isOpen());
+	menu.Check(ID_MENU_TIMING_OVERLAY, m_timing_overlay);
+	menu.Check(ID_MENU_ADAPTIVE_QUALITY, m_adaptive_quality);
+	menu.Enable(ID_MENU_SAVE_CLIP, m_clip_recorder.isOpen());
+	menu.Enable(ID_MENU_CLIP_ON_HIGHLIGHT, m_clip_recorder.isOpen());
+
+	PopupMenu(&menu);
+}
+
+
+void MainDialog::OnMenuHighlightAbove(wxCommandEvent &)
+{
+	long val = wxGetNumberFromUser("Pixels at or above this value will be painted red.", "Value:", "Highlight Above", m_slider_high->GetValue(), 0, 0xffff, this);
+
+	if (val < 0)
+		return;
+
+	ColorProfile::Isotherms isotherms = m_isotherms;
+
+	isotherms.push_back(ColorProfile::Isotherm(static_cast<uint16_t>(val), 0xffff, 0xff, 0, 0));
+
+	SetIsotherms(isotherms);
+}
+
+
+void MainDialog::OnMenuHighlightBelow(wxCommandEvent &)
+{
+	long val = wxGetNumberFromUser("Pixels at or below this value will be tinted blue.", "Value:", "Highlight Below", m_slider_low->GetValue(), 0, 0xffff, this);
+
+	if (val < 0)
+		return;
+
+	ColorProfile::Isotherms isotherms = m_isotherms;
+
+	isotherms.push_back(ColorProfile::Isotherm(0, static_cast<uint16_t>(val), 0, 0x40, 0xff, 0xa0));
+
+	SetIsotherms(isotherms);
+}
+
+
+void MainDialog::OnMenuClearHighlights(wxCommandEvent &)
+{
+	SetIsotherms(ColorProfile::Isotherms());
+}
+
+
+void MainDialog::OnMenuResetZoom(wxCommandEvent &)
+{
+	m_picture->resetZoom();
+}
+
+
+void MainDialog::OnMenuRecord(wxCommandEvent &)
+{
+	if (m_recorder.isOpen())
+	{
+		m_recorder.close();
+
+		Recorder::Stats stats = m_recorder.getStats();
+
+		if (stats.failed)
+			wxMessageBox("Writing the recording failed, it's incomplete");
+		else if (stats.frames_dropped)
+			wxMessageBox(wxString::Format("The disk couldn't keep up, %llu frames were dropped", static_cast<unsigned long long>(stats.frames_dropped)));
+
+		return;
+	}
+
+	wxFileDialog fd(this, "Record", "", "", "ThermalView recordings (*.tvr)|*.tvr", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+
+	if (fd.ShowModal() == wxID_CANCEL)
+		return;
+
+	if (!m_recorder.open(fd.GetPath().ToStdString()))
+		wxMessageBox("Failed to open file for writing");
+}
+
+
+void MainDialog::OnMenuShareFrames(wxCommandEvent &)
+{
+	if (m_shared_frames.isOpen())
+		m_shared_frames.close();
+	else if (!m_shared_frames.open())
+		wxMessageBox("Can't share the frames: " + m_shared_frames.getError());
+}
+
+
+void MainDialog::OnMenuOpenRecording(wxCommandEvent &)
+{
+	wxFileDialog fd(this, "Open recording", "", "", "ThermalView recordings (*.tvr)|*.tvr", wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+
+	if (fd.ShowModal() == wxID_CANCEL)
+		return;
+
+	// The frames come from the recording from now on, and so does the calibration, which isn't kept
+	m_thermal.close();
+
+	m_frames.getProcessor().loadCalibration("");
+
+	if (!m_player.open(fd.GetPath().ToStdString()))
+	{
+		wxMessageBox("Failed to open the recording");
+		return;
+	}
+
+	m_player.stepForward();
+}
+
+
+void MainDialog::OnMenuCloseRecording(wxCommandEvent &)
+{
+	m_player.close();
+
+	SetTitle(m_title);
+}
+
+
+void MainDialog::OnMenuPlayPause(wxCommandEvent &)
+{
+	if (m_player.isPlaying())
+		m_player.pause();
+	else
+		m_player.play();
+}
+
+
+void MainDialog::OnMenuStepForward(wxCommandEvent &)
+{
+	m_player.stepForward();
+}
+
+
+void MainDialog::OnMenuStepBack(wxCommandEvent &)
+{
+	m_player.stepBack();
+}
+
+
+void MainDialog::OnMenuPlaybackSpeed(wxCommandEvent &)
+{
+	wxString text = wxGetTextFromUser("Playback speed, 1 is the recorded pace:", "Playback Speed", wxString::Format("%g", m_player.getSpeed()), this);
+	double speed;
+
+	if (!text.empty() && text.ToDouble(&speed) && speed > 0)
+		m_player.setSpeed(speed);
+}
+
+
+void MainDialog::OnMenuGoTo(wxCommandEvent &)
+{
+	wxString text = wxGetTextFromUser(wxString::Format("Position in seconds, up to %.1f:", m_player.getDuration() / 1e9), "Go To",
+		wxString::Format("%.1f", m_player.getPosition() / 1e9), this);
+	double position;
+
+	if (!text.empty() && text.ToDouble(&position) && position >= 0)
+		m_player.seek(static_cast<uint64_t>(position * 1e9));
+}
+
+
+void MainDialog::OnMenuClipBuffer(wxCommandEvent &)
+{
+	if (m_clip_recorder.isOpen())
+	{
+		// Whatever was triggered gets saved first
+		m_clip_recorder.close();
+		m_clip_on_highlight = false;
+		return;
+	}
+
+	wxDirDialog dd(this, "Save clips to", m_clip_dir);
+
+	if (dd.ShowModal() == wxID_CANCEL)
+		return;
+
+	m_clip_dir = dd.GetPath().ToStdString();
+
+	if (!m_clip_recorder.open(CLIP_BUFFER_BYTES, 206 * 156, std::chrono::seconds(CLIP_PRE_SECONDS), std::chrono::seconds(CLIP_POST_SECONDS)))
+		wxMessageBox("Failed to allocate the clip buffer");
+}
+
+
+void MainDialog::OnMenuSaveClip(wxCommandEvent &)
+{
+	SaveClip();
+}
+
+
+void MainDialog::OnMenuClipOnHighlight(wxCommandEvent &)
+{
+	m_clip_on_highlight = !m_clip_on_highlight;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// SaveClip - Triggers a clip, named after the time
+//////////////////////////////////////////////////////////////////////////
+void MainDialog::SaveClip()
+{
+	std::time_t now = std::time(nullptr);
+	char name[64];
+
+	std::strftime(name, sizeof(name), "clip_%Y%m%d_%H%M%S.tvr", std::localtime(&now));
+
+	// Only one clip at a time, a trigger during the post-trigger window is already covered
+	m_clip_recorder.trigger((fs::path(m_clip_dir) / name).string());
+}
+
+void MainDialog::OnMenuPipelineStats(wxCommandEvent &)
+{
+	std::string text;
+
+	for (auto & stage : m_frames.getStats())
+	{
+		text += wxString::Format("%s: %.1f%% busy, %u/%u queued, %llu frames (%llu dropped, %llu skipped)\n",
+			stage.name, stage.busy * 100, static_cast<unsigned>(stage.queued), static_cast<unsigned>(stage.capacity),
+			static_cast<unsigned long long>(stage.processed), static_cast<unsigned long long>(stage.dropped),
+			static_cast<unsigned long long>(stage.skipped)).ToStdString();
+	}
+
+	wxMessageBox(text, "Pipeline Statistics", wxOK | wxICON_INFORMATION, this);
+}
+
+
+void MainDialog::OnMenuTimingOverlay(wxCommandEvent &)
+{
+	m_timing_overlay = !m_timing_overlay;
+
+	// Starts with a fresh period, the text shows up with the next frame
+	m_overlay_last.clear();
+	m_picture->setOverlay(wxEmptyString);
+}
+
+
+void MainDialog::OnMenuAdaptiveQuality(wxCommandEvent &)
+{
+	m_adaptive_quality = !m_adaptive_quality;
+
+	// Off means as chosen, on starts from there with a fresh period
+	m_quality_control.reset();
+	m_quality_busy.clear();
+	ApplyQualityLevel();
+}
+
+
+void MainDialog::OnMenuSaveTimings(wxCommandEvent &)
+{
+	wxFileDialog fd(this, "Save timings", "", "timings.txt", "Text files (*.txt)|*.txt", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+
+	if (fd.ShowModal() == wxID_CANCEL)
+		return;
+
+	if (!m_frames.getTimings().dump(fd.GetPath().ToStdString()))
+		wxMessageBox("Failed to open file for writing");
+}
+
+
+void MainDialog::OnMenuSaveTrace(wxCommandEvent &)
+{
+#ifdef THERMALVIEW_TRACE
+	wxFileDialog fd(this, "Save trace", "", "thermalview_trace.json", "Chrome trace files (*.json)|*.json", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+
+	if (fd.ShowModal() == wxID_CANCEL)
+		return;
+
+	if (!Trace::write(fd.GetPath().ToStdString()))
+		wxMessageBox("Failed to open file for writing");
+#endif
+}
+
+
+void MainDialog::UpdateTimingOverlay()
+{
+	// The histograms count since the start, the overlay shows what happened over the last second
+	auto now = TimingClock::now();
+	double elapsed = std::chrono::duration<double>(now - m_overlay_since).count();
+
+	if (!m_overlay_last.empty() && elapsed < 1)
+		return;
+
+	const StageTimings & timings = m_frames.getTimings();
+	std::vector<LatencyHistogram::Summary> current;
+
+	for (int i = 0; i < StageTimings::STAGE_COUNT; i++)
+		current.push_back(timings.get(static_cast<StageTimings::Stage>(i)).getSummary());
+
+	if (!m_overlay_last.empty())
+	{
+		unsigned queued = 0;
+
+		for (auto & stage : m_frames.getStats())
+			queued += static_cast<unsigned>(stage.queued);
+
+		uint64_t shown = current[StageTimings::STAGE_PAINT].count - m_overlay_last[StageTimings::STAGE_PAINT].count;
+
+		wxString text = wxString::Format("%.1f fps, %u queued", shown / elapsed, queued);
+
+		// How old the frame on display is, and which one it is
+		if (m_shown && m_shown->frame->m_captured != TimingClock::time_point())
+		{
+			text += wxString::Format("\nFrame %llu (camera %u), %.0f ms old", static_cast<unsigned long long>(m_shown->frame->m_seq),
+				static_cast<unsigned>(m_shown->frame->m_counter), std::chrono::duration<double, std::milli>(now - m_shown->frame->m_captured).count());
+		}
+
+		for (int i = 0; i < StageTimings::STAGE_COUNT; i++)
+		{
+			const LatencyHistogram::Summary & last = m_overlay_last[i];
+			const LatencyHistogram::Summary & cur = current[i];
+
+			// The mean over the period, out of the running means
+			uint64_t count = cur.count - last.count;
+			double mean = count ? (cur.mean_us * cur.count - last.mean_us * last.count) / count : 0;
+
+			text += wxString::Format("\n%s: %.0f us (p99 %.0f)", StageTimings::getName(static_cast<StageTimings::Stage>(i)), mean, cur.p99_us);
+		}
+
+		if (m_quality_control.getLevelIndex() > 0)
+		{
+			text += wxString::Format("\nQuality level %u of %u", static_cast<unsigned>(m_quality_control.getLevelIndex()),
+				static_cast<unsigned>(m_quality_control.getLevelCount() - 1));
+		}
+
+		if (m_recorder.isOpen())
+		{
+			auto latency = m_recorder.getStats().latency;
+
+			text += wxString::Format("\nRecorded: %.0f us (p99 %.0f)", latency.mean_us, latency.p99_us);
+		}
+
+		m_picture->setOverlay(text);
+	}
+
+	m_overlay_last	= current;
+	m_overlay_since	= now;
+}
+
+
+void MainDialog::UpdateQualityLevel()
+{
+	// Once a second, the slowest part of showing a frame against the time between camera frames
+	auto now = TimingClock::now();
+	double elapsed = std::chrono::duration<double>(now - m_quality_since).count();
+
+	if (!m_quality_busy.empty() && elapsed < 1)
+		return;
+
+	auto stats = m_frames.getStats();
+
+	if (!m_quality_busy.empty() && m_quality_busy.size() == stats.size())
+	{
+		// Every frame goes through the first stage, dropped or not, unless it was skipped on the way in
+		uint64_t arrived = stats[0].processed + stats[0].skipped - m_quality_arrived;
+		double interval = arrived ? elapsed / arrived : 0;
+
+		double cost = m_ui_frames ? std::chrono::duration<double>(m_ui_busy).count() / m_ui_frames : 0;
+
+		for (size_t i = 0; i < stats.size(); i++)
+		{
+			uint64_t processed = stats[i].processed - m_quality_processed[i];
+
+			if (processed)
+				cost = std::max(cost, (stats[i].busy_ns - m_quality_busy[i]) / 1e9 / processed);
+		}
+
+		if (m_quality_control.update(cost, interval))
+			ApplyQualityLevel();
+	}
+
+	m_quality_busy.clear();
+	m_quality_processed.clear();
+
+	m_quality_arrived = stats.empty() ? 0 : stats[0].processed + stats[0].skipped;
+
+	for (auto & stage : stats)
+	{
+		m_quality_busy.push_back(stage.busy_ns);
+		m_quality_processed.push_back(stage.processed);
+	}
+
+	m_quality_since	= now;
+	m_ui_busy		= TimingClock::duration::zero();
+	m_ui_frames		= 0;
+}
+
+
+void MainDialog::ApplyQualityLevel()
+{
+	const QualityLevel & level = m_quality_control.getLevel();
+
+	// From the cheapest to the best
+	static const wxImageResizeQuality qualities[] = { wxIMAGE_QUALITY_NORMAL, wxIMAGE_QUALITY_BILINEAR, wxIMAGE_QUALITY_BICUBIC };
+	int chosen = 0;
+
+	while (chosen < 2 && qualities[chosen] != m_quality)
+		chosen++;
+
+	m_picture->setQuality(qualities[std::max(chosen - level.scaling_steps, 0)]);
+
+	// Only the display changes, the processing threads pick it up with the next frame
+	PublishConfig();
+}
+
+
+void MainDialog::SetIsotherms(const ColorProfile::Isotherms & isotherms)
+{
+	m_isotherms = isotherms;
+
+	for (auto & profile : m_profiles)
+	{
+		profile = profile->clone();
+		profile->setIsotherms(m_isotherms);
+	}
+
+	if (m_preview_profile)
+	{
+		m_preview_profile = m_preview_profile->clone();
+		m_preview_profile->setIsotherms(m_isotherms);
+	}
+
+	UpdateFrame();
+}
+
+
 //////////////////////////////////////////////////////////////////////////
 // UI events
 //////////////////////////////////////////////////////////////////////////
@@ -299,8 +984,18 @@ void MainDialog::OnButton_connectButtonClicked(wxCommandEvent& event)
 		m_thermal.close();
 	else
 	{
+		// Back to the live camera
+		if (m_player.isOpen())
+		{
+			m_player.close();
+			SetTitle(m_title);
+		}
+
 		if (m_thermal.connect())
+		{
+			m_frames.getProcessor().loadCalibration(m_thermal.getDeviceId());
 			m_thermal.getStream();
+		}
 		else
 			wxMessageBox("Failed to connect to the USB device");
 	}
@@ -320,11 +1015,7 @@ void MainDialog::OnButton_stopButtonClicked(wxCommandEvent& event)
 // Take One
 void MainDialog::OnButton_take_oneButtonClicked(wxCommandEvent& event)
 {
-	{
-		std::lock_guard<std::recursive_mutex> lck(m_mx);
-		
-		m_get_one_after_cal = true;
-	}
+	m_get_one_after_cal = true;
 	
 	m_thermal.getStream();
 }
@@ -333,21 +1024,19 @@ void MainDialog::OnButton_take_oneButtonClicked(wxCommandEvent& event)
 // Get Extra Cal
 void MainDialog::OnButton_get_calButtonClicked(wxCommandEvent& event)
 {
-	std::lock_guard<std::recursive_mutex> lck(m_mx);
-	
-	m_get_extra_cal = true;
+	m_frames.getProcessor().captureExtraCalibration();
 	
 	// Set the checkbox, so we also get to use it
 	m_check_use_extra_cal->SetValue(true);
 	m_use_extra_cal = true;
+
+	PublishConfig();
 }
 
 
 // Use Extra Calibration
 void MainDialog::OnCheck_use_extra_calCheckboxClicked(wxCommandEvent& event)
 {
-	std::lock_guard<std::recursive_mutex> lck(m_mx);
-	
 	m_use_extra_cal = m_check_use_extra_cal->IsChecked();
 	
 	UpdateFrame();
@@ -357,8 +1046,6 @@ void MainDialog::OnCheck_use_extra_calCheckboxClicked(wxCommandEvent& event)
 // Interpolation selector
 void MainDialog::OnLb_interpolationChoiceSelected(wxCommandEvent& event)
 {
-	std::lock_guard<std::recursive_mutex> lck(m_mx);
-
 	int sel = m_lb_interpolation->GetSelection();
 
 	if (sel == wxNOT_FOUND)
@@ -381,7 +1068,7 @@ void MainDialog::OnLb_interpolationChoiceSelected(wxCommandEvent& event)
 				break;
 		}
 
-		m_picture->setQuality(m_quality);
+		ApplyQualityLevel();
 	}
 }
 
@@ -389,8 +1076,6 @@ void MainDialog::OnLb_interpolationChoiceSelected(wxCommandEvent& event)
 // Color Profile
 void MainDialog::OnLb_profileChoiceSelected(wxCommandEvent& event)
 {
-	std::lock_guard<std::recursive_mutex> lck(m_mx);
-	
 	m_sel_profile = m_lb_profile->GetSelection();
 	
 	if (m_sel_profile == wxNOT_FOUND)
@@ -398,7 +1083,7 @@ void MainDialog::OnLb_profileChoiceSelected(wxCommandEvent& event)
 		
 	if (m_sel_profile >= 0)
 	{
-		m_gradient->setImage(m_profiles[m_sel_profile]->getGradient());
+		ShowGradient(*m_profiles[m_sel_profile]);
 
 		//////////////////////////////////////////////////////////////////////////
 		// Profile Editor handling
@@ -434,8 +1119,6 @@ void MainDialog::OnLb_profileChoiceSelected(wxCommandEvent& event)
 // Edit Profile
 void MainDialog::OnButton_edit_profileButtonClicked(wxCommandEvent& event)
 {
-	std::lock_guard<std::recursive_mutex> lck(m_mx);
-
 	m_sel_profile = m_lb_profile->GetSelection();
 
 	if (m_sel_profile == wxNOT_FOUND)
@@ -457,52 +1140,49 @@ void MainDialog::OnButton_edit_profileButtonClicked(wxCommandEvent& event)
 // Save
 void MainDialog::OnButton_saveButtonClicked(wxCommandEvent& event)
 {
-	std::string file_types = "PNG files (*.png)|*.png|JPEG files (*.jpg)|*.jpg|BMP files (*.bmp)|*.bmp";
-
-	// For 206 x 156 we can save in RAW
-	if (m_lb_sizes->GetSelection() == 0)
-		file_types += "|RAW files (*.raw)|*.raw";
+	std::string file_types = "PNG files (*.png)|*.png|JPEG files (*.jpg)|*.jpg|BMP files (*.bmp)|*.bmp"
+		"|Radiometric snapshots (*.tvs)|*.tvs";
 
-	
 	wxFileDialog fd(this, "Save image", "", "", file_types, wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
 	
 	if (fd.ShowModal() == wxID_CANCEL)
 		return;
 	
 	
-	std::lock_guard<std::recursive_mutex> lck(m_mx);
+	// Save what's on display
+	PFrameResult result = m_shown;
 
-	// If we're saving RAW
-	if (fd.GetFilterIndex() == 3)
-	{
-		std::ofstream f(fd.GetPath().ToStdString().c_str(), std::ios::binary);
+	if (!result)
+		return;
 
-		if (f.is_open())
-		{
-			f.write(reinterpret_cast<const char *>(&m_frame_extra.m_pixels[0]), m_frame_extra.m_pixels.size() * sizeof(decltype(m_frame_extra.m_pixels)::value_type));
+	// With the profile it was rendered with, the current one may have other isotherms by now
+	const ThermalFrame & frame = *result->frame_extra;
+	const auto & profile = result->profile;
 
-			f.close();
-		}
-		else
-			wxMessageBox("Failed to open file for writing");
+	// The snapshot keeps the raw data and everything it was processed with, regardless of the size
+	if (fd.GetFilterIndex() == 3)
+	{
+		if (!FrameProcessor::saveSnapshot(fd.GetPath().ToStdString(), *result))
+			wxMessageBox("Failed to save file");
 	}
 	else
 	{
+		wxImage img = profile->getImage(frame, result->lut);
 		wxImage to_save;
 
 		switch (m_lb_sizes->GetSelection())
 		{
 		case 0:
-			to_save = m_new_img;
+			to_save = img;
 			break;
 
 		case 1:
-			to_save = m_new_img.Scale(412, 312, m_quality);
+			to_save = img.Scale(412, 312, m_quality);
 			break;
 
 		default:
 		case 2:
-			to_save = m_new_img.Scale(824, 624, m_quality);
+			to_save = img.Scale(824, 624, m_quality);
 			break;
 		}
 
@@ -511,12 +1191,9 @@ void MainDialog::OnButton_saveButtonClicked(wxCommandEvent& event)
 	}
 }
 
-
 // Autorange checkbox
 void MainDialog::OnCheck_auto_rangeCheckboxClicked(wxCommandEvent& event)
 {
-	std::lock_guard<std::recursive_mutex> lck(m_mx);
-
 	m_auto_range = m_check_auto_range->IsChecked();
 
 	if (!m_auto_range)
@@ -532,14 +1209,14 @@ void MainDialog::OnCheck_auto_rangeCheckboxClicked(wxCommandEvent& event)
 		m_slider_low->Disable();
 		m_slider_high->Disable();
 	}
+
+	PublishConfig();
 }
 
 
 // Low limit
 void MainDialog::OnSlider_lowScrollChanged(wxScrollEvent& event)
 {
-	std::lock_guard<std::recursive_mutex> lck(m_mx);
-
 	if (!m_auto_range)
 	{
 		m_manual_min = m_slider_low->GetValue();
@@ -558,8 +1235,6 @@ void MainDialog::OnSlider_lowScrollChanged(wxScrollEvent& event)
 // High limit
 void MainDialog::OnSlider_highScrollChanged(wxScrollEvent& event)
 {
-	std::lock_guard<std::recursive_mutex> lck(m_mx);
-
 	if (!m_auto_range)
 	{
 		m_manual_max = m_slider_high->GetValue();
@@ -29,8 +29,15 @@
 #include "frame.h"
 #include "color_profile/color_profile.h"
 #include "ProfileEditorDialog.h"
+#include "frame_pipeline.h"
+#include "quality_controller.h"
+#include "recording/recorder.h"
+#include "recording/player.h"
+#include "recording/clip_recorder.h"
+#include "shm/ring_writer.h"
 
-#include <mutex>
+#include <atomic>
+#include <memory>
 
 
 wxDECLARE_EVENT(ON_MSG_FRAME_READY, wxCommandEvent);
@@ -38,29 +45,37 @@ wxDECLARE_EVENT(ON_MSG_FRAME_READY, wxCommandEvent);
 class MainDialog : public MainDialogBaseClass
 {
 public:
-	typedef std::unique_ptr<ColorProfile> PColorProfile;
-	typedef std::unique_ptr<GradientProfile> PGradientProfile;
+	typedef std::shared_ptr<ColorProfile> PColorProfile;
+	typedef std::shared_ptr<GradientProfile> PGradientProfile;
 
+	RingWriter					m_shared_frames;		// Shares the frames with other processes, when open. Outlives the threads writing to it.
 	SeekThermal					m_thermal;				// The camera interface
-	ThermalFrame				m_frame;				// Current frame on display
-	ThermalFrame				m_frame_extra;			// Current frame on display after extra calibration
-	wxImage						m_new_img;				// The new image
-	wxImage						m_new_historgram;		// The new histogram
-	
-	std::recursive_mutex		m_mx;
-	
-	std::vector<double>			m_gain_cal;				// Gain calibration data - Frame ID 4
-	std::vector<uint16_t>		m_unknown_gain;			// Unknown gain pixels - Frame ID 4
-	std::vector<int>			m_offset_cal;			// Offset calibration - Frame ID 1
+	FramePipeline				m_frames;				// Processes the camera frames, one thread per stage
+	Recorder					m_recorder;				// Writes the raw camera frames to disk, while recording
+	Player						m_player;				// Plays back a recording, instead of the camera
+	ClipRecorder				m_clip_recorder;		// Keeps the last frames, to save clips of what just happened
+
+	// Shared between the worker and the UI thread
+	std::atomic<bool>			m_frame_pending;		// An ON_MSG_FRAME_READY is queued and wasn't handled yet
+	std::atomic<bool>			m_get_one_after_cal;	// Do we want to stop after we get the first one after the calibration frame?
 
-	std::vector<int>			m_extra_cal;			// Extra offset calibration
-	bool						m_get_extra_cal;		// Do we have to fetch a good frame for it?
+	// UI thread only
+	PFrameResult				m_shown;				// The result on display
+	wxString					m_title;				// The dialog title, without the playback position
 	bool						m_use_extra_cal;
-	bool						m_first_after_cal;		// Marks the first frame after the offset calibration
-	bool						m_get_one_after_cal;	// Do we want to stop after we get the first one after the calibration frame?
 
+	wxImageResizeQuality		m_quality;				// The image quality, as chosen
 
-	wxImageResizeQuality		m_quality;				// The image quality
+	bool						m_adaptive_quality;		// Trade display quality for keeping up with the camera
+	QualityController			m_quality_control;		// The display quality level in use
+	TimingClock::time_point		m_quality_since;		// Start of the period the load is measured over
+	std::vector<uint64_t>		m_quality_busy;			// The pipeline stage handler times at the start of it...
+	std::vector<uint64_t>		m_quality_processed;	// ...and the frames they handled
+	uint64_t					m_quality_arrived;		// Camera frames offered to the pipeline, including the skipped ones
+	TimingClock::duration		m_ui_busy;				// Time spent showing frames in the period
+	unsigned					m_ui_frames;			// Frames shown in the period
+	int							m_histogram_skipped;	// Frames shown since the histogram was last drawn
+	int							m_picture_skipped;		// Frames shown since the picture was last drawn
 	
 	
 	std::vector<PColorProfile>	m_profiles;				// The color profile container
@@ -69,6 +84,17 @@ public:
 	ProfileEditorDialog			m_profile_editor;		// The profile editor dialog
 	PColorProfile				m_preview_profile;		// The preview profile, generated from the profile editor data
 	bool						m_use_preview_profile;	// Indicates that we should use the preview profile
+	wxTimer						m_preview_timer;		// Coalesces the profile editor updates
+
+	ColorProfile::Isotherms		m_isotherms;			// Overlay bands, applied to every profile
+
+	std::string					m_clip_dir;				// Where the clips are saved
+	bool						m_clip_on_highlight;	// Save a clip when a highlight starts matching pixels
+	bool						m_highlight_active;		// The shown frame has highlighted pixels
+
+	bool						m_timing_overlay;		// Show the frame rate and the stage timings over the picture
+	TimingClock::time_point		m_overlay_since;		// Start of the period the overlay is showing
+	std::vector<LatencyHistogram::Summary>	m_overlay_last;	// The stage timings at the start of it
 	
 	
 	bool						m_got_image;			// Indicates that we receive at least one image
@@ -84,7 +110,7 @@ public:
 	// Seek Thermal events
 	void OnConnectionStatusChange();
 	void OnStreamingStatusChange();
-	void OnNewFrame(const std::vector<uint16_t> & data);
+	void OnNewFrame(const std::vector<uint16_t> & data, const FrameTimes & times);
 
 	// Profile Editor events
 	void OnProfileEditorUpdate();
@@ -96,10 +122,47 @@ public:
 	void OnMsgConnectionStatusChange(wxCommandEvent &);
 	void OnMsgStreamingStatusChange(wxCommandEvent &);
 	void OnMsgFrameReady(wxCommandEvent &);
+	void OnPreviewTimer(wxTimerEvent &);
+
+	// Picture context menu
+	void OnPictureContextMenu(wxContextMenuEvent &);
+	void OnMenuHighlightAbove(wxCommandEvent &);
+	void OnMenuHighlightBelow(wxCommandEvent &);
+	void OnMenuClearHighlights(wxCommandEvent &);
+	void OnMenuResetZoom(wxCommandEvent &);
+	void OnMenuRecord(wxCommandEvent &);
+	void OnMenuShareFrames(wxCommandEvent &);
+	void OnMenuOpenRecording(wxCommandEvent &);
+	void OnMenuCloseRecording(wxCommandEvent &);
+	void OnMenuPlayPause(wxCommandEvent &);
+	void OnMenuStepForward(wxCommandEvent &);
+	void OnMenuStepBack(wxCommandEvent &);
+	void OnMenuPlaybackSpeed(wxCommandEvent &);
+	void OnMenuGoTo(wxCommandEvent &);
+	void OnMenuClipBuffer(wxCommandEvent &);
+	void OnMenuSaveClip(wxCommandEvent &);
+	void OnMenuClipOnHighlight(wxCommandEvent &);
+	void OnMenuPipelineStats(wxCommandEvent &);
+	void OnMenuTimingOverlay(wxCommandEvent &);
+	void OnMenuAdaptiveQuality(wxCommandEvent &);
+	void OnMenuSaveTimings(wxCommandEvent &);
+	void OnMenuSaveTrace(wxCommandEvent &);
+
+	void SetIsotherms(const ColorProfile::Isotherms & isotherms);
+	void SaveClip();
 	
 private:
+	void PublishConfig();
+	void LoadStages();
 	void UpdateFrame();
-	void ComputeHistogram();
+	void RenderPreview(std::pair<size_t, size_t> changed_points);
+	void PostFrameReady();
+	void UpdateTimingOverlay();
+	void UpdateQualityLevel();
+	void ApplyQualityLevel();
+	void ShowGradient(const ColorProfile & profile);
+
+	wxImage DrawHistogram(const std::vector<uint16_t> & histogram) const;
 	
 protected:
     virtual void OnButton_connectButtonClicked(wxCommandEvent& event);
@@ -22,136 +22,144 @@
  */
 
 #include "MainDialog.h"
+#include <fstream>
 
+static const char STAGES_DIR[] = "stages";	// Shared objects with custom stages, and stages.txt listing the ones to run
 
-void MainDialog::OnNewFrame(const std::vector<uint16_t> & data)
+
+void MainDialog::OnNewFrame(const std::vector<uint16_t> & data, const FrameTimes & times)
 {
-	std::lock_guard<std::recursive_mutex> lck(m_mx);
-	
-	// Let's extract and process the data, while we're still running from the worker thread
-	ThermalFrame frame(data);
-	
-	// See if it's a key frame
-	if (frame.m_id != 3)
-	{
-		switch (frame.m_id)
-		{
-			// Gain calibration
-			case 4:
-				m_gain_cal = frame.getGainCalibration();
-				m_unknown_gain = frame.getZeroPixels();
-			break;
-
-			// Offset calibration (every time the shutter is heard)
-			case 1:
-				frame.applyGainCalibration(m_gain_cal);
-				frame.computeMinMax();
-				
-				m_offset_cal = frame.getOffsetCalibration();
-
-				m_first_after_cal = true;
-			break;
-		}
+	// This runs on the camera thread, so only the bookkeeping that has to keep up with the camera is done here
+	bool first_after_cal;
+	uint64_t seq = m_frames.number(data, &first_after_cal);
+
+	// Recording only queues a copy, the disk is never waited for here. The frames are stamped with when they were captured.
+	// Every frame is recorded before the display gets it, since the display may skip it.
+	if (m_recorder.isOpen())
+		m_recorder.addFrame(data, seq, times.received);
+
+	m_clip_recorder.addFrame(data, seq, times.received);
+
+	m_shared_frames.writeRaw(data, seq, times.received);
+
+	m_frames.queue(data, &times);
 
+	// Do we have to stop streaming?
+	if (first_after_cal && m_get_one_after_cal.exchange(false))
+		m_thermal.stopStreaming();
+}
+
+
+void MainDialog::PublishConfig()
+{
+	// If we don't have a real profile selected, stop
+	if ( m_sel_profile < 0 || m_sel_profile >= static_cast<int>(m_profiles.size()) )
 		return;
-	}
-	
-	
-	// It's a regular frame, so let's process it
-	
-	frame.addBadPixels(frame.getZeroPixels());
-	frame.addBadPixels(m_unknown_gain);
 
-	frame.applyGainCalibration(m_gain_cal);
-	frame.applyOffsetCalibration(m_offset_cal);
+	auto config = std::make_shared<RenderConfig>();
+
+	config->profile			= m_use_preview_profile ? m_preview_profile : m_profiles[m_sel_profile];
+	config->use_extra_cal	= m_use_extra_cal;
+	config->auto_range		= m_auto_range;
+	config->filters			= m_quality_control.getLevel().filters;
+	config->manual_min		= m_manual_min;
+	config->manual_max		= m_manual_max;
+
+	m_frames.setConfig(config);
+}
+
 
-	frame.computeMinMax();
+void MainDialog::LoadStages()
+{
+	std::string errors;
 
-	frame.fixBadPixels();
+	StageRegistry::loadDirectory(STAGES_DIR, errors);
 
-	// If it's the first regular frame after the calibration frame
-	if (m_first_after_cal)
+	// One NAME or NAME:ARGS per line, in the order they run. Empty lines and the ones starting with # are skipped.
+	auto stages = std::make_shared<StageChain>();
+	std::ifstream list(std::string(STAGES_DIR) + "/stages.txt");
+	std::string spec;
+
+	while (std::getline(list, spec))
 	{
-		m_first_after_cal = false;
-
-		// Do we have to use it as an extra calibration frame?
-		if (m_get_extra_cal)
-		{
-			m_get_extra_cal = false;
-			m_extra_cal = frame.getOffsetCalibration();
-		}
-		
-		// Do we have to stop streaming?
-		if (m_get_one_after_cal)
-		{
-			m_get_one_after_cal = false;
-			m_thermal.stopStreaming();
-		}
+		spec.erase(spec.find_last_not_of(" \t\r") + 1);
+
+		if (spec.empty() || spec[0] == '#')
+			continue;
+
+		std::string error;
+
+		if (!stages->add(spec, error))
+			errors += error + "\n";
 	}
-	
-	// Set it as the current frame
-	m_frame = frame;
-	
-	// Update the display
-	UpdateFrame();
-}
 
+	if (!errors.empty())
+		wxMessageBox(errors, "Custom Stages", wxOK | wxICON_WARNING, this);
+
+	m_frames.setStages(stages);
+}
 
 
 void MainDialog::UpdateFrame()
 {
-	// If we don't have a real profile selected, stop
-	if ( m_sel_profile < 0 || m_sel_profile > static_cast<int>(m_profiles.size()) )
-		return;
+	PublishConfig();
+
+	// Re-render the latest frame with the new settings
+	m_frames.rerender();
+}
 
-	// If we don't have any data, return
-	if (m_frame.m_pixels.empty())
+
+void MainDialog::RenderPreview(std::pair<size_t, size_t> changed_points)
+{
+	PFrameResult current = m_frames.getResult();
+
+	// Nothing to reuse, or the next frame is going to pick up the changes anyway
+	if (!current || current->lut.band.empty() || m_thermal.isStreaming())
 		return;
-	
-	// Make a copy, we don't want to alter it
-	m_frame_extra = m_frame;
-	
-	
-	// Handle extra calibration
-	if (!m_extra_cal.empty() && m_use_extra_cal)
-	{
-		m_frame_extra.applyOffsetCalibration(m_extra_cal);
-		m_frame_extra.computeMinMax();
-	}
 
+	auto profile = dynamic_cast<GradientProfile *>(m_preview_profile.get());
+	auto result = std::make_shared<FrameResult>(*current);
 
-	const auto & profile = m_use_preview_profile ? m_preview_profile : m_profiles[m_sel_profile];
+	// Only redo the values that map to the changed part of the gradient, the frame and the histogram stay the same
+	uint16_t first;
+	uint16_t last;
 
-	// Update the image to be displayed
-	if (m_auto_range)
-		m_new_img = profile->getImage(m_frame_extra, m_frame_extra.m_min_val, m_frame.m_max_val);
-	else
-		m_new_img = profile->getImage(m_frame_extra, m_manual_min, m_manual_max);
+	profile->getValueRange(changed_points.first, changed_points.second, result->lut.min_val, result->lut.max_val, first, last);
+	profile->updateLut(result->lut, first, last);
 
+	result->profile = m_preview_profile;
 
-	// Compute the new histogram
-	ComputeHistogram();
+	// Like a re-rendered result, it's not timed, or the frame's own times would be counted again
+	result->times = FrameTimes();
 
-		
-	QueueEvent(new wxCommandEvent(ON_MSG_FRAME_READY));
+	m_frames.publish(result);
 }
 
 
-void MainDialog::ComputeHistogram()
+void MainDialog::PostFrameReady()
 {
-	// Compute the histogram
-	std::vector<uint16_t> vect((m_frame_extra.m_max_val - m_frame_extra.m_min_val) + 1, 0);
+	// The handler always displays the latest data, so while an event is still queued there's no point in
+	// queueing another one. This way a busy UI thread never builds a backlog of repaints.
+	if (!m_frame_pending.exchange(true))
+		QueueEvent(new wxCommandEvent(ON_MSG_FRAME_READY));
+}
 
-	uint16_t max_val = 0;
 
-	for (uint16_t v : m_frame_extra.m_pixels)
-	{
-		auto & elm = vect[v - m_frame_extra.m_min_val];
+void MainDialog::ShowGradient(const ColorProfile & profile)
+{
+	// The profile may end up being released by the worker thread, so the view gets a copy it doesn't share
+	m_gradient->setImage(profile.getGradient().Copy());
+}
 
-		++elm;
 
-		if (elm > max_val)
-			max_val = elm;
+wxImage MainDialog::DrawHistogram(const std::vector<uint16_t> & vect) const
+{
+	uint16_t max_val = 0;
+
+	for (uint16_t v : vect)
+	{
+		if (v > max_val)
+			max_val = v;
 	}
 
 	// Create the histogram image
@@ -178,5 +186,6 @@ void MainDialog::ComputeHistogram()
 	dc.SelectObject(wxNullBitmap);
 
 	// Convert to image
-	m_new_historgram = bmp.ConvertToImage();
-}
\ No newline at end of file
+	return bmp.ConvertToImage();
+}
+
@@ -0,0 +1,651 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Microbenchmarks for the per-frame hot paths, from the USB transfer to the scaled picture.
+//
+//   ThermalViewBench [--fixture FILE.tvr] [--make-fixture FILE.tvr] [--profile FILE.gppal] [--filter TEXT]
+//                    [--min-time SECONDS] [--repeat N] [--json FILE] [--baseline FILE] [--threshold PERCENT] [--perf]
+//
+// The frames come from a recording given with --fixture, which needs a gain and an offset calibration frame
+// before its regular frames (a saved clip always has them). Without one, a synthetic set is generated, the same
+// on every run; --make-fixture writes it out as a recording, so it can be kept next to a baseline.
+//
+// Each benchmark runs over all the fixture frames, in rounds of at least --min-time, and the median round is
+// reported: ns per frame, frames per second, and heap allocations and bytes per frame. --json writes the same
+// numbers for tools, --baseline compares against such a file and fails when something got slower than
+// --threshold allows.
+//
+// --perf also counts, per frame, the cycles, instructions, L1 data and last level cache misses and branch misses
+// of each benchmark, with the instructions per cycle, to tell the ones waiting on memory from the ones that are
+// busy computing. It needs Linux and a kernel that allows it; whatever counters can't be opened are left out.
+
+#include "fixture.h"
+#include "perf_counters.h"
+#include "thermal.h"
+#include "frame.h"
+#include "processor.h"
+#include "resampler.h"
+#include "color_profile/gradient.h"
+#include "recording/codec.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+
+//////////////////////////////////////////////////////////////////////////
+/// Allocation counting - every heap allocation of the program goes through here
+//////////////////////////////////////////////////////////////////////////
+static std::atomic<uint64_t> g_allocs(0);
+static std::atomic<uint64_t> g_alloc_bytes(0);
+
+void * operator new(size_t size)
+{
+	++g_allocs;
+	g_alloc_bytes += size;
+
+	if (void * p = malloc(size ? size : 1))
+		return p;
+
+	throw std::bad_alloc();
+}
+
+void * operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+// The replacements above allocate with malloc(), but once these are inlined GCC only sees free() called on what
+// operator new returned
+#if defined(__GNUC__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void * p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void * p) noexcept
+{
+	free(p);
+}
+
+#if defined(__GNUC__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+
+// Keeps the compiler from dropping work whose result isn't used
+static volatile uint64_t g_sink;
+
+
+static const int WIDTH = 206;
+static const int HEIGHT = 156;
+static const size_t FRAME_WORDS = WIDTH * HEIGHT;
+static const size_t TRANSFER_WORDS = 0x7ec0;
+
+
+struct Result
+{
+	std::string	name;
+	double		ns_per_frame;
+	double		frames_per_second;
+	double		allocs_per_frame;
+	double		bytes_per_frame;
+
+	PerfCounters::Values	counters;		// Per round, with --perf
+	double					counted_frames;	// The frames the counters are for
+};
+
+struct Benchmark
+{
+	std::string						name;
+	std::function<void(size_t)>		run;		// Processes the given fixture frame
+};
+
+struct Options
+{
+	std::string		fixture;
+	std::string		make_fixture;
+	std::string		profile;
+	std::string		filter;
+	std::string		json;
+	std::string		baseline;
+	double			min_time;		// Seconds per round
+	int				repeat;			// Rounds
+	double			threshold;		// Percent
+	bool			perf;
+
+	Options() : min_time(0.2), repeat(5), threshold(10), perf(false) {}
+};
+
+
+//////////////////////////////////////////////////////////////////////////
+/// measure - Median of the rounds, each one long enough for the clock not to matter
+//////////////////////////////////////////////////////////////////////////
+static Result measure(const Benchmark & benchmark, size_t frames, const Options & options, const PerfCounters & perf)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	auto runFrames = [&](size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+			benchmark.run(i % frames);
+	};
+
+	// Warm up: the caches, the lazily built tables and the buffers that get reused
+	runFrames(frames);
+
+	// Find how many frames make a round
+	size_t count = frames;
+
+	while (true)
+	{
+		auto begin = Clock::now();
+
+		runFrames(count);
+
+		double elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+
+		if (elapsed >= options.min_time || count >= (size_t(1) << 30))
+			break;
+
+		count *= elapsed > 0 ? std::max<size_t>(2, static_cast<size_t>(options.min_time / elapsed * 1.2)) : 2;
+	}
+
+	std::vector<double> rounds;
+
+	uint64_t allocs = g_allocs;
+	uint64_t alloc_bytes = g_alloc_bytes;
+
+	PerfCounters::Values counters_begin = perf.read();
+
+	for (int r = 0; r < options.repeat; ++r)
+	{
+		auto begin = Clock::now();
+
+		runFrames(count);
+
+		rounds.push_back(std::chrono::duration<double, std::nano>(Clock::now() - begin).count() / count);
+	}
+
+	PerfCounters::Values counters_end = perf.read();
+
+	allocs = g_allocs - allocs;
+	alloc_bytes = g_alloc_bytes - alloc_bytes;
+
+	std::sort(rounds.begin(), rounds.end());
+
+	double total = static_cast<double>(count) * options.repeat;
+
+	Result result;
+
+	result.name					= benchmark.name;
+	result.ns_per_frame			= rounds[rounds.size() / 2];
+	result.frames_per_second	= 1e9 / result.ns_per_frame;
+	result.allocs_per_frame		= allocs / total;
+	result.bytes_per_frame		= alloc_bytes / total;
+	result.counters				= PerfCounters::difference(counters_end, counters_begin);
+	result.counted_frames		= total;
+
+	return result;
+}
+
+
+static std::string jsonString(const std::string & text)
+{
+	std::string out;
+
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+			out += '\\';
+
+		out += c;
+	}
+
+	return out;
+}
+
+
+static bool writeJson(const std::string & file, const std::vector<Result> & results, const std::string & fixture, size_t frames)
+{
+	FILE * f = fopen(file.c_str(), "w");
+
+	if (!f)
+		return false;
+
+	fprintf(f, "{\n  \"fixture\": \"%s\",\n  \"frames\": %u,\n  \"benchmarks\": [\n", jsonString(fixture).c_str(), static_cast<unsigned>(frames));
+
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const Result & r = results[i];
+
+		fprintf(f, "    { \"name\": \"%s\", \"ns_per_frame\": %.1f, \"frames_per_second\": %.1f, \"allocs_per_frame\": %.3f, \"bytes_per_frame\": %.1f",
+			jsonString(r.name).c_str(), r.ns_per_frame, r.frames_per_second, r.allocs_per_frame, r.bytes_per_frame);
+
+		// Only the counters that were there
+		for (int c = 0; c < PerfCounters::COUNTER_COUNT; ++c)
+		{
+			if (r.counters.valid[c])
+				fprintf(f, ", \"%s_per_frame\": %.1f", PerfCounters::getName(static_cast<PerfCounters::Counter>(c)), r.counters.value[c] / r.counted_frames);
+		}
+
+		if (r.counters.valid[PerfCounters::CYCLES] && r.counters.valid[PerfCounters::INSTRUCTIONS] && r.counters.value[PerfCounters::CYCLES])
+			fprintf(f, ", \"ipc\": %.3f", static_cast<double>(r.counters.value[PerfCounters::INSTRUCTIONS]) / r.counters.value[PerfCounters::CYCLES]);
+
+		fprintf(f, " }%s\n", i + 1 < results.size() ? "," : "");
+	}
+
+	fprintf(f, "  ]\n}\n");
+
+	return fclose(f) == 0;
+}
+
+
+static bool readBaseline(const std::string & file, std::map<std::string, double> & ns_per_frame)
+{
+	boost::property_tree::ptree tree;
+
+	try
+	{
+		boost::property_tree::read_json(file, tree);
+
+		for (auto & entry : tree.get_child("benchmarks"))
+			ns_per_frame[entry.second.get<std::string>("name")] = entry.second.get<double>("ns_per_frame");
+	}
+	catch (std::exception &)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+static void usage()
+{
+	std::cerr << "Usage: ThermalViewBench [--fixture FILE.tvr] [--make-fixture FILE.tvr] [--profile FILE.gppal] [--filter TEXT]" << std::endl
+			  << "                        [--min-time SECONDS] [--repeat N] [--json FILE] [--baseline FILE] [--threshold PERCENT] [--perf]" << std::endl;
+}
+
+
+static bool parseOptions(int argc, char * argv[], Options & options)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+
+		if (arg == "--perf")
+		{
+			options.perf = true;
+			continue;
+		}
+
+		if (i + 1 >= argc)
+			return false;
+
+		if (arg == "--fixture")
+			options.fixture = argv[++i];
+		else if (arg == "--make-fixture")
+			options.make_fixture = argv[++i];
+		else if (arg == "--profile")
+			options.profile = argv[++i];
+		else if (arg == "--filter")
+			options.filter = argv[++i];
+		else if (arg == "--json")
+			options.json = argv[++i];
+		else if (arg == "--baseline")
+			options.baseline = argv[++i];
+		else if (arg == "--min-time")
+			options.min_time = atof(argv[++i]);
+		else if (arg == "--repeat")
+			options.repeat = std::max(1, atoi(argv[++i]));
+		else if (arg == "--threshold")
+			options.threshold = atof(argv[++i]);
+		else
+			return false;
+	}
+
+	return true;
+}
+
+
+int main(int argc, char * argv[])
+{
+	Options options;
+
+	if (!parseOptions(argc, argv, options))
+	{
+		usage();
+		return 1;
+	}
+
+	Fixture fixture;
+
+	if (options.fixture.empty())
+		fixture = Fixture::synthetic(64);
+	else if (!fixture.load(options.fixture))
+	{
+		std::cerr << "No usable frames in " << options.fixture << ", it needs a gain and an offset calibration frame before the regular ones" << std::endl;
+		return 1;
+	}
+
+	if (!options.make_fixture.empty())
+	{
+		if (!fixture.save(options.make_fixture))
+		{
+			std::cerr << "Can't write " << options.make_fixture << std::endl;
+			return 1;
+		}
+
+		return 0;
+	}
+
+	const size_t frames = fixture.frames.size();
+
+	auto profile = options.profile.empty() ? Fixture::profile() : std::make_shared<GradientProfile>(options.profile);
+
+
+	//////////////////////////////////////////////////////////////////////////
+	// Everything the stages work on, prepared up front so only the stage itself is timed
+
+	// What the USB transfer looks like
+	std::vector<std::vector<uint8_t>> transfers(frames, std::vector<uint8_t>(TRANSFER_WORDS * 2, 0));
+
+	for (size_t n = 0; n < frames; ++n)
+	{
+		for (size_t y = 0; y < HEIGHT; ++y)
+		{
+			for (size_t x = 0; x < WIDTH; ++x)
+			{
+				uint16_t val = fixture.frames[n][y * WIDTH + x];
+
+				transfers[n][(y * 208 + x) * 2] = static_cast<uint8_t>(val);
+				transfers[n][(y * 208 + x) * 2 + 1] = static_cast<uint8_t>(val >> 8);
+			}
+		}
+	}
+
+	// The calibration tables, the same way the processor builds them
+	ThermalFrame gain_frame(fixture.gain);
+	std::vector<double> gain = gain_frame.getGainCalibration();
+	std::vector<uint16_t> unknown_gain = gain_frame.getZeroPixels();
+
+	ThermalFrame offset_frame(fixture.offset);
+	offset_frame.applyGainCalibration(gain);
+	offset_frame.computeMinMax();
+	std::vector<int> offset = offset_frame.getOffsetCalibration();
+
+	FrameProcessor processor;
+
+	processor.calibrate(0, std::vector<uint16_t>(fixture.gain), false);
+	processor.calibrate(0, std::vector<uint16_t>(fixture.offset), false);
+
+	// Raw frames, the in place stages work on these. The values drift from round to round, the cost doesn't depend on them.
+	std::vector<ThermalFrame> raw_frames;
+
+	for (auto & data : fixture.frames)
+	{
+		raw_frames.push_back(ThermalFrame(data));
+		raw_frames.back().addBadPixels(raw_frames.back().getZeroPixels());
+		raw_frames.back().addBadPixels(unknown_gain);
+	}
+
+	// Calibrated frames and their lookup tables, for the display stages
+	RenderConfig config;
+
+	config.profile			= profile;
+	config.use_extra_cal	= false;
+	config.auto_range		= true;
+	config.filters			= true;
+	config.manual_min		= 0;
+	config.manual_max		= 0;
+
+	std::vector<std::shared_ptr<FrameResult>> results;
+
+	for (size_t n = 0; n < frames; ++n)
+	{
+		results.push_back(processor.calibrate(n + 1, std::vector<uint16_t>(fixture.frames[n]), false));
+		processor.analyze(*results.back(), config);
+		FrameProcessor::colorize(*results.back(), config);
+	}
+
+	// Reused between frames, like the camera thread and the view do
+	std::vector<uint16_t> unpacked;
+	std::vector<uint8_t> rgb(FRAME_WORDS * 3);
+	std::vector<uint8_t> encoded;
+
+	// The view at 4x, the biggest save size
+	Resampler resampler;
+	std::vector<unsigned char> row(824 * 3);
+
+	resampler.setup(WIDTH, HEIGHT, 824, 624, Resampler::QUALITY_BICUBIC);
+
+	auto scale = [&](const ThermalFrame & frame, const ColorProfile::Lut & lut)
+	{
+		resampler.prepareValues(frame.m_pixels.data());
+
+		for (int y = 0; y < resampler.getDstHeight(); ++y)
+		{
+			if (!resampler.isSameRow(y))
+				resampler.getValueRow(y, lut.rgb.data(), lut.first, lut.band.size(), row.data());
+		}
+
+		g_sink = g_sink + row[0];
+	};
+
+
+	//////////////////////////////////////////////////////////////////////////
+	// The stages, in the order a frame goes through them
+	std::vector<Benchmark> benchmarks;
+
+	benchmarks.push_back({ "unpack", [&](size_t n)
+	{
+		SeekThermal::unpackFrame(transfers[n].data(), unpacked);
+		g_sink = g_sink + unpacked[n];
+	}});
+
+	benchmarks.push_back({ "frame_construct", [&](size_t n)
+	{
+		ThermalFrame frame(fixture.frames[n]);
+		g_sink = g_sink + frame.m_avg_val;
+	}});
+
+	benchmarks.push_back({ "compute_min_max", [&](size_t n)
+	{
+		raw_frames[n].computeMinMax();
+		g_sink = g_sink + raw_frames[n].m_avg_val;
+	}});
+
+	benchmarks.push_back({ "apply_gain", [&](size_t n)
+	{
+		raw_frames[n].applyGainCalibration(gain);
+		g_sink = g_sink + raw_frames[n].m_pixels[n];
+	}});
+
+	benchmarks.push_back({ "apply_offset", [&](size_t n)
+	{
+		raw_frames[n].applyOffsetCalibration(offset);
+		g_sink = g_sink + raw_frames[n].m_pixels[n];
+	}});
+
+	benchmarks.push_back({ "fix_bad_pixels", [&](size_t n)
+	{
+		raw_frames[n].fixBadPixels();
+		g_sink = g_sink + raw_frames[n].m_pixels[n];
+	}});
+
+	benchmarks.push_back({ "calibrate", [&](size_t n)
+	{
+		auto result = processor.calibrate(n, std::vector<uint16_t>(fixture.frames[n]), false);
+		g_sink = g_sink + result->frame->m_avg_val;
+	}});
+
+	benchmarks.push_back({ "histogram", [&](size_t n)
+	{
+		auto histogram = FrameProcessor::computeHistogram(*results[n]->frame);
+		g_sink = g_sink + histogram->size();
+	}});
+
+	benchmarks.push_back({ "lut", [&](size_t n)
+	{
+		const ThermalFrame & frame = *results[n]->frame;
+		ColorProfile::Lut lut = profile->getLut(frame, frame.m_min_val, frame.m_max_val);
+		g_sink = g_sink + lut.rgb.size();
+	}});
+
+	benchmarks.push_back({ "render", [&](size_t n)
+	{
+		profile->render(*results[n]->frame, results[n]->lut, rgb.data());
+		g_sink = g_sink + rgb[n];
+	}});
+
+	benchmarks.push_back({ "scale_824x624", [&](size_t n)
+	{
+		scale(*results[n]->frame, results[n]->lut);
+	}});
+
+	benchmarks.push_back({ "encode", [&](size_t n)
+	{
+		FrameCodec::encode(fixture.frames[n].data(), WIDTH, HEIGHT, n ? fixture.frames[n - 1].data() : nullptr, encoded);
+		g_sink = g_sink + encoded.size();
+	}});
+
+	// Everything a camera frame goes through before it's on screen, on one thread
+	benchmarks.push_back({ "pipeline", [&](size_t n)
+	{
+		auto result = processor.calibrate(n, std::vector<uint16_t>(fixture.frames[n]), false);
+
+		processor.analyze(*result, config);
+		FrameProcessor::colorize(*result, config);
+
+		scale(*result->frame_extra, result->lut);
+	}});
+
+
+	//////////////////////////////////////////////////////////////////////////
+	// Run them
+	std::map<std::string, double> baseline;
+
+	if (!options.baseline.empty() && !readBaseline(options.baseline, baseline))
+	{
+		std::cerr << "Can't read the baseline " << options.baseline << std::endl;
+		return 1;
+	}
+
+	// Counted on this thread, which is the one running the benchmarks
+	PerfCounters perf;
+
+	if (options.perf && !perf.open())
+		std::cerr << "Hardware counters not available: " << perf.getError() << std::endl;
+	else if (options.perf && !perf.getError().empty())
+		std::cerr << "Some hardware counters not available: " << perf.getError() << std::endl;
+
+	std::string fixture_name = options.fixture.empty() ? "synthetic" : options.fixture;
+
+	printf("%u frames from %s\n\n", static_cast<unsigned>(frames), fixture_name.c_str());
+	printf("%-16s %12s %12s %10s %12s", "benchmark", "ns/frame", "frames/s", "allocs", "bytes");
+
+	if (!baseline.empty())
+		printf(" %10s", "baseline");
+
+	printf("\n");
+
+	std::vector<Result> measured;
+	bool regressed = false;
+
+	for (auto & benchmark : benchmarks)
+	{
+		if (!options.filter.empty() && benchmark.name.find(options.filter) == std::string::npos)
+			continue;
+
+		Result r = measure(benchmark, frames, options, perf);
+
+		measured.push_back(r);
+
+		printf("%-16s %12.0f %12.0f %10.2f %12.0f", r.name.c_str(), r.ns_per_frame, r.frames_per_second, r.allocs_per_frame, r.bytes_per_frame);
+
+		auto base = baseline.find(r.name);
+
+		if (base != baseline.end() && base->second > 0)
+		{
+			double change = (r.ns_per_frame / base->second - 1) * 100;
+			bool slower = change > options.threshold;
+
+			printf(" %+9.1f%%%s", change, slower ? "  REGRESSION" : "");
+
+			regressed |= slower;
+		}
+
+		printf("\n");
+		fflush(stdout);
+	}
+
+	if (perf.isOpen())
+	{
+		printf("\n%-16s %8s %12s %12s %12s %12s %12s\n", "per frame", "ipc", "cycles", "instructions", "l1d_misses", "llc_misses", "branch_miss");
+
+		for (auto & r : measured)
+		{
+			const PerfCounters::Values & c = r.counters;
+
+			if (c.valid[PerfCounters::CYCLES] && c.valid[PerfCounters::INSTRUCTIONS] && c.value[PerfCounters::CYCLES])
+				printf("%-16s %8.2f", r.name.c_str(), static_cast<double>(c.value[PerfCounters::INSTRUCTIONS]) / c.value[PerfCounters::CYCLES]);
+			else
+				printf("%-16s %8s", r.name.c_str(), "-");
+
+			for (int i = 0; i < PerfCounters::COUNTER_COUNT; ++i)
+			{
+				if (c.valid[i])
+					printf(" %12.0f", c.value[i] / r.counted_frames);
+				else
+					printf(" %12s", "-");
+			}
+
+			printf("\n");
+		}
+	}
+
+	if (!options.json.empty() && !writeJson(options.json, measured, fixture_name, frames))
+	{
+		std::cerr << "Can't write " << options.json << std::endl;
+		return 1;
+	}
+
+	return regressed ? 2 : 0;
+}
@@ -0,0 +1,168 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "color_profile/color_profile.h"
+#include "trace.h"
+#include <algorithm>
+
+using namespace std;
+
+
+//////////////////////////////////////////////////////////////////////////
+/// getLut - Palette and isotherms, evaluated once per value
+//////////////////////////////////////////////////////////////////////////
+ColorProfile::Lut ColorProfile::getLut(const ThermalFrame & frame, uint16_t min_val, uint16_t max_val) const
+{
+	TRACE_SCOPE("getLut");
+
+	Lut lut;
+
+	// The table has to cover the display range and everything in the frame, otherwise the isotherms
+	// would only see clamped values
+	uint16_t first = std::min(min_val, frame.m_min_val);
+	uint16_t last = std::max(max_val, frame.m_max_val);
+
+	size_t size = static_cast<size_t>(last - first) + 1;
+
+	lut.first = first;
+	lut.min_val = min_val;
+	lut.max_val = max_val;
+	lut.rgb.resize(size * 3);
+	lut.band.resize(size);
+
+	updateLut(lut, first, last);
+
+	return lut;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// updateLut - Recomputes a part of the lookup table
+//////////////////////////////////////////////////////////////////////////
+void ColorProfile::updateLut(Lut & lut, uint16_t first, uint16_t last) const
+{
+	if (last < lut.first)
+		return;
+
+	size_t begin = std::max(first, lut.first) - lut.first;
+	size_t end = std::min<size_t>(static_cast<size_t>(last) + 1 - lut.first, lut.band.size());
+
+	for (size_t i = begin; i < end; ++i)
+	{
+		uint16_t val = static_cast<uint16_t>(lut.first + i);
+		uint8_t * rgb = &lut.rgb[i * 3];
+
+		getColor(val, lut.min_val, lut.max_val, rgb[0], rgb[1], rgb[2]);
+
+		lut.band[i] = 0;
+
+		// The last isotherm that covers the value ends up on top
+		for (size_t j = m_isotherms.size(); j > 0; --j)
+		{
+			const Isotherm & iso = m_isotherms[j - 1];
+
+			if (val < iso.low || val > iso.high)
+				continue;
+
+			rgb[0] = static_cast<uint8_t>((iso.r * iso.alpha + rgb[0] * (255 - iso.alpha)) / 255);
+			rgb[1] = static_cast<uint8_t>((iso.g * iso.alpha + rgb[1] * (255 - iso.alpha)) / 255);
+			rgb[2] = static_cast<uint8_t>((iso.b * iso.alpha + rgb[2] * (255 - iso.alpha)) / 255);
+
+			lut.band[i] = static_cast<uint8_t>(j);
+			break;
+		}
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// countIsotherms - Same counts as getImage() gives, without going through the pixels
+//////////////////////////////////////////////////////////////////////////
+void ColorProfile::countIsotherms(const std::vector<uint16_t> & histogram, uint16_t histogram_first, const Lut & lut, std::vector<uint32_t> & isotherm_counts) const
+{
+	TRACE_SCOPE("countIsotherms");
+
+	std::vector<uint32_t> counts(m_isotherms.size() + 1, 0);
+
+	size_t last = lut.band.size() - 1;
+
+	for (size_t i = 0; i < histogram.size(); ++i)
+	{
+		size_t val = histogram_first + i;
+		size_t idx = val < lut.first ? 0 : std::min<size_t>(val - lut.first, last);
+
+		counts[lut.band[idx]] += histogram[i];
+	}
+
+	isotherm_counts.assign(counts.begin() + 1, counts.end());
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// render - Colorizes the frame and counts the isotherm pixels in the same pass
+//////////////////////////////////////////////////////////////////////////
+void ColorProfile::render(const ThermalFrame & frame, const Lut & lut, uint8_t * dst, std::vector<uint32_t> * isotherm_counts) const
+{
+	TRACE_SCOPE("Palette mapping");
+
+	size_t last = lut.band.size() - 1;
+
+	std::vector<uint32_t> counts(m_isotherms.size() + 1, 0);
+
+	for (size_t i = 0; i < frame.m_pixels.size(); ++i, dst += 3)
+	{
+		size_t idx = frame.m_pixels[i] < lut.first ? 0 : std::min<size_t>(frame.m_pixels[i] - lut.first, last);
+		const uint8_t * rgb = &lut.rgb[idx * 3];
+
+		dst[0] = rgb[0];
+		dst[1] = rgb[1];
+		dst[2] = rgb[2];
+
+		++counts[lut.band[idx]];
+	}
+
+	if (isotherm_counts)
+		isotherm_counts->assign(counts.begin() + 1, counts.end());
+}
+
+
+#ifndef THERMALVIEW_HEADLESS
+
+//////////////////////////////////////////////////////////////////////////
+/// getImage - render(), to an image
+//////////////////////////////////////////////////////////////////////////
+wxImage ColorProfile::getImage(const ThermalFrame & frame, uint16_t min_val, uint16_t max_val, std::vector<uint32_t> * isotherm_counts) const
+{
+	return getImage(frame, getLut(frame, min_val, max_val), isotherm_counts);
+}
+
+wxImage ColorProfile::getImage(const ThermalFrame & frame, const Lut & lut, std::vector<uint32_t> * isotherm_counts) const
+{
+	wxImage img(206, 156, false);
+
+	render(frame, lut, img.GetData(), isotherm_counts);
+
+	return img;
+}
+
+#endif
@@ -25,8 +25,14 @@
 
 #include "frame.h"
 
+#ifndef THERMALVIEW_HEADLESS
 #include <wx/image.h>
+#endif
+#include <algorithm>
+#include <cassert>
+#include <memory>
 #include <string>
+#include <vector>
 
 
 class ColorProfile
@@ -34,8 +40,38 @@ class ColorProfile
 public:
 	enum Type { TYPE_CUSTOM, TYPE_GRADIENT };
 
+	// Overlay band, painted over the palette for the raw values in [low, high]. Bounds given the other way around
+	// are swapped, a band that never matches would never raise the highlight alarm either.
+	struct Isotherm
+	{
+		uint16_t low;
+		uint16_t high;
+
+		uint8_t r;
+		uint8_t g;
+		uint8_t b;
+		uint8_t alpha;		// 255 paints a solid color, anything lower blends it with the palette
+
+		Isotherm(uint16_t low, uint16_t high, uint8_t r, uint8_t g, uint8_t b, uint8_t alpha = 255)
+			: low(std::min(low, high)), high(std::max(low, high)), r(r), g(g), b(b), alpha(alpha) {}
+		Isotherm() {}
+	};
+
+	typedef std::vector<Isotherm> Isotherms;
+
+	// Raw value to color lookup table, covering the values in [first, first + band.size())
+	struct Lut
+	{
+		uint16_t				first;
+		uint16_t				min_val;	// The palette is stretched over [min_val, max_val]
+		uint16_t				max_val;
+		std::vector<uint8_t>	rgb;		// 3 bytes per value
+		std::vector<uint8_t>	band;		// 0 for the palette, otherwise the 1 based index of the isotherm that covers the value
+	};
+
 protected:
 	std::string m_name;
+	Isotherms	m_isotherms;
 
 private:
 	Type m_type;
@@ -54,6 +90,44 @@ public:
 		return m_type;
 	}
 	
-	virtual wxImage getImage(const ThermalFrame & frame, uint16_t min_val, uint16_t max_val) const = 0;
+	const Isotherms & getIsotherms() const
+	{
+		return m_isotherms;
+	}
+
+	void setIsotherms(const Isotherms & isotherms)
+	{
+		assert(isotherms.size() < 256);	// The lookup table stores the band index in a byte
+
+		m_isotherms = isotherms;
+	}
+
+	// Renders the frame to rgb, 3 bytes per pixel. When isotherm_counts is given, it receives the number of pixels that fell in each isotherm
+	void render(const ThermalFrame & frame, const Lut & lut, uint8_t * rgb, std::vector<uint32_t> * isotherm_counts = 0) const;
+
+#ifndef THERMALVIEW_HEADLESS
+	// Same as render(), to an image
+	wxImage getImage(const ThermalFrame & frame, uint16_t min_val, uint16_t max_val, std::vector<uint32_t> * isotherm_counts = 0) const;
+	wxImage getImage(const ThermalFrame & frame, const Lut & lut, std::vector<uint32_t> * isotherm_counts = 0) const;
+#endif
+
+	// Builds the lookup table for the values in the frame and in [min_val, max_val], with the palette stretched over the latter
+	Lut getLut(const ThermalFrame & frame, uint16_t min_val, uint16_t max_val) const;
+
+	// Recomputes the entries for the values in [first, last], after the palette changed
+	void updateLut(Lut & lut, uint16_t first, uint16_t last) const;
+
+	// Number of pixels in each isotherm, from a histogram whose first bin holds the value histogram_first
+	void countIsotherms(const std::vector<uint16_t> & histogram, uint16_t histogram_first, const Lut & lut, std::vector<uint32_t> & isotherm_counts) const;
+
+#ifndef THERMALVIEW_HEADLESS
 	virtual wxImage getGradient() const = 0;
+#endif
+
+	// Profiles are shared with the processing thread, so they are changed by replacing them with a modified copy
+	virtual std::shared_ptr<ColorProfile> clone() const = 0;
+
+protected:
+	// Palette color for the given value, where the palette is stretched over [min_val, max_val]
+	virtual void getColor(uint16_t val, uint16_t min_val, uint16_t max_val, uint8_t & r, uint8_t & g, uint8_t & b) const = 0;
 };
\ No newline at end of file
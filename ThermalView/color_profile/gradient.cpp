@@ -122,6 +122,8 @@ void GradientProfile::createProfile()
 {
 	size_t pos = 1;	// The current position
 
+	m_rgb.clear();
+
 	// Initial data
 	gpRGB start_color = m_pattern[0].second;
 	gpRGB stop_color = m_pattern[1].second;
@@ -170,54 +172,81 @@ void GradientProfile::createProfile()
 	}
 }
 
-wxImage GradientProfile::getImage(const ThermalFrame & frame, uint16_t min_val, uint16_t max_val) const
+void GradientProfile::getColor(uint16_t val, uint16_t min_val, uint16_t max_val, uint8_t & r, uint8_t & g, uint8_t & b) const
 {
-	wxImage img(206, 156);
-
 	uint16_t real_span = max_val - min_val;
 
-	for (size_t y = 0; y < 156; ++y)
-	{
-		for (size_t x = 0; x < 206; ++x)
-		{
-			size_t pixel = y * 206 + x;
-			uint16_t val = frame.m_pixels[pixel];
+	if (val < min_val)
+		val = min_val;
 
-			if (val < min_val)
-				val = min_val;
+	if (val > max_val)
+		val = max_val;
 
-			if (val > max_val)
-				val = max_val;
+	// Map the difference between min_val and max_val to the gradient
+	size_t idx;
 
-			// The value should be something between 0 and 255, so we have to map the difference between min_val and max_val to 0 to 255
-			if (real_span != 0)
-				val = ((val - min_val) * (m_rgb.size() - 1)) / real_span;
-			else
-				val = m_rgb.size() / 2;
+	if (real_span != 0)
+		idx = (static_cast<size_t>(val - min_val) * (m_rgb.size() - 1)) / real_span;
+	else
+		idx = m_rgb.size() / 2;
 
-			img.SetRGB(x, y, m_rgb[val].r, m_rgb[val].g, m_rgb[val].b);
-		}
-	}
-	
-	return img;
+	r = m_rgb[idx].r;
+	g = m_rgb[idx].g;
+	b = m_rgb[idx].b;
 }
 
+#ifndef THERMALVIEW_HEADLESS
 wxImage GradientProfile::getGradient() const
 {
-	size_t max_height = std::max(m_rgb.size(), MAX_GRADIENT_HEIGHT);
-	
-	wxImage img(15, max_height);
-	
+	if (!m_legend.IsOk())
+	{
+		m_legend.Create(15, std::max(m_rgb.size(), MAX_GRADIENT_HEIGHT), false);
+
+		drawLegend(0, m_rgb.size() - 1);
+	}
+
+	return m_legend;
+}
+#endif
+
+std::shared_ptr<ColorProfile> GradientProfile::clone() const
+{
+	auto profile = std::make_shared<GradientProfile>(*this);
+
+#ifndef THERMALVIEW_HEADLESS
+	// wxImage reference counting isn't thread safe, so the copy gets a legend of its own
+	if (m_legend.IsOk())
+		profile->m_legend = m_legend.Copy();
+#endif
+
+	return profile;
+}
+
+#ifndef THERMALVIEW_HEADLESS
+void GradientProfile::drawLegend(size_t first, size_t last) const
+{
+	size_t max_height = m_legend.GetHeight();
+
+	unsigned char * data = m_legend.GetData();
+
 	for (size_t y = 0; y < max_height; ++y)
 	{
 		size_t val = (y * (m_rgb.size() - 1)) / max_height;
-		
-		for (size_t x = 0; x < 15; ++x)
-			img.SetRGB(x, max_height - y - 1, m_rgb[val].r, m_rgb[val].g, m_rgb[val].b);
+
+		if (val < first || val > last)
+			continue;
+
+		unsigned char * row = data + (max_height - y - 1) * 15 * 3;
+
+		for (size_t x = 0; x < 15; ++x, row += 3)
+		{
+			row[0] = m_rgb[val].r;
+			row[1] = m_rgb[val].g;
+			row[2] = m_rgb[val].b;
+		}
 	}
-	
-	return img;
 }
+#endif
 
 const GradientProfile::Pattern & GradientProfile::getPattern() const
 {
@@ -229,6 +258,72 @@ uint16_t GradientProfile::getGranularity() const
 	return m_granularity;
 }
 
+std::pair<size_t, size_t> GradientProfile::setPattern(const Pattern & pattern, uint16_t granularity)
+{
+	std::vector<gpRGB> old_rgb;
+	old_rgb.swap(m_rgb);
+
+	m_pattern = pattern;
+	m_granularity = granularity;
+
+	createProfile();
+
+	// A different number of points changes the scale of everything
+	if (old_rgb.size() != m_rgb.size())
+	{
+#ifndef THERMALVIEW_HEADLESS
+		m_legend.Destroy();
+#endif
+		return std::make_pair(0, m_rgb.size());
+	}
+
+	// Only the segments next to the modified stops end up with different colors
+	size_t first = 0;
+	size_t last = m_rgb.size();
+
+	while (first < m_rgb.size() && m_rgb[first] == old_rgb[first])
+		++first;
+
+	if (first == m_rgb.size())
+		return std::make_pair(first, first);
+
+	while (last > first && m_rgb[last - 1] == old_rgb[last - 1])
+		--last;
+
+#ifndef THERMALVIEW_HEADLESS
+	if (m_legend.IsOk())
+	{
+		// Someone else may still hold the image we handed out, so don't draw over it
+		if (m_legend.GetRefData()->GetRefCount() > 1)
+			m_legend = m_legend.Copy();
+
+		drawLegend(first, last - 1);
+	}
+#endif
+
+	return std::make_pair(first, last);
+}
+
+void GradientProfile::getValueRange(size_t first_point, size_t last_point, uint16_t min_val, uint16_t max_val, uint16_t & first, uint16_t & last) const
+{
+	size_t span = max_val - min_val;
+	size_t n = m_rgb.size();
+
+	// Everything outside [min_val, max_val] is clamped to the first and last points
+	first = 0;
+	last = 0xffff;
+
+	if (n < 2 || span == 0)
+		return;
+
+	// Same mapping as getColor(), rounded outwards
+	if (first_point > 0)
+		first = static_cast<uint16_t>(min_val + (first_point * span) / (n - 1));
+
+	if (last_point < n)
+		last = static_cast<uint16_t>(min_val + (last_point * span) / (n - 1));
+}
+
 const string & GradientProfile::getFile() const
 {
 	return m_file;
@@ -53,21 +53,40 @@ protected:
 	std::vector<gpRGB>	m_rgb;			// The gradient
 	Pattern				m_pattern;		// The pattern that was used to create this profile
 	uint16_t			m_granularity;	// How many points should the gradient have
+
+#ifndef THERMALVIEW_HEADLESS
+	mutable wxImage		m_legend;		// Cached gradient image, built on the first getGradient() call
+#endif
 	
 public:
 	GradientProfile(const std::string & file, const std::string & name, const Pattern & pattern, uint16_t granularity = 512);
 	GradientProfile(const std::string & file);
 
-	wxImage getImage(const ThermalFrame & frame, uint16_t min_val, uint16_t max_val) const override;
+#ifndef THERMALVIEW_HEADLESS
 	wxImage getGradient() const override;
+#endif
+	std::shared_ptr<ColorProfile> clone() const override;
 
 	const Pattern & getPattern() const;
 	uint16_t getGranularity() const;
 
+	// Replaces the pattern, only redrawing the parts of the cached gradient image that changed.
+	// Returns the range of gradient points [first, last) that got a different color.
+	std::pair<size_t, size_t> setPattern(const Pattern & pattern, uint16_t granularity);
+
+	// The raw values that map to the gradient points [first_point, last_point), with the gradient stretched over [min_val, max_val]
+	void getValueRange(size_t first_point, size_t last_point, uint16_t min_val, uint16_t max_val, uint16_t & first, uint16_t & last) const;
+
 	const std::string & getFile() const;
 
 	bool save() const;
 
+protected:
+	void getColor(uint16_t val, uint16_t min_val, uint16_t max_val, uint8_t & r, uint8_t & g, uint8_t & b) const override;
+
 private:
 	void createProfile();	// Creates the profile based on the given pattern and granularity
+#ifndef THERMALVIEW_HEADLESS
+	void drawLegend(size_t first, size_t last) const;	// Redraws the legend rows that show the gradient points in [first, last]
+#endif
 };
\ No newline at end of file
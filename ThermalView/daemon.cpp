@@ -0,0 +1,404 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Headless capture daemon: streams from the camera, processes and records the frames, without a display.
+//
+//   ThermalViewDaemon [--record FILE] [--profile FILE.gppal] [--rgb-out FILE] [--range MIN MAX]
+//                     [--extra-cal] [--duration SECONDS] [--timings FILE] [--trace FILE]
+//                     [--load FILE]... [--stage NAME[:ARGS]]... [--share NAME]
+//
+// --record writes the raw camera frames to a recording, --rgb-out appends every colorized frame to FILE as
+// 206x156 RGB, using the profile given with --profile. It runs until --duration passes, the camera goes away,
+// or it's interrupted.
+//
+// --timings writes how long the frames took through each stage to FILE when it stops, and whenever it gets
+// SIGUSR1 where there is one. --trace does the same with the trace events, when built with THERMALVIEW_TRACE.
+//
+// --stage runs a custom stage on every frame, in the order given, after the stages of the shared objects given
+// with --load are registered.
+//
+// --share puts the frames in POSIX shared memory under NAME, such as /thermalview, for other processes to read
+// with RingReader. The calibrated frames are only there with --profile, without one they go no further than
+// calibration.
+
+#include "thermal.h"
+#include "frame_pipeline.h"
+#include "color_profile/gradient.h"
+#include "recording/recorder.h"
+#include "shm/ring_writer.h"
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+struct Options
+{
+	std::string		record;
+	std::string		profile;
+	std::string		rgb_out;
+	bool			auto_range;
+	int				manual_min;
+	int				manual_max;
+	bool			extra_cal;
+	double			duration;		// Seconds, 0 runs until interrupted
+	std::string		timings;
+	std::string		trace;
+	std::vector<std::string>	load;		// Shared objects with custom stages
+	std::vector<std::string>	stages;		// NAME or NAME:ARGS
+	std::string		share;		// Shared memory object name
+
+	Options() : auto_range(true), manual_min(0), manual_max(0), extra_cal(false), duration(0) {}
+};
+
+
+static std::atomic<bool> g_stop(false);
+static std::atomic<bool> g_dump(false);
+
+static void onSignal(int)
+{
+	g_stop = true;
+}
+
+static void onDumpSignal(int)
+{
+	g_dump = true;
+}
+
+
+static void usage()
+{
+	std::cerr << "Usage: ThermalViewDaemon [--record FILE] [--profile FILE.gppal] [--rgb-out FILE] [--range MIN MAX]" << std::endl
+			  << "                         [--extra-cal] [--duration SECONDS] [--timings FILE] [--trace FILE]" << std::endl
+			  << "                         [--load FILE]... [--stage NAME[:ARGS]]... [--share NAME]" << std::endl;
+}
+
+
+static bool parseOptions(int argc, char * argv[], Options & options)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (arg == "--record" && has_value)
+			options.record = argv[++i];
+		else if (arg == "--profile" && has_value)
+			options.profile = argv[++i];
+		else if (arg == "--rgb-out" && has_value)
+			options.rgb_out = argv[++i];
+		else if (arg == "--duration" && has_value)
+			options.duration = atof(argv[++i]);
+		else if (arg == "--timings" && has_value)
+			options.timings = argv[++i];
+		else if (arg == "--load" && has_value)
+			options.load.push_back(argv[++i]);
+		else if (arg == "--stage" && has_value)
+			options.stages.push_back(argv[++i]);
+		else if (arg == "--share" && has_value)
+			options.share = argv[++i];
+#ifdef THERMALVIEW_TRACE
+		else if (arg == "--trace" && has_value)
+			options.trace = argv[++i];
+#endif
+		else if (arg == "--range" && i + 2 < argc)
+		{
+			options.auto_range = false;
+			options.manual_min = atoi(argv[++i]);
+			options.manual_max = atoi(argv[++i]);
+		}
+		else if (arg == "--extra-cal")
+			options.extra_cal = true;
+		else
+			return false;
+	}
+
+	// Colorizing needs a palette
+	return options.rgb_out.empty() || !options.profile.empty();
+}
+
+
+// Writes the timings and the trace, if they were asked for
+static bool dump(const FramePipeline & frames, const Options & options)
+{
+	bool ok = true;
+
+	if (!options.timings.empty() && !frames.getTimings().dump(options.timings))
+	{
+		std::cerr << "Can't write " << options.timings << std::endl;
+		ok = false;
+	}
+
+#ifdef THERMALVIEW_TRACE
+	if (!options.trace.empty() && !Trace::write(options.trace))
+	{
+		std::cerr << "Can't write " << options.trace << std::endl;
+		ok = false;
+	}
+#endif
+
+	return ok;
+}
+
+
+int main(int argc, char * argv[])
+{
+	Options options;
+
+	if (!parseOptions(argc, argv, options))
+	{
+		usage();
+		return 1;
+	}
+
+	// The processing settings never change here
+	std::shared_ptr<RenderConfig> config;
+
+	if (!options.profile.empty())
+	{
+		auto profile = std::make_shared<GradientProfile>(options.profile);
+
+		config = std::make_shared<RenderConfig>();
+
+		config->profile			= profile;
+		config->use_extra_cal	= options.extra_cal;
+		config->auto_range		= options.auto_range;
+		config->filters			= true;
+		config->manual_min		= options.manual_min;
+		config->manual_max		= options.manual_max;
+	}
+
+	// The custom stages never change either
+	auto stages = std::make_shared<StageChain>();
+
+	for (auto & file : options.load)
+	{
+		std::string error;
+
+		if (!StageRegistry::load(file, error))
+		{
+			std::cerr << error << std::endl;
+			return 1;
+		}
+	}
+
+	for (auto & spec : options.stages)
+	{
+		std::string error;
+
+		if (!stages->add(spec, error))
+		{
+			std::cerr << error << std::endl;
+			return 1;
+		}
+	}
+
+	std::ofstream rgb_out;
+
+	if (!options.rgb_out.empty())
+	{
+		rgb_out.open(options.rgb_out, std::ios::binary | std::ios::trunc);
+
+		if (!rgb_out.is_open())
+		{
+			std::cerr << "Can't open " << options.rgb_out << std::endl;
+			return 1;
+		}
+	}
+
+	libusb_init(0);
+
+	int status = 0;
+
+	{
+		RingWriter shared;
+		SeekThermal thermal;
+		FramePipeline frames;
+		Recorder recorder;
+
+		FrameProcessor & processor = frames.getProcessor();
+
+		std::atomic<uint64_t> frame_count(0);
+		std::atomic<uint64_t> frames_out(0);
+
+		// Without a profile the frames are only calibrated, which still keeps the calibration tables up to date
+		frames.setConfig(config);
+		frames.setStages(stages);
+
+		// Every result is published by the colorize thread, so this sees them all, in order
+		std::vector<uint8_t> rgb(206 * 156 * 3);
+
+		frames.onResult.connect([&](const PFrameResult & result)
+		{
+			if (rgb_out.is_open())
+			{
+				result->profile->render(*result->frame_extra, result->lut, rgb.data());
+				rgb_out.write(reinterpret_cast<const char *>(rgb.data()), rgb.size());
+			}
+
+			shared.writeCalibrated(*result->frame_extra, !!result->extra_cal);
+
+			// Written out is as far as a frame goes here
+			frames.resultShown(*result);
+
+			++frames_out;
+		});
+
+		thermal.onNewFrame.connect([&](const std::vector<uint16_t> & data, const FrameTimes & times)
+		{
+			// Recorded first, the pipeline skips frames when it's behind
+			uint64_t seq = frames.number(data);
+
+			if (recorder.isOpen())
+				recorder.addFrame(data, seq, times.received);
+
+			shared.writeRaw(data, seq, times.received);
+
+			frames.queue(data, &times);
+
+			frame_count = seq;
+		});
+
+		if (!thermal.connect())
+		{
+			std::cerr << "No camera found" << std::endl;
+			status = 1;
+		}
+		else if (!options.record.empty() && !recorder.open(options.record))
+		{
+			std::cerr << "Can't record to " << options.record << std::endl;
+			status = 1;
+		}
+		else if (!options.share.empty() && !shared.open(options.share))
+		{
+			std::cerr << shared.getError() << std::endl;
+			status = 1;
+		}
+		else
+		{
+			std::string device = thermal.getDeviceId();
+
+			std::cerr << "Camera " << device << std::endl;
+
+			processor.loadCalibration(device);
+
+			// The extra calibration is taken from the first frame after the shutter, unless one was kept
+			if (options.extra_cal && !processor.getExtraCalibration())
+				processor.captureExtraCalibration();
+
+			signal(SIGINT, onSignal);
+			signal(SIGTERM, onSignal);
+#ifdef SIGUSR1
+			signal(SIGUSR1, onDumpSignal);
+#endif
+
+			frames.start();
+			thermal.getStream();
+
+			auto start = std::chrono::steady_clock::now();
+			bool done = false;
+			auto next_report = start + std::chrono::seconds(1);
+			uint64_t last_seq = 0;
+
+			while (!g_stop && thermal.isStreaming())
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+				auto now = std::chrono::steady_clock::now();
+
+				if (g_dump.exchange(false))
+					dump(frames, options);
+
+				if (options.duration > 0 && std::chrono::duration<double>(now - start).count() >= options.duration)
+				{
+					done = true;
+					break;
+				}
+
+				if (now < next_report)
+					continue;
+
+				next_report += std::chrono::seconds(1);
+
+				// One line a second, on stderr so the output stays usable
+				uint64_t seq = frame_count;
+
+				// From the USB transfer to being written out
+				auto latency = frames.getTimings().get(StageTimings::STAGE_TOTAL).getSummary();
+
+				fprintf(stderr, "frames %llu (%llu/s), out %llu, %.1f ms p99", static_cast<unsigned long long>(seq),
+					static_cast<unsigned long long>(seq - last_seq), static_cast<unsigned long long>(frames_out.load()), latency.p99_us / 1e3);
+
+				last_seq = seq;
+
+				for (auto & stage : frames.getStats())
+				{
+					fprintf(stderr, ", %s %.0f%% %u/%u", stage.name.c_str(), stage.busy * 100, static_cast<unsigned>(stage.queued), static_cast<unsigned>(stage.capacity));
+
+					if (stage.skipped)
+						fprintf(stderr, " (%llu skipped)", static_cast<unsigned long long>(stage.skipped));
+				}
+
+				if (recorder.isOpen())
+				{
+					Recorder::Stats rec = recorder.getStats();
+
+					fprintf(stderr, ", recorded %llu, dropped %llu, %.1f ms p99%s", static_cast<unsigned long long>(rec.frames_written),
+						static_cast<unsigned long long>(rec.frames_dropped), rec.latency.p99_us / 1e3, rec.failed ? " (failed)" : "");
+				}
+
+				fprintf(stderr, "\n");
+			}
+
+			if (!g_stop && !done)
+			{
+				std::cerr << "Camera stopped streaming" << std::endl;
+				status = 1;
+			}
+		}
+
+		// The camera first, so nothing is pushed after the pipeline stops
+		thermal.close();
+		frames.stop();
+		recorder.close();
+		shared.close();
+
+		if (!dump(frames, options))
+			status = 1;
+	}
+
+	libusb_exit(0);
+
+	return status;
+}
@@ -0,0 +1,195 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "fixture.h"
+#include "frame.h"
+#include "recording/player.h"
+#include "recording/recorder.h"
+
+#include <algorithm>
+#include <chrono>
+
+
+static const int WIDTH = 206;
+static const int HEIGHT = 156;
+static const size_t FRAME_WORDS = WIDTH * HEIGHT;
+
+
+//////////////////////////////////////////////////////////////////////////
+/// synthetic - Frames that look like the sensor output: fixed pattern noise, uneven gain, a moving warm spot
+//////////////////////////////////////////////////////////////////////////
+Fixture Fixture::synthetic(size_t count)
+{
+	uint32_t seed = 12345;
+
+	auto random = [&seed]() -> uint32_t
+	{
+		seed = seed * 1103515245 + 12345;
+		return (seed >> 16) & 0x7fff;
+	};
+
+	std::vector<int> fpn(FRAME_WORDS);
+	std::vector<double> gain(FRAME_WORDS);
+	std::vector<bool> dead(FRAME_WORDS, false);
+
+	for (size_t i = 0; i < FRAME_WORDS; ++i)
+	{
+		fpn[i] = static_cast<int>(random() % 400) - 200;
+		gain[i] = 0.9 + (random() % 2000) / 10000.0;
+	}
+
+	for (int i = 0; i < 40; ++i)
+		dead[random() % FRAME_WORDS] = true;
+
+	auto sensor = [&](double scene, size_t i) -> uint16_t
+	{
+		if (dead[i] && !is_pattern_pixel(static_cast<int>(i)))
+			return 0;
+
+		int val = 8000 + fpn[i] + static_cast<int>(scene * gain[i]) + static_cast<int>(random() % 24) - 12;
+
+		return static_cast<uint16_t>(std::max(1, std::min(val, 0xfffe)));
+	};
+
+	Fixture fixture;
+
+	fixture.gain.resize(FRAME_WORDS);
+	fixture.offset.resize(FRAME_WORDS);
+
+	for (size_t i = 0; i < FRAME_WORDS; ++i)
+	{
+		fixture.gain[i] = sensor(2000, i);
+		fixture.offset[i] = sensor(0, i);
+	}
+
+	fixture.gain[10] = 4;
+	fixture.offset[10] = 1;
+
+	for (size_t n = 0; n < count; ++n)
+	{
+		std::vector<uint16_t> frame(FRAME_WORDS);
+
+		int spot_x = static_cast<int>(30 + (n * 5) % 140);
+		int spot_y = static_cast<int>(40 + (n * 3) % 80);
+
+		for (int y = 0; y < HEIGHT; ++y)
+		{
+			for (int x = 0; x < WIDTH; ++x)
+			{
+				int dx = x - spot_x;
+				int dy = y - spot_y;
+
+				double scene = 300 + y * 4 + 3000.0 / (1 + (dx * dx + dy * dy) / 60.0);
+
+				frame[y * WIDTH + x] = sensor(scene, y * WIDTH + x);
+			}
+		}
+
+		frame[10] = 3;
+
+		fixture.frames.push_back(std::move(frame));
+	}
+
+	return fixture;
+}
+
+
+bool Fixture::load(const std::string & file)
+{
+	Player player;
+
+	if (!player.open(file))
+		return false;
+
+	for (size_t i = 0; i < player.getRecordCount(); ++i)
+	{
+		Player::PData data = player.getRecord(i);
+
+		if (!data || data->size() != FRAME_WORDS)
+			continue;
+
+		switch ((*data)[10] & 0xff)
+		{
+			case 4:
+				if (gain.empty())
+					gain = *data;
+				break;
+
+			case 1:
+				if (offset.empty())
+					offset = *data;
+				break;
+
+			case 3:
+				if (!gain.empty() && !offset.empty())
+					frames.push_back(*data);
+				break;
+		}
+	}
+
+	return !frames.empty();
+}
+
+
+bool Fixture::save(const std::string & file) const
+{
+	Recorder recorder;
+
+	auto start = std::chrono::steady_clock::now();
+
+	if (!recorder.open(file, recording::CODEC_THERMAL, start))
+		return false;
+
+	uint64_t seq = 0;
+	auto frame_time = start;
+
+	recorder.addFrame(gain, ++seq, frame_time, true);
+	recorder.addFrame(offset, ++seq, frame_time, true);
+
+	for (auto & frame : frames)
+	{
+		frame_time += std::chrono::microseconds(111111);
+		recorder.addFrame(frame, ++seq, frame_time, true);
+	}
+
+	recorder.close();
+
+	return !recorder.getStats().failed;
+}
+
+
+
+std::shared_ptr<GradientProfile> Fixture::profile()
+{
+	GradientProfile::Pattern pattern;
+
+	pattern.push_back(std::make_pair(0.0f, GradientProfile::gpRGB(0x00, 0x00, 0x00)));
+	pattern.push_back(std::make_pair(0.06f, GradientProfile::gpRGB(0x00, 0x00, 0x66)));
+	pattern.push_back(std::make_pair(0.2f, GradientProfile::gpRGB(0x7c, 0x00, 0x9d)));
+	pattern.push_back(std::make_pair(0.6f, GradientProfile::gpRGB(0xf0, 0x70, 0x00)));
+	pattern.push_back(std::make_pair(0.8f, GradientProfile::gpRGB(0xff, 0xcc, 0x00)));
+	pattern.push_back(std::make_pair(0.9f, GradientProfile::gpRGB(0xff, 0xf0, 0x60)));
+	pattern.push_back(std::make_pair(1.0f, GradientProfile::gpRGB(0xff, 0xff, 0xff)));
+
+	return std::make_shared<GradientProfile>("", "Iron", pattern);
+}
@@ -0,0 +1,51 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "color_profile/gradient.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+// Camera frames for the benchmarks: a recorded capture, or a synthetic one that's the same on every run
+struct Fixture
+{
+	std::vector<uint16_t>				gain;		// Gain calibration frame - ID 4
+	std::vector<uint16_t>				offset;		// Offset calibration frame - ID 1
+	std::vector<std::vector<uint16_t>>	frames;		// Regular frames - ID 3
+
+	static Fixture synthetic(size_t count);
+
+	// Takes the first gain and offset calibration frames of a recording, and the regular frames after them
+	bool load(const std::string & file);
+
+	// Writes it as a recording, which load() gives back
+	bool save(const std::string & file) const;
+
+	// The iron palette, without depending on the profiles directory
+	static std::shared_ptr<GradientProfile> profile();
+};
@@ -22,6 +22,7 @@
  */
 
 #include "frame.h"
+#include "trace.h"
 #include <cstring>
 
 using namespace std;
@@ -33,6 +34,8 @@ using namespace std;
 ThermalFrame::ThermalFrame()
 {
     m_id = 0;
+    m_counter = 0;
+    m_seq = 0;
     m_max_val = 0;
     m_min_val = 0xffff;
     m_avg_val = 0;
@@ -44,6 +47,8 @@ ThermalFrame::ThermalFrame()
 //////////////////////////////////////////////////////////////////////////
 ThermalFrame::ThermalFrame(const std::vector<uint16_t> & data)
 {
+	TRACE_SCOPE("ThermalFrame");
+
 	if (data.size() != 32136)
 		return;
 
@@ -62,8 +67,10 @@ ThermalFrame::ThermalFrame(const std::vector<uint16_t> & data)
 	// Copy it
 	memcpy(&m_pixels[0], &data[0], data.size() * 2);
 
-	// Get the ID of the frame
+	// Get the ID of the frame, and the frame counter of the camera
 	m_id = static_cast<uint8_t>(m_pixels[10]);
+	m_counter = m_pixels[1];
+	m_seq = 0;
 	
 	// Comput min/max values
 	computeMinMax();
@@ -75,6 +82,8 @@ ThermalFrame::ThermalFrame(const std::vector<uint16_t> & data)
 //////////////////////////////////////////////////////////////////////////
 void ThermalFrame::computeMinMax()
 {
+	TRACE_SCOPE("computeMinMax");
+
 	m_max_val = 0;
 	m_min_val = 0xffff;
 
@@ -109,6 +118,8 @@ void ThermalFrame::computeMinMax()
 //////////////////////////////////////////////////////////////////////////
 std::vector<int> ThermalFrame::getOffsetCalibration() const
 {
+	TRACE_SCOPE("getOffsetCalibration");
+
 	std::vector<int> calibration;
 
 	calibration.resize(m_pixels.size());
@@ -132,6 +143,8 @@ std::vector<int> ThermalFrame::getOffsetCalibration() const
 //////////////////////////////////////////////////////////////////////////
 void ThermalFrame::applyOffsetCalibration(const std::vector<int> & calibration)
 {
+	TRACE_SCOPE("applyOffsetCalibration");
+
 	for (size_t i = 0; i < calibration.size(); ++i)
 		m_pixels[i] += calibration[i];
 }
@@ -142,6 +155,8 @@ void ThermalFrame::applyOffsetCalibration(const std::vector<int> & calibration)
 //////////////////////////////////////////////////////////////////////////
 std::vector<double> ThermalFrame::getGainCalibration() const
 {
+	TRACE_SCOPE("getGainCalibration");
+
 	std::vector<double> calibration;
 
 	calibration.resize(m_pixels.size());
@@ -167,6 +182,8 @@ std::vector<double> ThermalFrame::getGainCalibration() const
 //////////////////////////////////////////////////////////////////////////
 void ThermalFrame::applyGainCalibration(const std::vector<double> & calibration)
 {
+	TRACE_SCOPE("applyGainCalibration");
+
 	for (size_t i = 0; i < calibration.size(); ++i)
 		m_pixels[i] = static_cast<uint16_t>(m_pixels[i] * calibration[i]);
 }
@@ -177,6 +194,8 @@ void ThermalFrame::applyGainCalibration(const std::vector<double> & calibration)
 //////////////////////////////////////////////////////////////////////////
 std::vector<uint16_t> ThermalFrame::getZeroPixels() const
 {
+	TRACE_SCOPE("getZeroPixels");
+
 	std::vector<uint16_t> res;
 
 	for (size_t i = 0; i < m_pixels.size(); ++i)
@@ -194,6 +213,8 @@ std::vector<uint16_t> ThermalFrame::getZeroPixels() const
 //////////////////////////////////////////////////////////////////////////
 void ThermalFrame::addBadPixels(const std::vector<uint16_t> & pixels)
 {
+	TRACE_SCOPE("addBadPixels");
+
 	for (size_t i = 0; i < pixels.size(); ++i)
 	{
 		uint16_t pos = pixels[i];
@@ -208,6 +229,8 @@ void ThermalFrame::addBadPixels(const std::vector<uint16_t> & pixels)
 //////////////////////////////////////////////////////////////////////////
 void ThermalFrame::fixBadPixels()
 {
+	TRACE_SCOPE("fixBadPixels");
+
 	size_t i = 0;
 	
 	for (size_t y = 0; y < 156; ++y)
@@ -262,6 +285,8 @@ void ThermalFrame::fixBadPixels()
 //////////////////////////////////////////////////////////////////////////
 void ThermalFrame::fixPixels(const std::vector<uint16_t> & pixels, bool use_given_pixel)
 {
+	TRACE_SCOPE("fixPixels");
+
 	for (size_t i = 0; i < pixels.size(); ++i)
 	{
 		uint32_t pixel = pixels[i];
@@ -313,6 +338,8 @@ void ThermalFrame::fixPixels(const std::vector<uint16_t> & pixels, bool use_give
 //////////////////////////////////////////////////////////////////////////
 void ThermalFrame::subtract(const ThermalFrame & frame)
 {
+	TRACE_SCOPE("subtract");
+
 	for (size_t i = 0; i < frame.m_pixels.size(); ++i)
 	{
 		if (m_pixels[i] >= frame.m_pixels[i])
@@ -328,6 +355,8 @@ void ThermalFrame::subtract(const ThermalFrame & frame)
 //////////////////////////////////////////////////////////////////////////
 void ThermalFrame::add(const ThermalFrame & frame)
 {
+	TRACE_SCOPE("add");
+
 	for (size_t i = 0; i < frame.m_pixels.size(); ++i)
 	{
 		if (m_pixels[i] < 0xffff - frame.m_pixels[i])
@@ -23,6 +23,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <cstdint>
 #include <vector>
 #include <array>
@@ -34,6 +35,11 @@ public:
 	std::array<std::array<bool, 156>, 206>	m_bad_pixels;
 
 	uint8_t m_id;
+	uint16_t m_counter;		// The camera's own frame counter, from the header
+
+	// Where the frame came from, set by whoever takes it off the camera
+	uint64_t m_seq;											// Sequence number of the camera frame
+	std::chrono::steady_clock::time_point m_captured;		// When its USB transfer completed
 
 	uint16_t m_max_val;
 	uint16_t m_min_val;
@@ -0,0 +1,281 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "frame_pipeline.h"
+
+#include <functional>
+
+
+FramePipeline::FramePipeline()
+	: m_first_after_cal(false),
+	m_frame_seq(0),
+	m_frame_first_after_cal(false)
+{
+	m_pipeline.addStage("Calibrate", std::bind(&FramePipeline::calibrateStage, this, std::placeholders::_1));
+	m_pipeline.addStage("Custom", std::bind(&FramePipeline::customStage, this, std::placeholders::_1));
+	m_pipeline.addStage("Analyze", std::bind(&FramePipeline::analyzeStage, this, std::placeholders::_1));
+	m_pipeline.addStage("Colorize", std::bind(&FramePipeline::colorizeStage, this, std::placeholders::_1));
+}
+
+
+FramePipeline::~FramePipeline()
+{
+	stop();
+}
+
+
+FrameProcessor & FramePipeline::getProcessor()
+{
+	return m_processor;
+}
+
+
+void FramePipeline::start()
+{
+	m_pipeline.start();
+}
+
+
+void FramePipeline::stop()
+{
+	m_pipeline.stop();
+}
+
+
+uint64_t FramePipeline::number(const std::vector<uint16_t> & data, bool * first_after_cal)
+{
+	uint8_t id = data.size() > 10 ? static_cast<uint8_t>(data[10]) : 0;
+
+	m_frame_first_after_cal = false;
+
+	// Offset calibration (every time the shutter is heard)
+	if (id == 1)
+		m_first_after_cal = true;
+	else if (id == 3 && m_first_after_cal)
+	{
+		m_first_after_cal = false;
+		m_frame_first_after_cal = true;
+	}
+
+	if (first_after_cal)
+		*first_after_cal = m_frame_first_after_cal;
+
+	return ++m_frame_seq;
+}
+
+
+void FramePipeline::queue(const std::vector<uint16_t> & data, const FrameTimes * times)
+{
+	// This runs on the camera thread, so only the bookkeeping that has to keep up with the camera is done here
+	Item item;
+
+	item.seq				= m_frame_seq;
+	item.first_after_cal	= m_frame_first_after_cal;
+	item.data				= data;
+	item.times				= times ? *times : FrameTimes::arrived();
+
+	m_timings.record(StageTimings::STAGE_UNPACK, item.times.received, item.times.unpacked);
+
+	uint8_t id = data.size() > 10 ? static_cast<uint8_t>(data[10]) : 0;
+
+	// The display skips to the latest result anyway, so a regular frame that finds the pipeline backed up is dropped
+	if (id == 3 && !item.first_after_cal)
+		m_pipeline.tryPush(std::move(item));
+	else
+		m_pipeline.push(std::move(item));
+}
+
+
+uint64_t FramePipeline::push(const std::vector<uint16_t> & data, bool * first_after_cal, const FrameTimes * times)
+{
+	Item item;
+
+	uint64_t seq = number(data, first_after_cal);
+
+	item.seq				= seq;
+	item.first_after_cal	= m_frame_first_after_cal;
+	item.data				= data;
+	item.times				= times ? *times : FrameTimes::arrived();
+
+	m_timings.record(StageTimings::STAGE_UNPACK, item.times.received, item.times.unpacked);
+
+	m_pipeline.push(std::move(item));
+
+	return seq;
+}
+
+
+void FramePipeline::setConfig(const PRenderConfig & config)
+{
+	std::atomic_store(&m_config, config);
+}
+
+
+PRenderConfig FramePipeline::getConfig() const
+{
+	return std::atomic_load(&m_config);
+}
+
+
+void FramePipeline::setStages(const std::shared_ptr<StageChain> & stages)
+{
+	std::atomic_store(&m_stages, stages);
+}
+
+
+PFrameResult FramePipeline::getResult() const
+{
+	return std::atomic_load(&m_result);
+}
+
+
+bool FramePipeline::publish(const PFrameResult & result)
+{
+	PFrameResult current = std::atomic_load(&m_result);
+
+	// A re-render from the UI thread must not replace a newer frame from the camera
+	while (!current || current->seq <= result->seq)
+	{
+		if (std::atomic_compare_exchange_weak(&m_result, &current, result))
+		{
+			onResult(result);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+void FramePipeline::rerender()
+{
+	// The next frame from the camera is going to use the new settings anyway, this is for the one on display
+	PFrameResult previous = std::atomic_load(&m_result);
+	PRenderConfig config = std::atomic_load(&m_config);
+
+	if (!previous || !config)
+		return;
+
+	auto result = std::make_shared<FrameResult>();
+
+	result->seq			= previous->seq;
+	result->raw			= previous->raw;
+	result->calibration	= previous->calibration;
+	result->frame		= previous->frame;
+
+	m_processor.analyze(*result, *config, previous);
+	FrameProcessor::colorize(*result, *config);
+
+	publish(result);
+}
+
+
+std::vector<FramePipeline::StageStats> FramePipeline::getStats() const
+{
+	return m_pipeline.getStats();
+}
+
+
+void FramePipeline::resultShown(const FrameResult & result)
+{
+	// Re-rendered results weren't timed, so they're skipped
+	if (result.times.colorized == TimingClock::time_point())
+		return;
+
+	auto now = TimingClock::now();
+
+	m_timings.record(StageTimings::STAGE_PAINT, result.times.colorized, now);
+	m_timings.record(StageTimings::STAGE_TOTAL, result.times.received, now);
+}
+
+
+void FramePipeline::alarmRaised(const FrameResult & result)
+{
+	// A re-rendered result raises alarms because the settings changed, not the scene, so it isn't timed
+	if (result.times.colorized != TimingClock::time_point())
+		m_timings.record(StageTimings::STAGE_ALARM, result.frame->m_captured, TimingClock::now());
+}
+
+
+const StageTimings & FramePipeline::getTimings() const
+{
+	return m_timings;
+}
+
+
+bool FramePipeline::calibrateStage(Item & item)
+{
+	// The raw data isn't needed after this stage, so it goes with the result
+	item.result = m_processor.calibrate(item.seq, std::move(item.data), item.first_after_cal, item.times.received);
+
+	if (!item.result)
+		return false;
+
+	item.times.calibrated = TimingClock::now();
+	item.result->times = item.times;
+
+	m_timings.record(StageTimings::STAGE_CALIBRATE, item.times.unpacked, item.times.calibrated);
+
+	return true;
+}
+
+
+bool FramePipeline::customStage(Item & item)
+{
+	// The settings are picked here, so all the stages that depend on them see the same ones
+	item.config = std::atomic_load(&m_config);
+
+	if (!item.config)
+		return false;
+
+	// Holding on to the chain keeps it alive while it runs, even if it was replaced in the meantime
+	std::shared_ptr<StageChain> stages = std::atomic_load(&m_stages);
+
+	if (!item.config->filters || !stages || stages->empty())
+		return true;
+
+	// The frame isn't shared with anyone before it's published, so the stages can work on it in place
+	return stages->process(*std::const_pointer_cast<ThermalFrame>(item.result->frame));
+}
+
+
+bool FramePipeline::analyzeStage(Item & item)
+{
+	m_processor.analyze(*item.result, *item.config);
+
+	return true;
+}
+
+
+bool FramePipeline::colorizeStage(Item & item)
+{
+	FrameProcessor::colorize(*item.result, *item.config);
+
+	item.result->times.colorized = TimingClock::now();
+
+	m_timings.record(StageTimings::STAGE_COLORIZE, item.result->times.calibrated, item.result->times.colorized);
+
+	publish(item.result);
+
+	return true;
+}
@@ -0,0 +1,131 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "pipeline.h"
+#include "processor.h"
+#include "stages/stage_registry.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <boost/signals2.hpp>
+
+
+// The camera frames on their way to the screen: calibrated, run through the custom stages, analyzed and colorized
+// on a thread each, with the latest result kept for whoever displays it. A display that falls behind just skips
+// to the latest one.
+// The dialog, the daemon and the throughput harness all go through this, so they all measure the same thing.
+class FramePipeline
+{
+private:
+	// A camera frame on its way through the stages
+	struct Item
+	{
+		uint64_t						seq;
+		bool							first_after_cal;	// The first regular frame after the offset calibration
+		std::vector<uint16_t>			data;				// The raw data, as it came from the camera
+		PRenderConfig					config;				// The settings the frame is processed with
+		FrameTimes						times;
+		std::shared_ptr<FrameResult>	result;
+	};
+
+public:
+	typedef Pipeline<Item>::StageStats StageStats;
+
+private:
+	FrameProcessor		m_processor;
+	Pipeline<Item>		m_pipeline;
+	StageTimings		m_timings;
+
+	// Shared between threads, only accessed through std::atomic_load / std::atomic_store
+	PRenderConfig		m_config;				// The settings new frames are processed with
+	PFrameResult		m_result;				// Latest processed frame
+	std::shared_ptr<StageChain>	m_stages;		// The custom stages, only run from their pipeline stage
+
+	// Camera thread only
+	bool				m_first_after_cal;		// Marks the first frame after the offset calibration
+	uint64_t			m_frame_seq;			// Sequence number of the last camera frame
+	bool				m_frame_first_after_cal;	// The last camera frame is the first one after the offset calibration
+
+public:
+	FramePipeline();
+	~FramePipeline();
+
+	FramePipeline(const FramePipeline &) = delete;
+	FramePipeline & operator=(const FramePipeline &) = delete;
+
+	FrameProcessor & getProcessor();
+
+	void start();
+	void stop();		// Finishes the frames already queued
+
+	// Numbers a camera frame, so it can be recorded before it's queued. Called from one thread, in camera order.
+	// Gives the sequence number of the frame, and if it's the first regular frame after the offset calibration.
+	uint64_t number(const std::vector<uint16_t> & data, bool * first_after_cal = nullptr);
+
+	// Queues the frame number() was last called with, for the camera thread. Regular frames are skipped while the
+	// pipeline is backed up, so a slow display never holds up the camera; calibration frames and the first one after
+	// the offset calibration carry the tables, those wait for room. Without the times it came off the camera, the
+	// frame is timed from here.
+	void queue(const std::vector<uint16_t> & data, const FrameTimes * times = nullptr);
+
+	// Numbers and queues a camera frame, waiting while the pipeline is backed up. For replaying captures as fast
+	// as the pipeline takes them.
+	uint64_t push(const std::vector<uint16_t> & data, bool * first_after_cal = nullptr, const FrameTimes * times = nullptr);
+
+	// Frames are only processed past calibration once there are settings
+	void setConfig(const PRenderConfig & config);
+	PRenderConfig getConfig() const;
+
+	// Replaces the custom stages, from the next frame on. Null or an empty chain runs none.
+	void setStages(const std::shared_ptr<StageChain> & stages);
+
+	PFrameResult getResult() const;
+
+	// Makes the result the latest one, unless a newer frame was published in the meantime
+	bool publish(const PFrameResult & result);
+
+	// Processes the latest frame again, with the current settings
+	void rerender();
+
+	std::vector<StageStats> getStats() const;
+
+	// Times the result from the end of the pipeline to the screen. Called by whoever displays the results, from one thread.
+	void resultShown(const FrameResult & result);
+
+	// Times a highlight alarm raised by the result, from the camera to the alarm. From one thread too.
+	void alarmRaised(const FrameResult & result);
+
+	const StageTimings & getTimings() const;
+
+	// A result was published, from the thread that published it
+	boost::signals2::signal<void(const PFrameResult & result)> onResult;
+
+private:
+	bool calibrateStage(Item & item);
+	bool customStage(Item & item);
+	bool analyzeStage(Item & item);
+	bool colorizeStage(Item & item);
+};
@@ -0,0 +1,119 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Follows the frames a ThermalView process shares, to check what other processes get, and as an example of
+// reading them. Built with shm/ring_reader.cpp only, it doesn't need anything else of ThermalView's.
+//
+//   ThermalViewPeek [--name NAME] [--raw] [--frames N]
+//
+// Prints a line per frame: its sequence number and camera counter, how long after its capture it was read, its
+// range, and how many frames the writer got ahead with since the last one. --raw follows the frames as they came
+// from the camera instead of the calibrated ones. It stops after --frames frames, or when the writer goes away.
+
+#include "shm/ring_reader.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+
+static void usage()
+{
+	std::cerr << "Usage: ThermalViewPeek [--name NAME] [--raw] [--frames N]" << std::endl;
+}
+
+
+int main(int argc, char * argv[])
+{
+	std::string name = ring::DEFAULT_NAME;
+	ring::Kind kind = ring::KIND_CALIBRATED;
+	uint64_t frames = 0;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+
+		if (arg == "--name" && i + 1 < argc)
+			name = argv[++i];
+		else if (arg == "--frames" && i + 1 < argc)
+			frames = strtoull(argv[++i], nullptr, 10);
+		else if (arg == "--raw")
+			kind = ring::KIND_RAW;
+		else
+		{
+			usage();
+			return 1;
+		}
+	}
+
+	RingReader reader;
+
+	if (!reader.open(name))
+	{
+		std::cerr << reader.getError() << std::endl;
+		return 1;
+	}
+
+	std::cerr << name << ": " << reader.getWidth() << "x" << reader.getHeight() << ", " << reader.getSlotCount()
+			  << " slots, written by process " << reader.getWriterPid() << std::endl;
+
+	RingReader::Frame frame;
+	uint64_t next = reader.getWritten(kind);
+	uint64_t count = 0;
+
+	while (!frames || count < frames)
+	{
+		uint64_t written = reader.getWritten(kind);
+
+		if (written <= next)
+		{
+			if (reader.isClosed())
+				break;
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+
+		// Only the latest one matters, the ones in between are counted as missed
+		if (!reader.read(kind, written - 1, frame))
+			continue;
+
+		double age = frame.captured_ns ? (std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count() - frame.captured_ns) / 1e6 : 0;
+
+		printf("%8llu  frame %llu (camera %u, id %u)  %.2f ms old  %u..%u  missed %llu\n",
+			static_cast<unsigned long long>(frame.index), static_cast<unsigned long long>(frame.seq), frame.counter, frame.id,
+			age, frame.min_val, frame.max_val, static_cast<unsigned long long>(written - 1 - next));
+
+		next = written;
+		count++;
+	}
+
+	if (reader.isClosed())
+		std::cerr << "The writer closed it" << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,193 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "perf_counters.h"
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+PerfCounters::PerfCounters()
+{
+	for (int i = 0; i < COUNTER_COUNT; i++)
+		m_fd[i] = -1;
+}
+
+
+PerfCounters::~PerfCounters()
+{
+	close();
+}
+
+
+bool PerfCounters::open()
+{
+	close();
+
+#ifdef __linux__
+	static const struct { uint32_t type; uint64_t config; } events[COUNTER_COUNT] =
+	{
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+		{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	};
+
+	for (int i = 0; i < COUNTER_COUNT; i++)
+	{
+		perf_event_attr attr;
+
+		memset(&attr, 0, sizeof(attr));
+
+		attr.size			= sizeof(attr);
+		attr.type			= events[i].type;
+		attr.config			= events[i].config;
+		attr.exclude_kernel	= 1;
+		attr.exclude_hv		= 1;
+		attr.read_format	= PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		// This thread, on any CPU
+		m_fd[i] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+
+		if (m_fd[i] < 0 && m_error.empty())
+		{
+			m_error = std::string(getName(static_cast<Counter>(i))) + ": " + strerror(errno);
+
+			if (errno == ENOENT || errno == EOPNOTSUPP)
+				m_error += " (no hardware counters here, or not that one)";
+			else if (errno == EACCES || errno == EPERM)
+			{
+				std::ifstream paranoid("/proc/sys/kernel/perf_event_paranoid");
+				int level;
+
+				if (paranoid >> level)
+					m_error += " (perf_event_paranoid is " + std::to_string(level) + ")";
+			}
+		}
+	}
+#else
+	m_error = "hardware counters are only read on Linux";
+#endif
+
+	return isOpen();
+}
+
+
+void PerfCounters::close()
+{
+	for (int i = 0; i < COUNTER_COUNT; i++)
+	{
+#ifdef __linux__
+		if (m_fd[i] >= 0)
+			::close(m_fd[i]);
+#endif
+
+		m_fd[i] = -1;
+	}
+
+	m_error.clear();
+}
+
+
+bool PerfCounters::isOpen() const
+{
+	for (int i = 0; i < COUNTER_COUNT; i++)
+	{
+		if (m_fd[i] >= 0)
+			return true;
+	}
+
+	return false;
+}
+
+
+bool PerfCounters::has(Counter counter) const
+{
+	return m_fd[counter] >= 0;
+}
+
+
+const std::string & PerfCounters::getError() const
+{
+	return m_error;
+}
+
+
+PerfCounters::Values PerfCounters::read() const
+{
+	Values values;
+
+	for (int i = 0; i < COUNTER_COUNT; i++)
+	{
+		values.value[i] = 0;
+		values.valid[i] = false;
+
+#ifdef __linux__
+		// The value, and how long it was enabled and actually counting
+		uint64_t data[3];
+
+		if (m_fd[i] < 0 || ::read(m_fd[i], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)) || !data[2])
+			continue;
+
+		values.value[i] = data[2] < data[1] ? static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2]) : data[0];
+		values.valid[i] = true;
+#endif
+	}
+
+	return values;
+}
+
+
+PerfCounters::Values PerfCounters::difference(const Values & end, const Values & begin)
+{
+	Values values;
+
+	for (int i = 0; i < COUNTER_COUNT; i++)
+	{
+		values.valid[i] = end.valid[i] && begin.valid[i];
+		values.value[i] = values.valid[i] && end.value[i] > begin.value[i] ? end.value[i] - begin.value[i] : 0;
+	}
+
+	return values;
+}
+
+
+const char * PerfCounters::getName(Counter counter)
+{
+	switch (counter)
+	{
+	case CYCLES:			return "cycles";
+	case INSTRUCTIONS:		return "instructions";
+	case L1D_MISSES:		return "l1d_misses";
+	case LLC_MISSES:		return "llc_misses";
+	case BRANCH_MISSES:		return "branch_misses";
+	default:				return "";
+	}
+}
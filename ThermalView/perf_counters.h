@@ -0,0 +1,78 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+
+// Hardware performance counters of the calling thread, through perf_event_open(). They're only there on Linux,
+// and only when the kernel lets us (perf_event_paranoid, containers, virtual machines without a PMU); any of
+// them that can't be opened is just missing, the rest still count.
+//
+// Only user space is counted, so it works with the default perf_event_paranoid of 2.
+class PerfCounters
+{
+public:
+	enum Counter
+	{
+		CYCLES,
+		INSTRUCTIONS,
+		L1D_MISSES,			// L1 data cache read misses
+		LLC_MISSES,			// Last level cache misses
+		BRANCH_MISSES,
+		COUNTER_COUNT
+	};
+
+	struct Values
+	{
+		uint64_t	value[COUNTER_COUNT];		// Scaled up when the kernel had to share the counters
+		bool		valid[COUNTER_COUNT];
+	};
+
+private:
+	int				m_fd[COUNTER_COUNT];
+	std::string		m_error;				// Why the missing counters couldn't be opened
+
+public:
+	PerfCounters();
+	~PerfCounters();
+
+	PerfCounters(const PerfCounters &) = delete;
+	PerfCounters & operator=(const PerfCounters &) = delete;
+
+	// Starts counting for the calling thread. False if none of the counters could be opened.
+	bool open();
+	void close();
+
+	bool isOpen() const;
+	bool has(Counter counter) const;
+	const std::string & getError() const;
+
+	// Counts since open(), from the thread that opened them
+	Values read() const;
+
+	static Values difference(const Values & end, const Values & begin);
+	static const char * getName(Counter counter);
+};
@@ -0,0 +1,300 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// FIFO queue with a fixed capacity. Producers wait while it's full, or give up with tryPush(); consumers wait while
+// it's empty.
+template <class T>
+class BoundedQueue
+{
+private:
+	mutable std::mutex		m_mx;
+	std::condition_variable	m_not_empty;
+	std::condition_variable	m_not_full;
+	std::deque<T>			m_items;
+	size_t					m_capacity;
+	bool					m_closed;
+
+public:
+	explicit BoundedQueue(size_t capacity) : m_capacity(capacity), m_closed(false) {}
+
+	// Waits for a free slot. Returns false if the queue is closed.
+	bool push(T item)
+	{
+		std::unique_lock<std::mutex> lock(m_mx);
+
+		m_not_full.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+
+		if (m_closed)
+			return false;
+
+		m_items.push_back(std::move(item));
+		m_not_empty.notify_one();
+
+		return true;
+	}
+
+	// Never waits. Returns false if the queue is full or closed.
+	bool tryPush(T item)
+	{
+		std::lock_guard<std::mutex> lock(m_mx);
+
+		if (m_closed || m_items.size() >= m_capacity)
+			return false;
+
+		m_items.push_back(std::move(item));
+		m_not_empty.notify_one();
+
+		return true;
+	}
+
+	// Waits for an item. Returns false once the queue is closed and there's nothing left in it.
+	bool pop(T & item)
+	{
+		std::unique_lock<std::mutex> lock(m_mx);
+
+		m_not_empty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+
+		if (m_items.empty())
+			return false;
+
+		item = std::move(m_items.front());
+		m_items.pop_front();
+		m_not_full.notify_one();
+
+		return true;
+	}
+
+	// Refuses new items and wakes up everyone, the items already queued can still be popped
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(m_mx);
+
+		m_closed = true;
+		m_not_empty.notify_all();
+		m_not_full.notify_all();
+	}
+
+	void open()
+	{
+		std::lock_guard<std::mutex> lock(m_mx);
+
+		m_closed = false;
+	}
+
+	size_t size() const
+	{
+		std::lock_guard<std::mutex> lock(m_mx);
+
+		return m_items.size();
+	}
+
+	size_t capacity() const
+	{
+		return m_capacity;
+	}
+};
+
+
+// A chain of stages, each one with its own thread and an input queue. Every stage handles one item at a time,
+// in the order they were queued, so items leave the pipeline in the order they came in while the stages work
+// on different items in parallel.
+template <class T>
+class Pipeline
+{
+public:
+	// Processes the item in place. Returning false drops it, the next stages never see it.
+	typedef std::function<bool(T &)> Handler;
+
+	struct StageStats
+	{
+		std::string	name;
+		size_t		queued;		// Items waiting in the input queue
+		size_t		capacity;	// Size of the input queue
+		uint64_t	processed;	// Items handled so far
+		uint64_t	dropped;	// Items the handler dropped
+		uint64_t	skipped;	// Items tryPush() turned away because the queue was full, first stage only
+		double		busy;		// Fraction of the time since start() spent in the handler
+		uint64_t	busy_ns;	// Time spent in the handler since start(), to take the fraction over a shorter period
+	};
+
+private:
+	struct Stage
+	{
+		std::string				name;
+		Handler					handler;
+		BoundedQueue<T>			queue;
+		std::thread				thread;
+		std::atomic<uint64_t>	processed;
+		std::atomic<uint64_t>	dropped;
+		std::atomic<uint64_t>	skipped;
+		std::atomic<uint64_t>	busy_ns;
+
+		Stage(const std::string & name, const Handler & handler, size_t capacity)
+			: name(name), handler(handler), queue(capacity), processed(0), dropped(0), skipped(0), busy_ns(0) {}
+	};
+
+	std::vector<std::unique_ptr<Stage>>		m_stages;
+	std::chrono::steady_clock::time_point	m_start;
+	bool									m_running;
+
+public:
+	Pipeline() : m_running(false) {}
+	~Pipeline() { stop(); }
+
+	Pipeline(const Pipeline &) = delete;
+	Pipeline & operator=(const Pipeline &) = delete;
+
+	// Stages can only be added while the pipeline is stopped
+	void addStage(const std::string & name, const Handler & handler, size_t capacity = 4)
+	{
+		if (!m_running)
+			m_stages.push_back(std::unique_ptr<Stage>(new Stage(name, handler, capacity)));
+	}
+
+	void start()
+	{
+		if (m_running)
+			return;
+
+		m_running = true;
+		m_start = std::chrono::steady_clock::now();
+
+		for (size_t i = 0; i < m_stages.size(); ++i)
+		{
+			Stage & stage = *m_stages[i];
+
+			stage.processed = 0;
+			stage.dropped = 0;
+			stage.skipped = 0;
+			stage.busy_ns = 0;
+
+			stage.queue.open();
+			stage.thread = std::thread(&Pipeline::run, this, i);
+		}
+	}
+
+	// Finishes the items already queued, then stops the threads
+	void stop()
+	{
+		if (!m_running)
+			return;
+
+		// Front to back, so every stage gets everything its predecessor produced before it's closed
+		for (auto & stage : m_stages)
+		{
+			stage->queue.close();
+			stage->thread.join();
+		}
+
+		m_running = false;
+	}
+
+	// Queues an item for the first stage, waiting while that stage is backed up. Returns false if it's not running.
+	bool push(T item)
+	{
+		if (m_stages.empty())
+			return false;
+
+		return m_stages[0]->queue.push(std::move(item));
+	}
+
+	// Queues an item for the first stage if it has room, without waiting. Returns false if it doesn't, or it's not running.
+	bool tryPush(T item)
+	{
+		if (m_stages.empty())
+			return false;
+
+		if (m_stages[0]->queue.tryPush(std::move(item)))
+			return true;
+
+		++m_stages[0]->skipped;
+
+		return false;
+	}
+
+	std::vector<StageStats> getStats() const
+	{
+		std::vector<StageStats> stats;
+
+		double elapsed = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count());
+
+		for (auto & stage : m_stages)
+		{
+			StageStats s;
+
+			s.name		= stage->name;
+			s.queued	= stage->queue.size();
+			s.capacity	= stage->queue.capacity();
+			s.processed	= stage->processed;
+			s.dropped	= stage->dropped;
+			s.skipped	= stage->skipped;
+			s.busy		= m_running && elapsed > 0 ? stage->busy_ns / elapsed : 0;
+			s.busy_ns	= stage->busy_ns;
+
+			stats.push_back(s);
+		}
+
+		return stats;
+	}
+
+private:
+	void run(size_t idx)
+	{
+		Stage & stage = *m_stages[idx];
+		Stage * next = idx + 1 < m_stages.size() ? m_stages[idx + 1].get() : nullptr;
+
+		TRACE_THREAD_NAME(stage.name);
+
+		T item;
+
+		while (stage.queue.pop(item))
+		{
+			auto begin = std::chrono::steady_clock::now();
+			bool keep = stage.handler(item);
+
+			stage.busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+			++stage.processed;
+
+			if (!keep)
+				++stage.dropped;
+			else if (next)
+				next->queue.push(std::move(item));
+		}
+	}
+};
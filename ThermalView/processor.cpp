@@ -0,0 +1,448 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "processor.h"
+#include "recording/snapshot.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+
+namespace fs = boost::filesystem;
+
+static const char CALIBRATION_DIR[] = "calibration";	// The calibration tables of every camera that was connected
+
+
+FrameProcessor::FrameProcessor()
+	: m_next_calibration(std::make_shared<Calibration>()),
+	m_get_extra_cal(false),
+	m_calibration(std::make_shared<Calibration>()),
+	m_saving(false),
+	m_save_stop(false)
+{
+}
+
+
+FrameProcessor::~FrameProcessor()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_save_mx);
+
+		m_save_stop = true;
+		m_save_cv.notify_all();
+	}
+
+	if (m_save_thread.joinable())
+		m_save_thread.join();
+}
+
+
+void FrameProcessor::captureExtraCalibration()
+{
+	m_get_extra_cal = true;
+}
+
+
+std::shared_ptr<const std::vector<int>> FrameProcessor::getExtraCalibration() const
+{
+	return std::atomic_load(&m_extra_cal);
+}
+
+
+std::shared_ptr<FrameResult> FrameProcessor::calibrate(uint64_t seq, std::vector<uint16_t> && data, bool first_after_cal, TimingClock::time_point captured)
+{
+	TRACE_SCOPE("Calibrate");
+
+	// Another camera was connected, or a recording opened
+	if (PCalibration next = std::atomic_exchange(&m_next_calibration, PCalibration()))
+		m_calibration = next;
+
+	// Let's extract and process the data
+	ThermalFrame frame(data);
+
+	frame.m_seq			= seq;
+	frame.m_captured	= captured;
+	
+	// See if it's a key frame
+	if (frame.m_id != 3)
+	{
+		switch (frame.m_id)
+		{
+			// Gain calibration
+			case 4:
+			{
+				auto calibration = std::make_shared<Calibration>(*m_calibration);
+
+				calibration->gain = frame.getGainCalibration();
+				calibration->unknown_gain = frame.getZeroPixels();
+
+				m_calibration = calibration;
+
+				saveCalibration(m_calibration);
+			}
+			break;
+
+			// Offset calibration (every time the shutter is heard)
+			case 1:
+			{
+				auto calibration = std::make_shared<Calibration>(*m_calibration);
+
+				frame.applyGainCalibration(calibration->gain);
+				frame.computeMinMax();
+				
+				calibration->offset = frame.getOffsetCalibration();
+
+				m_calibration = calibration;
+
+				saveCalibration(m_calibration);
+			}
+			break;
+		}
+
+		return std::shared_ptr<FrameResult>();
+	}
+	
+	
+	// It's a regular frame, so let's process it
+	
+	frame.addBadPixels(frame.getZeroPixels());
+	frame.addBadPixels(m_calibration->unknown_gain);
+
+	frame.applyGainCalibration(m_calibration->gain);
+	frame.applyOffsetCalibration(m_calibration->offset);
+
+	frame.computeMinMax();
+
+	frame.fixBadPixels();
+
+	// Do we have to use it as an extra calibration frame?
+	if (first_after_cal && m_get_extra_cal.exchange(false))
+	{
+		std::atomic_store(&m_extra_cal, std::shared_ptr<const std::vector<int>>(std::make_shared<std::vector<int>>(frame.getOffsetCalibration())));
+
+		saveCalibration(m_calibration);
+	}
+
+	auto result = std::make_shared<FrameResult>();
+
+	result->seq = seq;
+	result->frame = std::make_shared<ThermalFrame>(std::move(frame));
+	result->calibration = m_calibration;
+
+	// Kept so snapshots can be calibrated again later, the caller is done with it anyway
+	result->raw = std::make_shared<std::vector<uint16_t>>(std::move(data));
+
+	return result;
+}
+
+
+void FrameProcessor::analyze(FrameResult & result, const RenderConfig & config, const PFrameResult & previous) const
+{
+	TRACE_SCOPE("Analyze");
+
+	const auto & frame = result.frame;
+
+	result.extra_cal.reset();
+
+	if (config.use_extra_cal)
+	{
+		result.extra_cal = std::atomic_load(&m_extra_cal);
+
+		if (result.extra_cal && result.extra_cal->empty())
+			result.extra_cal.reset();
+	}
+
+	// Same frame and same extra calibration, only the colors changed
+	if (previous && previous->frame == frame && previous->extra_cal == result.extra_cal)
+	{
+		result.frame_extra	= previous->frame_extra;
+		result.histogram	= previous->histogram;
+		return;
+	}
+
+	// Handle extra calibration, on a copy since the frame itself may be on display
+	if (result.extra_cal)
+	{
+		auto frame_extra = std::make_shared<ThermalFrame>(*frame);
+
+		frame_extra->applyOffsetCalibration(*result.extra_cal);
+		frame_extra->computeMinMax();
+
+		result.frame_extra = frame_extra;
+	}
+	else
+		result.frame_extra = frame;
+
+	result.histogram = computeHistogram(*result.frame_extra);
+}
+
+
+void FrameProcessor::colorize(FrameResult & result, const RenderConfig & config)
+{
+	TRACE_SCOPE("Colorize");
+
+	const ThermalFrame & frame_extra = *result.frame_extra;
+
+	// The lookup table, which maps and scales the frame in one go
+	if (config.auto_range)
+		result.lut = config.profile->getLut(frame_extra, frame_extra.m_min_val, result.frame->m_max_val);
+	else
+		result.lut = config.profile->getLut(frame_extra, config.manual_min, config.manual_max);
+
+	config.profile->countIsotherms(*result.histogram, frame_extra.m_min_val, result.lut, result.isotherm_counts);
+
+	result.profile		= config.profile;
+	result.auto_range	= config.auto_range;
+}
+
+
+std::shared_ptr<const std::vector<uint16_t>> FrameProcessor::computeHistogram(const ThermalFrame & frame)
+{
+	TRACE_SCOPE("Histogram");
+
+	auto vect = std::make_shared<std::vector<uint16_t>>((frame.m_max_val - frame.m_min_val) + 1, 0);
+
+	for (uint16_t v : frame.m_pixels)
+		++(*vect)[v - frame.m_min_val];
+
+	return vect;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// saveSnapshot - The frame with its calibration tables and the way it was displayed
+//////////////////////////////////////////////////////////////////////////
+bool FrameProcessor::saveSnapshot(const std::string & file, const FrameResult & result)
+{
+	const ThermalFrame & frame = *result.frame_extra;
+	const ColorProfile & profile = *result.profile;
+
+	snapshot::SnapshotHeader header;
+
+	memset(&header, 0, sizeof(header));
+
+	header.width		= 206;
+	header.height		= 156;
+	header.time			= std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	header.seq			= result.seq;
+	header.frame_id		= frame.m_id;
+	header.flags		= (result.auto_range ? snapshot::FLAG_AUTO_RANGE : 0) | (result.extra_cal ? snapshot::FLAG_EXTRA_OFFSET : 0);
+	header.range_min	= result.lut.min_val;
+	header.range_max	= result.lut.max_val;
+	header.lut_first	= result.lut.first;
+
+	// The int tables are stored as int32_t
+	static_assert(sizeof(int) == sizeof(int32_t), "The calibration tables are written as they are");
+
+	std::vector<uint8_t> bad_pixels(header.width * header.height);
+
+	for (uint32_t y = 0; y < header.height; ++y)
+	{
+		for (uint32_t x = 0; x < header.width; ++x)
+			bad_pixels[y * header.width + x] = frame.m_bad_pixels[x][y] ? 1 : 0;
+	}
+
+	std::vector<snapshot::IsothermEntry> isotherms;
+
+	for (auto & isotherm : profile.getIsotherms())
+	{
+		snapshot::IsothermEntry entry = { isotherm.low, isotherm.high, isotherm.r, isotherm.g, isotherm.b, isotherm.alpha };
+
+		isotherms.push_back(entry);
+	}
+
+	std::vector<char> name(profile.getName().begin(), profile.getName().end());
+
+	std::vector<Snapshot::Section> sections;
+
+	if (result.raw)
+		Snapshot::addSection(sections, snapshot::SECTION_RAW, *result.raw);
+
+	Snapshot::addSection(sections, snapshot::SECTION_PIXELS, frame.m_pixels);
+
+	if (result.calibration)
+	{
+		Snapshot::addSection(sections, snapshot::SECTION_GAIN, result.calibration->gain);
+		Snapshot::addSection(sections, snapshot::SECTION_UNKNOWN_GAIN, result.calibration->unknown_gain);
+		Snapshot::addSection(sections, snapshot::SECTION_OFFSET, result.calibration->offset);
+	}
+
+	if (result.extra_cal)
+		Snapshot::addSection(sections, snapshot::SECTION_EXTRA_OFFSET, *result.extra_cal);
+
+	Snapshot::addSection(sections, snapshot::SECTION_BAD_PIXELS, bad_pixels);
+	Snapshot::addSection(sections, snapshot::SECTION_LUT_RGB, result.lut.rgb);
+	Snapshot::addSection(sections, snapshot::SECTION_LUT_BAND, result.lut.band);
+	Snapshot::addSection(sections, snapshot::SECTION_PROFILE_NAME, name);
+	Snapshot::addSection(sections, snapshot::SECTION_ISOTHERMS, isotherms);
+
+	return Snapshot::save(file, header, sections);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// loadCalibration - The tables the camera had last time, so its frames can be shown before it calibrates
+//////////////////////////////////////////////////////////////////////////
+void FrameProcessor::loadCalibration(const std::string & device)
+{
+	const size_t PIXELS = 206 * 156;
+
+	auto calibration = std::make_shared<Calibration>();
+
+	calibration->device = device;
+
+	// The file may be about to be replaced by tables of this camera still waiting to be saved
+	waitForSave();
+
+	// The extra calibration belongs to the previous camera, and would be saved with this one's tables
+	std::atomic_store(&m_extra_cal, std::shared_ptr<const std::vector<int>>());
+
+	Snapshot stored;
+
+	if (!device.empty() && stored.open((fs::path(CALIBRATION_DIR) / (device + ".tvs")).string()) &&
+		stored.getHeader().width == 206 && stored.getHeader().height == 156)
+	{
+		// The tables are applied pixel by pixel, so any other size is a damaged file
+		size_t count;
+
+		if (const double * gain = stored.getSection<double>(snapshot::SECTION_GAIN, count))
+			if (count == PIXELS)
+				calibration->gain.assign(gain, gain + count);
+
+		if (const uint16_t * unknown_gain = stored.getSection<uint16_t>(snapshot::SECTION_UNKNOWN_GAIN, count))
+			std::copy_if(unknown_gain, unknown_gain + count, std::back_inserter(calibration->unknown_gain), [PIXELS](uint16_t pos) { return pos < PIXELS; });
+
+		if (const int32_t * offset = stored.getSection<int32_t>(snapshot::SECTION_OFFSET, count))
+			if (count == PIXELS)
+				calibration->offset.assign(offset, offset + count);
+
+		if (const int32_t * extra = stored.getSection<int32_t>(snapshot::SECTION_EXTRA_OFFSET, count))
+			if (count == PIXELS)
+				std::atomic_store(&m_extra_cal, std::shared_ptr<const std::vector<int>>(std::make_shared<std::vector<int>>(extra, extra + count)));
+	}
+
+	// calibrate() switches to it before the next frame
+	std::atomic_store(&m_next_calibration, PCalibration(calibration));
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// saveCalibration - Keeps the tables for the next time the camera is connected
+//////////////////////////////////////////////////////////////////////////
+void FrameProcessor::saveCalibration(const PCalibration & calibration)
+{
+	if (calibration->device.empty())
+		return;
+
+	std::lock_guard<std::mutex> lock(m_save_mx);
+
+	// Tables that weren't written yet are out of date anyway
+	m_save_calibration = calibration;
+	m_save_extra_cal = std::atomic_load(&m_extra_cal);
+
+	if (!m_save_thread.joinable())
+		m_save_thread = std::thread(&FrameProcessor::saveThread, this);
+
+	m_save_cv.notify_all();
+}
+
+
+void FrameProcessor::waitForSave()
+{
+	std::unique_lock<std::mutex> lock(m_save_mx);
+
+	m_save_cv.wait(lock, [this] { return !m_save_calibration && !m_saving; });
+}
+
+
+void FrameProcessor::saveThread()
+{
+	TRACE_THREAD_NAME("Calibration save");
+
+	std::unique_lock<std::mutex> lock(m_save_mx);
+
+	// Whatever is waiting gets written before stopping
+	while (m_save_calibration || !m_save_stop)
+	{
+		if (!m_save_calibration)
+		{
+			m_save_cv.wait(lock);
+			continue;
+		}
+
+		PCalibration calibration;
+		std::shared_ptr<const std::vector<int>> extra_cal;
+
+		calibration.swap(m_save_calibration);
+		extra_cal.swap(m_save_extra_cal);
+		m_saving = true;
+
+		lock.unlock();
+		writeCalibration(*calibration, extra_cal);
+		lock.lock();
+
+		m_saving = false;
+		m_save_cv.notify_all();
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// writeCalibration - The tables and the extra calibration as a snapshot in the calibration directory
+//////////////////////////////////////////////////////////////////////////
+void FrameProcessor::writeCalibration(const Calibration & calibration, const std::shared_ptr<const std::vector<int>> & extra_cal)
+{
+	TRACE_SCOPE("Save calibration");
+
+	// A snapshot without a frame
+	snapshot::SnapshotHeader header;
+
+	memset(&header, 0, sizeof(header));
+
+	header.width	= 206;
+	header.height	= 156;
+	header.time		= std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+	std::vector<Snapshot::Section> sections;
+
+	Snapshot::addSection(sections, snapshot::SECTION_GAIN, calibration.gain);
+	Snapshot::addSection(sections, snapshot::SECTION_UNKNOWN_GAIN, calibration.unknown_gain);
+	Snapshot::addSection(sections, snapshot::SECTION_OFFSET, calibration.offset);
+
+	if (extra_cal && !extra_cal->empty())
+		Snapshot::addSection(sections, snapshot::SECTION_EXTRA_OFFSET, *extra_cal);
+
+	boost::system::error_code ec;
+
+	fs::create_directories(CALIBRATION_DIR, ec);
+
+	// Written next to it and renamed over it, so the file is never left half written
+	fs::path path = fs::path(CALIBRATION_DIR) / (calibration.device + ".tvs");
+	fs::path temp = path.string() + ".tmp";
+
+	if (Snapshot::save(temp.string(), header, sections))
+		fs::rename(temp, path, ec);
+}
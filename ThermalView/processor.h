@@ -0,0 +1,146 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "frame.h"
+#include "color_profile/color_profile.h"
+#include "stage_timing.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// The processing settings. A published config is never modified, changes publish a new one.
+struct RenderConfig
+{
+	std::shared_ptr<const ColorProfile>	profile;		// The profile used for rendering
+	bool								use_extra_cal;
+	bool								filters;		// The custom stages run, off when the display is behind
+	bool								auto_range;
+	int									manual_min;
+	int									manual_max;
+};
+
+// The calibration tables frames are processed with, replaced as a whole when a calibration frame comes in
+struct Calibration
+{
+	std::string				device;			// The camera the tables belong to, empty when they aren't kept
+	std::vector<double>		gain;			// Gain calibration data - Frame ID 4
+	std::vector<uint16_t>	unknown_gain;	// Unknown gain pixels - Frame ID 4
+	std::vector<int>		offset;			// Offset calibration - Frame ID 1
+};
+
+typedef std::shared_ptr<const Calibration> PCalibration;
+
+// A processed frame, ready to be displayed. A published result is never modified, changes publish a new one.
+struct FrameResult
+{
+	uint64_t										seq;				// Sequence number of the camera frame
+	std::shared_ptr<const std::vector<uint16_t>>	raw;				// The frame as it came from the camera
+	PCalibration									calibration;		// What frame was calibrated with
+	std::shared_ptr<const ThermalFrame>				frame;				// The calibrated frame
+	std::shared_ptr<const ThermalFrame>				frame_extra;		// The frame after extra calibration
+	std::shared_ptr<const std::vector<int>>			extra_cal;			// The extra calibration applied to frame_extra, if any
+	std::shared_ptr<const std::vector<uint16_t>>	histogram;			// Pixel count for each value in [frame_extra->m_min_val, frame_extra->m_max_val]
+	ColorProfile::Lut								lut;				// The lookup table for displaying frame_extra
+	std::shared_ptr<const ColorProfile>				profile;			// The profile lut was made with, so it's rendered with the same isotherms
+	bool											auto_range;			// Whether lut was made for the range of the frame
+	std::vector<uint32_t>							isotherm_counts;	// Number of pixels in each isotherm
+	FrameTimes										times;				// When it went through the stages
+};
+
+typedef std::shared_ptr<const RenderConfig> PRenderConfig;
+typedef std::shared_ptr<const FrameResult> PFrameResult;
+
+
+// Turns the camera frames into calibrated frames, and those into something that can be displayed.
+// Nothing in here needs a display, it's shared by the dialog and the headless daemon.
+//
+// calibrate() keeps the calibration tables, so it has to be called from one thread, in frame order. It keeps the
+// tables of every camera on disk, so the next time the camera is connected its frames can be calibrated right away.
+// They're written by a thread of its own, a slow disk doesn't hold up the frames behind a calibration frame.
+// The rest can be called from anywhere.
+class FrameProcessor
+{
+private:
+	// Shared between threads, only accessed through std::atomic_load / std::atomic_store
+	std::shared_ptr<const std::vector<int>>	m_extra_cal;			// Extra offset calibration
+	PCalibration							m_next_calibration;		// Replaces the tables of calibrate(), with its next frame
+
+	std::atomic<bool>						m_get_extra_cal;		// Do we have to fetch a good frame for it?
+
+	// calibrate() only
+	PCalibration							m_calibration;			// Current calibration tables
+
+	// The tables waiting for the save thread, only the latest ones are kept
+	std::thread								m_save_thread;
+	std::mutex								m_save_mx;
+	std::condition_variable					m_save_cv;
+	PCalibration							m_save_calibration;
+	std::shared_ptr<const std::vector<int>>	m_save_extra_cal;
+	bool									m_saving;				// The save thread is writing
+	bool									m_save_stop;
+
+public:
+	FrameProcessor();
+	~FrameProcessor();					// Writes the tables still waiting
+
+	FrameProcessor(const FrameProcessor &) = delete;
+	FrameProcessor & operator=(const FrameProcessor &) = delete;
+
+	// Switches to the tables kept for the camera. An empty device starts from scratch, and nothing is kept.
+	void loadCalibration(const std::string & device);
+
+	// The first regular frame after the next shutter becomes the extra calibration
+	void captureExtraCalibration();
+	std::shared_ptr<const std::vector<int>> getExtraCalibration() const;
+
+	// Calibrates a camera frame, captured at the given time. Calibration frames update the tables and give null.
+	std::shared_ptr<FrameResult> calibrate(uint64_t seq, std::vector<uint16_t> && data, bool first_after_cal,
+		TimingClock::time_point captured = TimingClock::time_point());
+
+	// Applies the extra calibration and computes the histogram. If previous holds the same frame, its work is reused.
+	void analyze(FrameResult & result, const RenderConfig & config, const PFrameResult & previous = PFrameResult()) const;
+
+	// Builds the lookup table and counts the isotherm pixels
+	static void colorize(FrameResult & result, const RenderConfig & config);
+
+	static std::shared_ptr<const std::vector<uint16_t>> computeHistogram(const ThermalFrame & frame);
+
+	// Saves the frame with its calibration tables and the way it was displayed, as a radiometric snapshot
+	static bool saveSnapshot(const std::string & file, const FrameResult & result);
+
+private:
+	void saveCalibration(const PCalibration & calibration);
+	void waitForSave();
+	void saveThread();
+
+	static void writeCalibration(const Calibration & calibration, const std::shared_ptr<const std::vector<int>> & extra_cal);
+};
@@ -0,0 +1,119 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "quality_controller.h"
+
+
+static const QualityLevel DEFAULT_LEVELS[] =
+{
+	{ 0, 1, 1, true },
+	{ 1, 1, 1, true },
+	{ 2, 1, 1, true },
+	{ 2, 4, 1, true },
+	{ 2, 4, 2, false },
+};
+
+
+QualityController::QualityController()
+	: QualityController(std::vector<QualityLevel>(DEFAULT_LEVELS, DEFAULT_LEVELS + sizeof(DEFAULT_LEVELS) / sizeof(DEFAULT_LEVELS[0])))
+{
+}
+
+
+QualityController::QualityController(const std::vector<QualityLevel> & levels)
+	: m_levels(levels),
+	m_level(0),
+	m_high_load(0.8),
+	m_low_load(0.5),
+	m_down_after(2),
+	m_up_after(5),
+	m_over(0),
+	m_under(0)
+{
+	if (m_levels.empty())
+		m_levels.push_back(DEFAULT_LEVELS[0]);
+}
+
+
+void QualityController::setThresholds(double high_load, double low_load, int down_after, int up_after)
+{
+	m_high_load		= high_load;
+	m_low_load		= low_load;
+	m_down_after	= down_after;
+	m_up_after		= up_after;
+}
+
+
+bool QualityController::update(double cost, double interval)
+{
+	// No frames, nothing to go by
+	if (interval <= 0)
+		return false;
+
+	double load = cost / interval;
+
+	m_over	= load > m_high_load ? m_over + 1 : 0;
+	m_under	= load < m_low_load ? m_under + 1 : 0;
+
+	size_t level = m_level;
+
+	if (m_over >= m_down_after && m_level + 1 < m_levels.size())
+		++m_level;
+	else if (m_under >= m_up_after && m_level > 0)
+		--m_level;
+
+	if (level == m_level)
+		return false;
+
+	// The measurements so far were taken at the old level
+	m_over = 0;
+	m_under = 0;
+
+	return true;
+}
+
+
+void QualityController::reset()
+{
+	m_level = 0;
+	m_over = 0;
+	m_under = 0;
+}
+
+
+size_t QualityController::getLevelIndex() const
+{
+	return m_level;
+}
+
+
+size_t QualityController::getLevelCount() const
+{
+	return m_levels.size();
+}
+
+
+const QualityLevel & QualityController::getLevel() const
+{
+	return m_levels[m_level];
+}
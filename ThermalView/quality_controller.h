@@ -0,0 +1,76 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+
+// How much of the display work is done at a quality level. Acquisition, calibration (extra calibration included),
+// the alarms and recording are never part of it, only what ends up on screen.
+struct QualityLevel
+{
+	int		scaling_steps;		// How many steps cheaper than the chosen one the scaling is (bicubic, bilinear, nearest)
+	int		histogram_every;	// The histogram is drawn for every this many frames shown
+	int		picture_every;		// The picture is redrawn for every this many frames shown
+	bool	filters;			// The optional display filters run
+};
+
+
+// Keeps the processing of a frame within the time between two camera frames. Fed once in a while with how long
+// the slowest part of the processing took per frame and how far apart the frames came, it steps down to the
+// next level when over budget, and back up once there's room again. Stepping up takes longer, so it doesn't
+// bounce between two levels.
+class QualityController
+{
+private:
+	std::vector<QualityLevel>	m_levels;		// From the best to the cheapest
+	size_t						m_level;
+
+	double						m_high_load;	// Steps down above this fraction of the frame interval...
+	double						m_low_load;		// ...and up below this one
+	int							m_down_after;	// Consecutive updates it takes
+	int							m_up_after;
+
+	int							m_over;			// Consecutive updates over and under the budget
+	int							m_under;
+
+public:
+	// The default levels: the scaling gets cheaper, then the histogram gets drawn less often, then the picture
+	// and no filters
+	QualityController();
+	explicit QualityController(const std::vector<QualityLevel> & levels);
+
+	void setThresholds(double high_load, double low_load, int down_after, int up_after);
+
+	// Takes the cost of a frame and the interval between camera frames, in any unit as long as it's the same.
+	// Gives true if the level changed.
+	bool update(double cost, double interval);
+
+	void reset();		// Back to the best level
+
+	size_t getLevelIndex() const;
+	size_t getLevelCount() const;
+	const QualityLevel & getLevel() const;
+};
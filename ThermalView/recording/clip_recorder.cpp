@@ -0,0 +1,434 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "recording/clip_recorder.h"
+#include "recording/recorder.h"
+#include "trace.h"
+#include <algorithm>
+
+static const uint64_t NO_SEQ = UINT64_MAX;
+
+
+//////////////////////////////////////////////////////////////////////////
+/// Constructor
+//////////////////////////////////////////////////////////////////////////
+ClipRecorder::ClipRecorder()
+	: m_frame_words(0), m_last_seq(0), m_empty(true), m_pre(0), m_post(0), m_triggered(false), m_saving(false), m_stop(false),
+	m_clips_saved(0), m_clips_failed(0), m_frames_lost(0)
+{
+	m_evicted_gain.used = false;
+	m_evicted_offset.used = false;
+}
+
+ClipRecorder::~ClipRecorder()
+{
+	close();
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// open - Allocates the ring and starts the save thread
+//////////////////////////////////////////////////////////////////////////
+bool ClipRecorder::open(size_t budget, size_t frame_words, std::chrono::nanoseconds pre, std::chrono::nanoseconds post)
+{
+	close();
+
+	size_t capacity = budget / (frame_words * sizeof(uint16_t) + sizeof(Slot));
+
+	// Two more frames go into the calibration slots
+	if (capacity < 4 || !frame_words)
+		return false;
+
+	capacity -= 2;
+
+	std::lock_guard<std::mutex> lock(m_mx);
+
+	m_slots.resize(capacity);
+
+	for (auto & slot : m_slots)
+	{
+		slot.used = false;
+		slot.data.reserve(frame_words);
+	}
+
+	m_evicted_gain.used = false;
+	m_evicted_gain.data.reserve(frame_words);
+	m_evicted_offset.used = false;
+	m_evicted_offset.data.reserve(frame_words);
+
+	m_frame_words = frame_words;
+	m_pre = pre;
+	m_post = post;
+	m_empty = true;
+	m_last_seq = 0;
+	m_triggered = false;
+	m_stop = false;
+	m_clips_saved = 0;
+	m_clips_failed = 0;
+	m_frames_lost = 0;
+
+	m_thread = std::thread(&ClipRecorder::saveThread, this);
+
+	return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// close - Saves what was triggered, then frees the ring
+//////////////////////////////////////////////////////////////////////////
+void ClipRecorder::close()
+{
+	if (!m_thread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mx);
+
+		if (m_triggered)
+			seal();
+
+		m_stop = true;
+		m_cv.notify_all();
+	}
+
+	m_thread.join();
+
+	std::lock_guard<std::mutex> lock(m_mx);
+
+	std::vector<Slot>().swap(m_slots);
+	std::vector<uint16_t>().swap(m_evicted_gain.data);
+	std::vector<uint16_t>().swap(m_evicted_offset.data);
+
+	m_frame_words = 0;
+}
+
+
+bool ClipRecorder::isOpen() const
+{
+	return m_thread.joinable();
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// addFrame - Copies the frame into its slot, without allocating
+//////////////////////////////////////////////////////////////////////////
+void ClipRecorder::addFrame(const std::vector<uint16_t> & data, uint64_t seq, TimePoint time)
+{
+	std::lock_guard<std::mutex> lock(m_mx);
+
+	if (m_slots.empty() || data.size() > m_frame_words)
+		return;
+
+	// Don't let a clip that waits for its end grow into its own start, end it while the saver can still get to it
+	if (m_triggered && m_pending.first_seq != NO_SEQ && seq - m_pending.first_seq >= m_slots.size() - m_slots.size() / 8)
+		seal();
+
+	Slot & slot = m_slots[seq % m_slots.size()];
+
+	// A calibration frame that falls out of the ring is still needed by the frames after it
+	if (slot.used && (slot.id == 4 || slot.id == 1))
+	{
+		Slot & evicted = slot.id == 4 ? m_evicted_gain : m_evicted_offset;
+
+		evicted.time	= slot.time;
+		evicted.seq		= slot.seq;
+		evicted.id		= slot.id;
+		evicted.used	= true;
+		evicted.data.assign(slot.data.begin(), slot.data.end());
+	}
+
+	slot.time	= time;
+	slot.seq	= seq;
+	slot.id		= data.size() > 10 ? static_cast<uint8_t>(data[10]) : 0;
+	slot.used	= true;
+	slot.data.assign(data.begin(), data.end());
+
+	m_last_seq = seq;
+	m_empty = false;
+
+	if (m_triggered)
+	{
+		if (m_pending.first_seq == NO_SEQ)
+			m_pending.first_seq = seq;
+
+		if (time >= m_trigger_time + m_post)
+			seal();
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// trigger - Starts a clip, from the frames of the pre-trigger window
+//////////////////////////////////////////////////////////////////////////
+bool ClipRecorder::trigger(const std::string & file)
+{
+	std::lock_guard<std::mutex> lock(m_mx);
+
+	if (m_slots.empty() || m_triggered)
+		return false;
+
+	m_trigger_time = std::chrono::steady_clock::now();
+
+	m_pending.file = file;
+	m_pending.first_seq = NO_SEQ;
+
+	// The oldest frame still in the pre-trigger window
+	if (!m_empty)
+	{
+		for (uint64_t seq = m_last_seq + 1; seq-- > oldestSeq(); )
+		{
+			const Slot * slot = findFrame(seq);
+
+			if (!slot)
+				continue;
+
+			if (slot->time < m_trigger_time - m_pre)
+				break;
+
+			m_pending.first_seq = seq;
+		}
+	}
+
+	m_triggered = true;
+
+	if (m_post.count() <= 0)
+		seal();
+
+	m_cv.notify_all();
+
+	return true;
+}
+
+
+void ClipRecorder::flush()
+{
+	std::unique_lock<std::mutex> lock(m_mx);
+
+	m_cv.wait(lock, [this] { return m_stop || (!m_triggered && m_clips.empty() && !m_saving); });
+}
+
+
+ClipRecorder::Stats ClipRecorder::getStats()
+{
+	std::lock_guard<std::mutex> lock(m_mx);
+
+	Stats stats;
+
+	stats.clips_saved	= m_clips_saved;
+	stats.clips_failed	= m_clips_failed;
+	stats.frames_lost	= m_frames_lost;
+	stats.triggered		= m_triggered;
+	stats.capacity		= m_slots.size();
+
+	return stats;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// seal - Ends the triggered clip at the newest frame, and hands it to the save thread
+//////////////////////////////////////////////////////////////////////////
+void ClipRecorder::seal()
+{
+	m_triggered = false;
+
+	if (m_pending.first_seq == NO_SEQ)
+		++m_clips_failed;
+	else
+	{
+		m_pending.last_seq = m_last_seq;
+		m_clips.push_back(m_pending);
+	}
+
+	m_cv.notify_all();
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// saveThread - Ends the clips whose window passed without frames, and saves the clips
+//////////////////////////////////////////////////////////////////////////
+void ClipRecorder::saveThread()
+{
+	TRACE_THREAD_NAME("Clip");
+
+	// Frames are copied out of the ring through this one, so the lock isn't held while the recorder copies them
+	std::vector<uint16_t> buffer;
+
+	buffer.reserve(m_frame_words);
+
+	std::unique_lock<std::mutex> lock(m_mx);
+
+	while (true)
+	{
+		// The camera may have stopped before the post-trigger window passed
+		if (m_triggered && std::chrono::steady_clock::now() >= m_trigger_time + m_post)
+			seal();
+
+		if (!m_clips.empty())
+		{
+			Clip clip = m_clips.front();
+
+			m_saving = true;
+			lock.unlock();
+
+			bool ok = save(clip, buffer);
+
+			lock.lock();
+			m_clips.pop_front();
+			m_saving = false;
+
+			if (ok)
+				++m_clips_saved;
+			else
+				++m_clips_failed;
+
+			m_cv.notify_all();
+			continue;
+		}
+
+		if (m_stop)
+			break;
+
+		if (m_triggered)
+			m_cv.wait_until(lock, m_trigger_time + m_post);
+		else
+			m_cv.wait(lock);
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// save - Writes the calibration the clip starts with, then its frames
+//////////////////////////////////////////////////////////////////////////
+bool ClipRecorder::save(const Clip & clip, std::vector<uint16_t> & buffer)
+{
+	Recorder recorder;
+
+	uint64_t first_seq;
+	TimePoint start;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mx);
+
+		// Whatever the camera overwrote since the clip ended is gone
+		first_seq = std::max(clip.first_seq, oldestSeq());
+		m_frames_lost += first_seq - clip.first_seq;
+
+		while (first_seq <= clip.last_seq && !findFrame(first_seq))
+			++first_seq;
+
+		if (first_seq > clip.last_seq)
+			return false;
+
+		start = findFrame(first_seq)->time;
+	}
+
+	if (!recorder.open(clip.file, recording::CODEC_THERMAL, start))
+		return false;
+
+	// The player applies the calibration in effect at the first frame
+	for (uint8_t id : { uint8_t(4), uint8_t(1) })
+	{
+		uint64_t seq;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mx);
+
+			const Slot * slot = findCalibration(id, first_seq);
+
+			if (!slot)
+				continue;
+
+			seq = slot->seq;
+			buffer.assign(slot->data.begin(), slot->data.end());
+		}
+
+		recorder.addFrame(buffer, seq, start, true);
+	}
+
+	for (uint64_t seq = first_seq; seq <= clip.last_seq; ++seq)
+	{
+		TimePoint time;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mx);
+
+			const Slot * slot = findFrame(seq);
+
+			if (!slot)
+			{
+				// Overwritten by a newer frame, rather than a gap in the sequence
+				const Slot & other = m_slots[seq % m_slots.size()];
+
+				if (other.used && other.seq > seq)
+					++m_frames_lost;
+
+				continue;
+			}
+
+			time = slot->time;
+			buffer.assign(slot->data.begin(), slot->data.end());
+		}
+
+		recorder.addFrame(buffer, seq, time, true);
+	}
+
+	recorder.close();
+
+	Recorder::Stats stats = recorder.getStats();
+
+	return !stats.failed && stats.frames_written > 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// Ring lookups, under the lock
+//////////////////////////////////////////////////////////////////////////
+uint64_t ClipRecorder::oldestSeq() const
+{
+	return m_last_seq + 1 >= m_slots.size() ? m_last_seq + 1 - m_slots.size() : 0;
+}
+
+
+const ClipRecorder::Slot * ClipRecorder::findFrame(uint64_t seq) const
+{
+	const Slot & slot = m_slots[seq % m_slots.size()];
+
+	return slot.used && slot.seq == seq ? &slot : nullptr;
+}
+
+
+// The last calibration frame of the kind before a frame, in the ring or evicted from it
+const ClipRecorder::Slot * ClipRecorder::findCalibration(uint8_t id, uint64_t before) const
+{
+	for (uint64_t seq = before; seq-- > oldestSeq(); )
+	{
+		const Slot * slot = findFrame(seq);
+
+		if (slot && slot->id == id)
+			return slot;
+	}
+
+	const Slot & evicted = id == 4 ? m_evicted_gain : m_evicted_offset;
+
+	return evicted.used && evicted.seq < before ? &evicted : nullptr;
+}
@@ -0,0 +1,131 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Keeps the last frames in memory, so a clip of what happened before something was noticed can still be saved.
+// The frames go into a ring of slots allocated up front, within a fixed memory budget, so keeping them costs a copy
+// per frame and nothing else. trigger() saves a recording covering the pre-trigger window, and the post-trigger
+// window once it has passed. The clip is written by a thread of its own, the camera thread only marks where it ends.
+//
+// The frames are kept raw, together with the calibration frames they need, so the clips play back like any other
+// recording.
+class ClipRecorder
+{
+public:
+	struct Stats
+	{
+		uint64_t	clips_saved;
+		uint64_t	clips_failed;
+		uint64_t	frames_lost;	// Overwritten in the ring before the clip got to them
+		bool		triggered;		// Waiting for the post-trigger window
+		size_t		capacity;		// Frames the ring holds
+	};
+
+private:
+	typedef std::chrono::steady_clock::time_point TimePoint;
+
+	struct Slot
+	{
+		TimePoint				time;
+		uint64_t				seq;
+		uint8_t					id;
+		bool					used;
+		std::vector<uint16_t>	data;
+	};
+
+	// A clip that's complete in the ring, waiting to be saved
+	struct Clip
+	{
+		std::string	file;
+		uint64_t	first_seq;
+		uint64_t	last_seq;
+	};
+
+	std::mutex					m_mx;
+	std::condition_variable		m_cv;
+	std::vector<Slot>			m_slots;			// The frame with sequence number seq goes into slot seq % size
+	size_t						m_frame_words;
+	uint64_t					m_last_seq;			// Of the newest frame in the ring
+	bool						m_empty;
+	Slot						m_evicted_gain;		// Latest calibration frames that fell out of the ring
+	Slot						m_evicted_offset;
+
+	std::chrono::nanoseconds	m_pre;
+	std::chrono::nanoseconds	m_post;
+
+	bool						m_triggered;
+	TimePoint					m_trigger_time;
+	Clip						m_pending;			// The clip being triggered
+
+	std::deque<Clip>			m_clips;
+	bool						m_saving;
+	bool						m_stop;
+	std::thread					m_thread;
+
+	uint64_t					m_clips_saved;
+	uint64_t					m_clips_failed;
+	uint64_t					m_frames_lost;
+
+public:
+	ClipRecorder();
+	~ClipRecorder();
+
+	ClipRecorder(const ClipRecorder &) = delete;
+	ClipRecorder & operator=(const ClipRecorder &) = delete;
+
+	// Allocates the ring, as many frames of frame_words as fit in budget bytes, and starts keeping frames
+	bool open(size_t budget, size_t frame_words, std::chrono::nanoseconds pre, std::chrono::nanoseconds post);
+	void close();					// Saves the clip being triggered, with what it has so far
+	bool isOpen() const;
+
+	// Camera thread. Frames larger than frame_words are ignored.
+	void addFrame(const std::vector<uint16_t> & data, uint64_t seq, TimePoint time);
+
+	// Saves a clip around now into file. Returns false if it's not open, or another clip is being triggered.
+	bool trigger(const std::string & file);
+
+	// Waits until the triggered clips are saved
+	void flush();
+
+	Stats getStats();
+
+private:
+	void seal();
+	void saveThread();
+	bool save(const Clip & clip, std::vector<uint16_t> & buffer);
+
+	// Under the lock
+	uint64_t oldestSeq() const;
+	const Slot * findFrame(uint64_t seq) const;
+	const Slot * findCalibration(uint8_t id, uint64_t before) const;
+};
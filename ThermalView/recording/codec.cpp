@@ -0,0 +1,606 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "recording/codec.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CODEC_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+
+static const uint8_t VERSION = 1;
+static const uint8_t FLAG_DELTA = 1;		// At least one row is predicted from the previous frame
+static const size_t HEADER_SIZE = 8;		// Version, flags, width, height, slice count, reserved
+static const int BLOCK_SIZE = 32;			// Pixels sharing one Rice parameter
+static const int K_BITS = 4;				// Bits used to store the Rice parameter
+static const uint32_t ESCAPE = 20;			// Quotients this large are replaced by the raw 16 bit value
+
+
+//////////////////////////////////////////////////////////////////////////
+/// Bit I/O, most significant bit first
+//////////////////////////////////////////////////////////////////////////
+namespace
+{
+	class BitWriter
+	{
+		vector<uint8_t> &	m_out;
+		uint64_t			m_acc;
+		int					m_bits;
+
+	public:
+		explicit BitWriter(vector<uint8_t> & out) : m_out(out), m_acc(0), m_bits(0) {}
+
+		// Up to 32 bits at a time
+		void put(uint32_t value, int count)
+		{
+			m_acc = (m_acc << count) | value;
+			m_bits += count;
+
+			while (m_bits >= 8)
+			{
+				m_bits -= 8;
+				m_out.push_back(static_cast<uint8_t>(m_acc >> m_bits));
+			}
+		}
+
+		void flush()
+		{
+			if (m_bits)
+				m_out.push_back(static_cast<uint8_t>(m_acc << (8 - m_bits)));
+
+			m_bits = 0;
+		}
+	};
+
+	class BitReader
+	{
+		const uint8_t *	m_data;
+		const uint8_t *	m_end;
+		uint64_t		m_acc;			// Left aligned
+		int				m_bits;
+		size_t			m_padding;		// Zero bytes read past the end
+
+		void refill()
+		{
+			while (m_bits <= 56)
+			{
+				uint64_t byte = 0;
+
+				if (m_data < m_end)
+					byte = *m_data++;
+				else
+					++m_padding;
+
+				m_acc |= byte << (56 - m_bits);
+				m_bits += 8;
+			}
+		}
+
+	public:
+		BitReader(const uint8_t * data, size_t size) : m_data(data), m_end(data + size), m_acc(0), m_bits(0), m_padding(0) {}
+
+		uint32_t get(int count)
+		{
+			if (!count)
+				return 0;
+
+			refill();
+
+			uint32_t value = static_cast<uint32_t>(m_acc >> (64 - count));
+
+			m_acc <<= count;
+			m_bits -= count;
+
+			return value;
+		}
+
+		// Counts the ones before the next zero, up to limit (which isn't followed by a zero)
+		uint32_t unary(uint32_t limit)
+		{
+			refill();
+
+			uint32_t count = 0;
+
+			while (count < limit && (m_acc >> 63))
+			{
+				m_acc <<= 1;
+				--m_bits;
+				++count;
+			}
+
+			if (count < limit)
+			{
+				m_acc <<= 1;
+				--m_bits;
+			}
+
+			return count;
+		}
+
+		// Whether more bits were read than there were
+		bool overrun() const
+		{
+			return m_padding * 8 > static_cast<size_t>(m_bits);
+		}
+	};
+
+
+	inline uint16_t zigzag(int16_t r)
+	{
+		return static_cast<uint16_t>((static_cast<uint16_t>(r) << 1) ^ (r < 0 ? 0xffff : 0));
+	}
+
+	inline int16_t unzigzag(uint16_t u)
+	{
+		return static_cast<int16_t>((u >> 1) ^ -static_cast<int>(u & 1));
+	}
+
+	inline uint16_t median(uint16_t a, uint16_t b, uint16_t c)
+	{
+		uint16_t lo = min(a, b);
+		uint16_t hi = max(a, b);
+
+		if (c >= hi)
+			return lo;
+
+		if (c <= lo)
+			return hi;
+
+		return static_cast<uint16_t>(a + b - c);
+	}
+
+	bool available(int mode, const uint16_t * up, const uint16_t * prev)
+	{
+		switch (mode)
+		{
+			case FrameCodec::PREDICT_LEFT:		return true;
+			case FrameCodec::PREDICT_UP:		return up != nullptr;
+			case FrameCodec::PREDICT_MEDIAN:	return up != nullptr;
+			case FrameCodec::PREDICT_PREVIOUS:	return prev != nullptr;
+			default:							return false;
+		}
+	}
+
+
+	// Prediction errors of a row, modulo 2^16
+	void residuals(int mode, const uint16_t * row, const uint16_t * up, const uint16_t * prev, int width, int16_t * res)
+	{
+		int x = 0;
+
+		switch (mode)
+		{
+			case FrameCodec::PREDICT_LEFT:
+				res[0] = static_cast<int16_t>(row[0] - (up ? up[0] : 0));
+				x = 1;
+
+#ifdef CODEC_SSE2
+				for (; x + 8 <= width; x += 8)
+				{
+					__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x));
+					__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x - 1));
+
+					_mm_storeu_si128(reinterpret_cast<__m128i *>(res + x), _mm_sub_epi16(v, a));
+				}
+#endif
+				for (; x < width; ++x)
+					res[x] = static_cast<int16_t>(row[x] - row[x - 1]);
+				break;
+
+			case FrameCodec::PREDICT_UP:
+			case FrameCodec::PREDICT_PREVIOUS:
+			{
+				const uint16_t * ref = mode == FrameCodec::PREDICT_UP ? up : prev;
+
+#ifdef CODEC_SSE2
+				for (; x + 8 <= width; x += 8)
+				{
+					__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x));
+					__m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ref + x));
+
+					_mm_storeu_si128(reinterpret_cast<__m128i *>(res + x), _mm_sub_epi16(v, p));
+				}
+#endif
+				for (; x < width; ++x)
+					res[x] = static_cast<int16_t>(row[x] - ref[x]);
+				break;
+			}
+
+			case FrameCodec::PREDICT_MEDIAN:
+			{
+				res[0] = static_cast<int16_t>(row[0] - up[0]);
+				x = 1;
+
+#ifdef CODEC_SSE2
+				// The signed min/max work on unsigned values once the sign bit is flipped
+				const __m128i bias = _mm_set1_epi16(static_cast<short>(0x8000));
+
+				for (; x + 8 <= width; x += 8)
+				{
+					__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x));
+					__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x - 1));
+					__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(up + x));
+					__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(up + x - 1));
+
+					__m128i sa = _mm_xor_si128(a, bias);
+					__m128i sb = _mm_xor_si128(b, bias);
+					__m128i sc = _mm_xor_si128(c, bias);
+
+					__m128i lo = _mm_min_epi16(sa, sb);
+					__m128i hi = _mm_max_epi16(sa, sb);
+
+					__m128i ge = _mm_xor_si128(_mm_cmplt_epi16(sc, hi), _mm_set1_epi16(-1));	// c >= hi
+					__m128i le = _mm_xor_si128(_mm_cmpgt_epi16(sc, lo), _mm_set1_epi16(-1));	// c <= lo
+
+					__m128i grad = _mm_sub_epi16(_mm_add_epi16(a, b), c);
+					__m128i pred = _mm_or_si128(_mm_and_si128(le, _mm_xor_si128(hi, bias)), _mm_andnot_si128(le, grad));
+
+					pred = _mm_or_si128(_mm_and_si128(ge, _mm_xor_si128(lo, bias)), _mm_andnot_si128(ge, pred));
+
+					_mm_storeu_si128(reinterpret_cast<__m128i *>(res + x), _mm_sub_epi16(v, pred));
+				}
+#endif
+				for (; x < width; ++x)
+					res[x] = static_cast<int16_t>(row[x] - median(row[x - 1], up[x], up[x - 1]));
+				break;
+			}
+		}
+	}
+
+
+	// The inverse of residuals()
+	void reconstruct(int mode, const int16_t * res, const uint16_t * up, const uint16_t * prev, int width, uint16_t * row)
+	{
+		int x = 0;
+
+		switch (mode)
+		{
+			case FrameCodec::PREDICT_LEFT:
+				row[0] = static_cast<uint16_t>((up ? up[0] : 0) + res[0]);
+
+				for (x = 1; x < width; ++x)
+					row[x] = static_cast<uint16_t>(row[x - 1] + res[x]);
+				break;
+
+			case FrameCodec::PREDICT_UP:
+			case FrameCodec::PREDICT_PREVIOUS:
+			{
+				const uint16_t * ref = mode == FrameCodec::PREDICT_UP ? up : prev;
+
+#ifdef CODEC_SSE2
+				for (; x + 8 <= width; x += 8)
+				{
+					__m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i *>(res + x));
+					__m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ref + x));
+
+					_mm_storeu_si128(reinterpret_cast<__m128i *>(row + x), _mm_add_epi16(p, r));
+				}
+#endif
+				for (; x < width; ++x)
+					row[x] = static_cast<uint16_t>(ref[x] + res[x]);
+				break;
+			}
+
+			case FrameCodec::PREDICT_MEDIAN:
+				row[0] = static_cast<uint16_t>(up[0] + res[0]);
+
+				for (x = 1; x < width; ++x)
+					row[x] = static_cast<uint16_t>(median(row[x - 1], up[x], up[x - 1]) + res[x]);
+				break;
+		}
+	}
+
+
+	void writeResiduals(BitWriter & writer, const int16_t * res, int width)
+	{
+		uint16_t u[BLOCK_SIZE];
+
+		for (int first = 0; first < width; first += BLOCK_SIZE)
+		{
+			int count = min(BLOCK_SIZE, width - first);
+			uint32_t sum = 0;
+
+			for (int i = 0; i < count; ++i)
+			{
+				u[i] = zigzag(res[first + i]);
+				sum += u[i];
+			}
+
+			// Rice parameter close to log2 of the mean times ln(2)
+			uint32_t k = 0;
+
+			while (k < 15 && (static_cast<uint64_t>(count) << (k + 1)) * 16 <= static_cast<uint64_t>(sum) * 11)
+				++k;
+
+			writer.put(k, K_BITS);
+
+			for (int i = 0; i < count; ++i)
+			{
+				uint32_t q = u[i] >> k;
+
+				if (q < ESCAPE)
+				{
+					writer.put(((1u << q) - 1) << 1, q + 1);
+
+					if (k)
+						writer.put(u[i] & ((1u << k) - 1), k);
+				}
+				else
+				{
+					writer.put((1u << ESCAPE) - 1, ESCAPE);
+					writer.put(u[i], 16);
+				}
+			}
+		}
+	}
+
+
+	void readResiduals(BitReader & reader, int16_t * res, int width)
+	{
+		for (int first = 0; first < width; first += BLOCK_SIZE)
+		{
+			int count = min(BLOCK_SIZE, width - first);
+			uint32_t k = reader.get(K_BITS);
+
+			for (int i = 0; i < count; ++i)
+			{
+				uint32_t q = reader.unary(ESCAPE);
+				uint32_t u = q < ESCAPE ? (q << k) | reader.get(k) : reader.get(16);
+
+				res[first + i] = unzigzag(static_cast<uint16_t>(u));
+			}
+		}
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// encode - Header, slice sizes, then the slices
+//////////////////////////////////////////////////////////////////////////
+void FrameCodec::encode(const uint16_t * data, int width, int height, const uint16_t * previous, vector<uint8_t> & out,
+	int slices, bool parallel)
+{
+	slices = max(1, min(slices, min(height, 255)));
+
+	vector<vector<uint8_t>> parts(slices);
+
+	auto work = [&](int i)
+	{
+		encodeSlice(data, width, i * height / slices, (i + 1) * height / slices, previous, parts[i]);
+	};
+
+	vector<thread> threads;
+
+	for (int i = 1; i < slices; ++i)
+	{
+		if (parallel)
+			threads.push_back(thread(work, i));
+		else
+			work(i);
+	}
+
+	work(0);
+
+	for (auto & t : threads)
+		t.join();
+
+	// Each slice starts with the predictor of every row
+	uint8_t flags = 0;
+
+	for (int i = 0; i < slices; ++i)
+	{
+		int rows = (i + 1) * height / slices - i * height / slices;
+
+		if (find(parts[i].begin(), parts[i].begin() + rows, static_cast<uint8_t>(PREDICT_PREVIOUS)) != parts[i].begin() + rows)
+			flags |= FLAG_DELTA;
+	}
+
+	out.clear();
+
+	out.push_back(VERSION);
+	out.push_back(flags);
+	out.push_back(static_cast<uint8_t>(width));
+	out.push_back(static_cast<uint8_t>(width >> 8));
+	out.push_back(static_cast<uint8_t>(height));
+	out.push_back(static_cast<uint8_t>(height >> 8));
+	out.push_back(static_cast<uint8_t>(slices));
+	out.push_back(0);
+
+	for (auto & part : parts)
+	{
+		uint32_t size = static_cast<uint32_t>(part.size());
+
+		for (int i = 0; i < 4; ++i)
+			out.push_back(static_cast<uint8_t>(size >> (i * 8)));
+	}
+
+	for (auto & part : parts)
+		out.insert(out.end(), part.begin(), part.end());
+}
+
+
+void FrameCodec::encodeSlice(const uint16_t * data, int width, int first_row, int last_row, const uint16_t * previous, vector<uint8_t> & out)
+{
+	// The predictor of each row, then the bits
+	out.assign(last_row - first_row, 0);
+	out.reserve(out.size() + static_cast<size_t>(last_row - first_row) * width);
+
+	BitWriter writer(out);
+
+	vector<int16_t> res(width);
+	vector<int16_t> best(width);
+
+	for (int y = first_row; y < last_row; ++y)
+	{
+		const uint16_t * row = data + static_cast<size_t>(y) * width;
+		const uint16_t * up = y > first_row ? row - width : nullptr;
+		const uint16_t * prev = previous ? previous + static_cast<size_t>(y) * width : nullptr;
+
+		// Go with the predictor that leaves the smallest errors
+		uint64_t best_cost = UINT64_MAX;
+		int best_mode = PREDICT_LEFT;
+
+		for (int mode = 0; mode < PREDICTOR_COUNT; ++mode)
+		{
+			if (!available(mode, up, prev))
+				continue;
+
+			residuals(mode, row, up, prev, width, &res[0]);
+
+			uint64_t cost = 0;
+
+			for (int x = 0; x < width; ++x)
+				cost += zigzag(res[x]);
+
+			if (cost < best_cost)
+			{
+				best_cost = cost;
+				best_mode = mode;
+				best.swap(res);
+			}
+		}
+
+		out[y - first_row] = static_cast<uint8_t>(best_mode);
+
+		writeResiduals(writer, &best[0], width);
+	}
+
+	writer.flush();
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// decode
+//////////////////////////////////////////////////////////////////////////
+bool FrameCodec::decode(const uint8_t * data, size_t size, const uint16_t * previous, vector<uint16_t> & out, bool parallel)
+{
+	if (size < HEADER_SIZE || data[0] != VERSION)
+		return false;
+
+	uint8_t flags = data[1];
+	int width = data[2] | (data[3] << 8);
+	int height = data[4] | (data[5] << 8);
+	int slices = data[6];
+
+	if (!width || !height || !slices || slices > height || size < HEADER_SIZE + slices * 4)
+		return false;
+
+	if ((flags & FLAG_DELTA) && !previous)
+		return false;
+
+	// Where each slice starts
+	vector<size_t> offsets(slices + 1);
+
+	offsets[0] = HEADER_SIZE + slices * 4;
+
+	for (int i = 0; i < slices; ++i)
+	{
+		const uint8_t * p = data + HEADER_SIZE + i * 4;
+
+		offsets[i + 1] = offsets[i] + (p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24));
+	}
+
+	if (offsets[slices] > size)
+		return false;
+
+	// Every row takes a predictor byte and every pixel at least a bit, so the header can't claim more pixels than
+	// the payload holds, and a few bytes can't ask for gigabytes
+	size_t payload = offsets[slices] - offsets[0];
+
+	if (static_cast<size_t>(height) > payload || static_cast<uint64_t>(width) * height > (payload - height) * 8ULL)
+		return false;
+
+	out.resize(static_cast<size_t>(width) * height);
+
+	vector<char> ok(slices, 0);
+
+	auto work = [&](int i)
+	{
+		ok[i] = decodeSlice(data + offsets[i], offsets[i + 1] - offsets[i], width, i * height / slices, (i + 1) * height / slices, previous, &out[0]);
+	};
+
+	vector<thread> threads;
+
+	for (int i = 1; i < slices; ++i)
+	{
+		if (parallel)
+			threads.push_back(thread(work, i));
+		else
+			work(i);
+	}
+
+	work(0);
+
+	for (auto & t : threads)
+		t.join();
+
+	return find(ok.begin(), ok.end(), 0) == ok.end();
+}
+
+
+bool FrameCodec::decodeSlice(const uint8_t * data, size_t size, int width, int first_row, int last_row, const uint16_t * previous, uint16_t * out)
+{
+	size_t rows = last_row - first_row;
+
+	if (size < rows)
+		return false;
+
+	BitReader reader(data + rows, size - rows);
+
+	vector<int16_t> res(width);
+
+	for (int y = first_row; y < last_row; ++y)
+	{
+		uint16_t * row = out + static_cast<size_t>(y) * width;
+		const uint16_t * up = y > first_row ? row - width : nullptr;
+		const uint16_t * prev = previous ? previous + static_cast<size_t>(y) * width : nullptr;
+
+		int mode = data[y - first_row];
+
+		if (!available(mode, up, prev))
+			return false;
+
+		readResiduals(reader, &res[0], width);
+		reconstruct(mode, &res[0], up, prev, width, row);
+	}
+
+	return !reader.overrun();
+}
+
+
+bool FrameCodec::readHeader(const uint8_t * data, size_t size, Header & header)
+{
+	if (size < HEADER_SIZE || data[0] != VERSION)
+		return false;
+
+	header.width	= data[2] | (data[3] << 8);
+	header.height	= data[4] | (data[5] << 8);
+	header.delta	= (data[1] & FLAG_DELTA) != 0;
+
+	return true;
+}
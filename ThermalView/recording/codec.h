@@ -0,0 +1,73 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Lossless compression for the 16 bit camera frames.
+//
+// Every row is predicted from pixels the decoder already has - the one to the left, the one above, the median
+// of the neighbours, or the same pixel in the previous frame - with the predictor picked per row by the encoder.
+// The prediction errors are Rice coded, with the parameter picked per block of pixels.
+// The rows are split into slices that don't depend on each other, so they can be coded in parallel.
+class FrameCodec
+{
+public:
+	enum Predictor
+	{
+		PREDICT_LEFT,
+		PREDICT_UP,
+		PREDICT_MEDIAN,		// LOCO-I median edge detector, on the left, upper and upper left pixels
+		PREDICT_PREVIOUS,	// Same pixel in the previous frame
+
+		PREDICTOR_COUNT
+	};
+
+	// Compresses width x height values. When previous is given, rows may be predicted from it, and decode()
+	// needs the same previous frame.
+	// Parallel starts a thread for every slice but the first, which only pays off for frames far larger than the
+	// camera's. The recorder and the player code a frame at a time on threads of their own, so they code the
+	// slices one after the other.
+	static void encode(const uint16_t * data, int width, int height, const uint16_t * previous, std::vector<uint8_t> & out,
+		int slices = 4, bool parallel = false);
+
+	// Returns false if the data is corrupt, or if it needs a previous frame that wasn't given.
+	// The size comes from the data, callers expecting a given one check it with readHeader() first.
+	static bool decode(const uint8_t * data, size_t size, const uint16_t * previous, std::vector<uint16_t> & out, bool parallel = false);
+
+	struct Header
+	{
+		int		width;
+		int		height;
+		bool	delta;		// Predicted from the previous frame
+	};
+
+	static bool readHeader(const uint8_t * data, size_t size, Header & header);
+
+private:
+	static void encodeSlice(const uint16_t * data, int width, int first_row, int last_row, const uint16_t * previous, std::vector<uint8_t> & out);
+	static bool decodeSlice(const uint8_t * data, size_t size, int width, int first_row, int last_row, const uint16_t * previous, uint16_t * out);
+};
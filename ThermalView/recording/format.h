@@ -0,0 +1,103 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// ThermalView recordings (.tvr)
+//
+//	[FileHeader] [Chunk]... [IndexEntry]... [Footer]
+//
+// A chunk is a ChunkHeader followed by record_count records. A record is a RecordHeader followed by its payload,
+// padded to RECORD_ALIGN bytes, so every header in the file is aligned when it's memory mapped.
+// The index and the footer are written when the recording is closed, together with the index offset in the
+// FileHeader. A recording that wasn't closed properly can still be read by walking the chunks.
+// All fields are little endian.
+namespace recording
+{
+	static const char		FILE_MAGIC[8]	= { 'T', 'V', 'R', 'E', 'C', 'O', 'R', 'D' };
+	static const char		FOOTER_MAGIC[8]	= { 'T', 'V', 'R', 'I', 'N', 'D', 'E', 'X' };
+	static const uint32_t	CHUNK_MAGIC		= 0x4b4e4843;	// "CHNK"
+	static const uint32_t	VERSION			= 1;
+	static const size_t		RECORD_ALIGN	= 8;
+
+	// How the payload of a record is stored
+	enum Codec
+	{
+		CODEC_RAW = 0,		// The 16 bit words, as they came from the camera
+		CODEC_THERMAL = 1,	// FrameCodec. Delta coded regular frames depend on the previous regular frame in the file.
+	};
+
+	struct FileHeader
+	{
+		char		magic[8];
+		uint32_t	version;
+		uint32_t	header_size;	// sizeof(FileHeader), the first chunk starts right after it
+		uint32_t	frame_width;
+		uint32_t	frame_height;
+		uint64_t	start_time;		// System time when the recording started, in ns since the epoch
+		uint64_t	index_offset;	// 0 until the recording is closed
+		uint64_t	record_count;	// 0 until the recording is closed
+	};
+
+	struct ChunkHeader
+	{
+		uint32_t	magic;
+		uint32_t	record_count;
+		uint64_t	size;			// Bytes following the header, records and padding included
+	};
+
+	struct RecordHeader
+	{
+		uint64_t	timestamp;		// ns since the start of the recording
+		uint64_t	seq;			// Sequence number of the frame, gaps mean dropped frames
+		uint32_t	size;			// Payload bytes, without the padding
+		uint8_t		frame_id;		// 3 for regular frames, the rest are calibration frames
+		uint8_t		codec;
+		uint16_t	reserved;
+	};
+
+	struct IndexEntry
+	{
+		uint64_t	timestamp;
+		uint64_t	offset;			// File offset of the RecordHeader
+		uint32_t	size;
+		uint8_t		frame_id;
+		uint8_t		codec;
+		uint16_t	reserved;
+	};
+
+	struct Footer
+	{
+		uint64_t	index_offset;
+		uint64_t	record_count;
+		char		magic[8];
+	};
+
+	inline size_t padded(size_t size)
+	{
+		return (size + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1);
+	}
+}
@@ -0,0 +1,667 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "recording/player.h"
+#include "recording/codec.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstddef>
+
+using namespace recording;
+namespace bip = boost::interprocess;
+
+static const size_t PREFETCH_RECORDS = 32;	// How far ahead of the playhead frames get decoded
+static const int MAX_DELTA_CHAIN = 256;		// Delta coded frames decoded to get to one, the recorder keeps it far lower
+static const int MAX_LATENESS_MS = 500;		// When delivery falls this much behind, the pace restarts instead of catching up
+
+
+//////////////////////////////////////////////////////////////////////////
+/// Constructor
+//////////////////////////////////////////////////////////////////////////
+Player::Player()
+	: m_data(nullptr), m_size(0), m_stop(false), m_playing(false), m_speed(1), m_pos(0), m_steps(0), m_generation(0),
+	m_last_timestamp(0), m_reference_idx(0), m_anchor_timestamp(0)
+{
+	memset(&m_header, 0, sizeof(m_header));
+}
+
+Player::~Player()
+{
+	close();
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// open - Maps the file, loads the index and starts the threads
+//////////////////////////////////////////////////////////////////////////
+bool Player::open(const std::string & file)
+{
+	close();
+
+	try
+	{
+		bip::file_mapping mapping(file.c_str(), bip::read_only);
+		bip::mapped_region region(mapping, bip::read_only);
+
+		m_mapping.swap(mapping);
+		m_region.swap(region);
+	}
+	catch (const bip::interprocess_exception &)
+	{
+		return false;
+	}
+
+	m_data = static_cast<const uint8_t *>(m_region.get_address());
+	m_size = m_region.get_size();
+
+	bool ok = m_size >= sizeof(FileHeader);
+
+	if (ok)
+	{
+		memcpy(&m_header, m_data, sizeof(m_header));
+
+		ok = memcmp(m_header.magic, FILE_MAGIC, sizeof(m_header.magic)) == 0 && m_header.version == VERSION &&
+			m_header.header_size >= sizeof(FileHeader) && m_header.header_size <= m_size &&
+			m_header.frame_width == 206 && m_header.frame_height == 156;
+	}
+
+	// A recording that wasn't closed properly has no index, but the chunks are still there.
+	// One with a footer and a broken index is damaged, and isn't trusted any further.
+	if (ok)
+		ok = (hasIndex() ? readIndex() : rebuildIndex()) && !m_index.empty();
+
+	if (!ok)
+	{
+		bip::mapped_region().swap(m_region);
+		bip::file_mapping().swap(m_mapping);
+
+		m_data = nullptr;
+		m_size = 0;
+		m_index.clear();
+
+		return false;
+	}
+
+	m_gain_records.clear();
+	m_offset_records.clear();
+
+	for (size_t i = 0; i < m_index.size(); ++i)
+	{
+		if (m_index[i].frame_id == 4)
+			m_gain_records.push_back(i);
+		else if (m_index[i].frame_id == 1)
+			m_offset_records.push_back(i);
+	}
+
+	m_stop = false;
+	m_playing = false;
+	m_speed = 1;
+	m_steps = 0;
+	m_last_timestamp = 0;
+	m_cache.clear();
+	m_reference.reset();
+
+	seekRecord(0);
+
+	m_play_thread = std::thread(&Player::playThread, this);
+	m_prefetch_thread = std::thread(&Player::prefetchThread, this);
+
+	return true;
+}
+
+
+void Player::close()
+{
+	if (!m_data)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mx);
+
+		m_stop = true;
+		m_cv.notify_all();
+	}
+
+	m_play_thread.join();
+	m_prefetch_thread.join();
+
+	m_cache.clear();
+	m_index.clear();
+	m_reference.reset();
+
+	bip::mapped_region().swap(m_region);
+	bip::file_mapping().swap(m_mapping);
+
+	m_data = nullptr;
+	m_size = 0;
+}
+
+
+bool Player::isOpen() const
+{
+	return m_data != nullptr;
+}
+
+
+size_t Player::getRecordCount() const
+{
+	return m_index.size();
+}
+
+
+Player::PData Player::getRecord(size_t idx) const
+{
+	if (idx >= m_index.size())
+		return PData();
+
+	PData data = decode(idx);
+
+	return data->empty() ? PData() : data;
+}
+
+
+uint64_t Player::getDuration() const
+{
+	return m_index.empty() ? 0 : m_index.back().timestamp;
+}
+
+
+uint64_t Player::getPosition() const
+{
+	std::lock_guard<std::mutex> lock(m_mx);
+
+	return m_last_timestamp;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// Playback control
+//////////////////////////////////////////////////////////////////////////
+void Player::play()
+{
+	std::lock_guard<std::mutex> lock(m_mx);
+
+	// Playing from the end starts over
+	if (m_pos >= m_index.size())
+		seekRecord(0);
+
+	m_playing = true;
+	m_steps = 0;
+
+	restartPace();
+}
+
+
+void Player::pause()
+{
+	std::lock_guard<std::mutex> lock(m_mx);
+
+	m_playing = false;
+	++m_generation;
+	m_cv.notify_all();
+}
+
+
+bool Player::isPlaying() const
+{
+	std::lock_guard<std::mutex> lock(m_mx);
+
+	return m_playing;
+}
+
+
+void Player::setSpeed(double speed)
+{
+	std::lock_guard<std::mutex> lock(m_mx);
+
+	if (speed > 0)
+	{
+		m_speed = speed;
+		restartPace();
+	}
+}
+
+
+double Player::getSpeed() const
+{
+	std::lock_guard<std::mutex> lock(m_mx);
+
+	return m_speed;
+}
+
+
+void Player::seek(uint64_t timestamp)
+{
+	std::lock_guard<std::mutex> lock(m_mx);
+
+	auto it = std::upper_bound(m_index.begin(), m_index.end(), timestamp,
+		[](uint64_t t, const IndexEntry & entry) { return t < entry.timestamp; });
+
+	size_t idx = it == m_index.begin() ? 0 : (it - m_index.begin()) - 1;
+
+	// Land on a regular frame, the calibration gets delivered by seekRecord() anyway
+	while (idx > 0 && m_index[idx].frame_id != 3)
+		--idx;
+
+	seekRecord(idx);
+
+	// While paused, show the frame we landed on
+	if (!m_playing)
+		m_steps = 1;
+}
+
+
+void Player::stepForward()
+{
+	std::lock_guard<std::mutex> lock(m_mx);
+
+	m_playing = false;
+	++m_steps;
+	++m_generation;
+	m_cv.notify_all();
+}
+
+
+void Player::stepBack()
+{
+	std::lock_guard<std::mutex> lock(m_mx);
+
+	m_playing = false;
+
+	// The frame on display is the last regular one before m_pos, we want the one before it
+	size_t idx = std::min(m_pos, m_index.size());
+	int found = 0;
+
+	while (idx > 0 && found < 2)
+	{
+		--idx;
+
+		if (m_index[idx].frame_id == 3)
+			++found;
+	}
+
+	seekRecord(idx);
+	m_steps = 1;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// seekRecord - Moves the playhead, queueing the calibration frames the record depends on
+//////////////////////////////////////////////////////////////////////////
+void Player::seekRecord(size_t idx)
+{
+	m_pending.clear();
+
+	auto gain = std::lower_bound(m_gain_records.begin(), m_gain_records.end(), idx);
+	auto offset = std::lower_bound(m_offset_records.begin(), m_offset_records.end(), idx);
+
+	if (gain != m_gain_records.begin())
+		m_pending.push_back(*(gain - 1));
+
+	if (offset != m_offset_records.begin())
+		m_pending.push_back(*(offset - 1));
+
+	m_pos = idx;
+	m_steps = 0;
+
+	restartPace();
+}
+
+
+void Player::restartPace()
+{
+	m_anchor_time = std::chrono::steady_clock::now();
+	m_anchor_timestamp = m_pos < m_index.size() ? m_index[m_pos].timestamp : 0;
+
+	++m_generation;
+	m_cv.notify_all();
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// hasIndex - Whether the recording was closed, with the footer in place
+//////////////////////////////////////////////////////////////////////////
+bool Player::hasIndex() const
+{
+	return m_size - m_header.header_size >= sizeof(Footer) &&
+		memcmp(m_data + m_size - sizeof(Footer) + offsetof(Footer, magic), FOOTER_MAGIC, sizeof(FOOTER_MAGIC)) == 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// readIndex - Loads the index written when the recording was closed
+//////////////////////////////////////////////////////////////////////////
+bool Player::readIndex()
+{
+	if (!hasIndex())
+		return false;
+
+	Footer footer;
+
+	memcpy(&footer, m_data + m_size - sizeof(Footer), sizeof(footer));
+
+	// The counts come from the file, so they're checked by division and subtraction, which can't wrap
+	uint64_t index_end = m_size - sizeof(Footer);
+
+	if (footer.index_offset < m_header.header_size || footer.index_offset > index_end ||
+		(index_end - footer.index_offset) % sizeof(IndexEntry) != 0 ||
+		footer.record_count != (index_end - footer.index_offset) / sizeof(IndexEntry))
+		return false;
+
+	m_index.resize(static_cast<size_t>(footer.record_count));
+
+	if (!m_index.empty())
+		memcpy(&m_index[0], m_data + footer.index_offset, m_index.size() * sizeof(IndexEntry));
+
+	for (auto & entry : m_index)
+	{
+		if (entry.offset < m_header.header_size || entry.offset > footer.index_offset ||
+			footer.index_offset - entry.offset < sizeof(RecordHeader) ||
+			entry.size > footer.index_offset - entry.offset - sizeof(RecordHeader))
+		{
+			m_index.clear();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// rebuildIndex - Walks the chunks, up to the first incomplete one
+//////////////////////////////////////////////////////////////////////////
+bool Player::rebuildIndex()
+{
+	m_index.clear();
+
+	uint64_t offset = m_header.header_size;
+
+	while (offset + sizeof(ChunkHeader) <= m_size)
+	{
+		ChunkHeader chunk;
+
+		memcpy(&chunk, m_data + offset, sizeof(chunk));
+
+		if (chunk.magic != CHUNK_MAGIC || chunk.size > m_size - offset - sizeof(ChunkHeader))
+			break;
+
+		uint64_t record_offset = offset + sizeof(ChunkHeader);
+		uint64_t chunk_end = record_offset + chunk.size;
+
+		for (uint32_t i = 0; i < chunk.record_count && record_offset + sizeof(RecordHeader) <= chunk_end; ++i)
+		{
+			RecordHeader record;
+
+			memcpy(&record, m_data + record_offset, sizeof(record));
+
+			if (record_offset + sizeof(RecordHeader) + record.size > chunk_end)
+				break;
+
+			IndexEntry entry;
+
+			entry.timestamp	= record.timestamp;
+			entry.offset	= record_offset;
+			entry.size		= record.size;
+			entry.frame_id	= record.frame_id;
+			entry.codec		= record.codec;
+			entry.reserved	= 0;
+
+			m_index.push_back(entry);
+
+			record_offset += sizeof(RecordHeader) + padded(record.size);
+		}
+
+		offset = chunk_end;
+	}
+
+	return !m_index.empty();
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// decode - The camera data of a record
+//////////////////////////////////////////////////////////////////////////
+Player::PData Player::decode(size_t idx, int depth) const
+{
+	const IndexEntry & entry = m_index[idx];
+	const uint8_t * payload = m_data + entry.offset + sizeof(RecordHeader);
+	const size_t pixels = static_cast<size_t>(m_header.frame_width) * m_header.frame_height;
+
+	auto data = std::make_shared<std::vector<uint16_t>>();
+
+	// A record that doesn't hold a frame of the file's size is dropped, like one that can't be decoded
+	switch (entry.codec)
+	{
+		case CODEC_RAW:
+			if (entry.size != pixels * sizeof(uint16_t))
+				break;
+
+			data->resize(pixels);
+			memcpy(&(*data)[0], payload, entry.size);
+			break;
+
+		case CODEC_THERMAL:
+		{
+			FrameCodec::Header header;
+
+			if (!FrameCodec::readHeader(payload, entry.size, header) ||
+				static_cast<uint32_t>(header.width) != m_header.frame_width ||
+				static_cast<uint32_t>(header.height) != m_header.frame_height)
+				break;
+
+			PData reference;
+
+			if (header.delta)
+			{
+				reference = decodeReference(idx, depth);
+
+				if (!reference || reference->size() != pixels)
+					break;
+			}
+
+			if (!FrameCodec::decode(payload, entry.size, reference ? reference->data() : nullptr, *data))
+				data->clear();
+			break;
+		}
+
+		default:
+			break;
+	}
+
+	if (entry.frame_id == 3 && entry.codec == CODEC_THERMAL && !data->empty())
+	{
+		std::lock_guard<std::mutex> lock(m_reference_mx);
+
+		m_reference_idx = idx;
+		m_reference = data;
+	}
+
+	return data;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// decodeReference - The frame a delta coded record was predicted from
+//////////////////////////////////////////////////////////////////////////
+Player::PData Player::decodeReference(size_t idx, int depth) const
+{
+	// The previous compressed regular frame
+	size_t ref = idx;
+
+	do
+	{
+		if (ref == 0)
+			return PData();
+	}
+	while (m_index[--ref].frame_id != 3 || m_index[ref].codec != CODEC_THERMAL);
+
+	{
+		std::lock_guard<std::mutex> lock(m_reference_mx);
+
+		if (m_reference && m_reference_idx == ref)
+			return m_reference;
+	}
+
+	// After a seek, this goes back to the last key frame, a corrupt file could make it go much further
+	if (depth >= MAX_DELTA_CHAIN)
+		return PData();
+
+	return decode(ref, depth + 1);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// playThread - Delivers the records, at the recorded pace
+//////////////////////////////////////////////////////////////////////////
+void Player::playThread()
+{
+	TRACE_THREAD_NAME("Playback");
+
+	std::unique_lock<std::mutex> lock(m_mx);
+
+	while (!m_stop)
+	{
+		bool pending = !m_pending.empty();
+
+		if (!pending && !((m_playing || m_steps > 0) && m_pos < m_index.size()))
+		{
+			m_cv.wait(lock);
+			continue;
+		}
+
+		size_t idx = pending ? m_pending.front() : m_pos;
+		uint64_t generation = m_generation;
+
+		// Only regular playback is paced, the rest goes out right away
+		if (!pending && m_playing)
+		{
+			auto offset = std::chrono::nanoseconds(static_cast<int64_t>((m_index[idx].timestamp - m_anchor_timestamp) / m_speed));
+			auto due = m_anchor_time + std::chrono::duration_cast<std::chrono::steady_clock::duration>(offset);
+
+			if (m_cv.wait_until(lock, due, [&] { return m_stop || m_generation != generation; }))
+				continue;
+
+			// Don't try to catch up after a long stall, just carry on from here
+			if (std::chrono::steady_clock::now() - due > std::chrono::milliseconds(MAX_LATENESS_MS))
+			{
+				m_anchor_time = std::chrono::steady_clock::now();
+				m_anchor_timestamp = m_index[idx].timestamp;
+			}
+		}
+
+		PData data;
+		auto it = m_cache.find(idx);
+
+		if (it != m_cache.end())
+			data = it->second;
+		else
+		{
+			lock.unlock();
+			data = decode(idx);
+			lock.lock();
+
+			if (m_generation != generation)
+				continue;
+		}
+
+		if (pending)
+			m_pending.pop_front();
+		else
+		{
+			m_pos = idx + 1;
+
+			if (m_steps > 0 && m_index[idx].frame_id == 3)
+				--m_steps;
+		}
+
+		if (m_index[idx].frame_id == 3)
+			m_last_timestamp = m_index[idx].timestamp;
+
+		bool finished = !pending && m_playing && m_pos >= m_index.size();
+
+		if (finished)
+			m_playing = false;
+
+		m_cv.notify_all();
+
+		lock.unlock();
+
+		// A record that couldn't be decoded is skipped
+		if (!data->empty())
+			onNewFrame(*data, FrameTimes::arrived());
+
+		if (finished)
+			onPlaybackStop();
+
+		lock.lock();
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// prefetchThread - Keeps the records around the playhead decoded
+//////////////////////////////////////////////////////////////////////////
+void Player::prefetchThread()
+{
+	TRACE_THREAD_NAME("Prefetch");
+
+	std::vector<size_t> wanted;
+
+	std::unique_lock<std::mutex> lock(m_mx);
+
+	while (!m_stop)
+	{
+		// The records that are going to be delivered next
+		wanted.assign(m_pending.begin(), m_pending.end());
+
+		for (size_t i = m_pos; i < m_index.size() && i < m_pos + PREFETCH_RECORDS; ++i)
+			wanted.push_back(i);
+
+		// Drop the ones that were delivered, or that the playhead jumped over
+		for (auto it = m_cache.begin(); it != m_cache.end(); )
+		{
+			if (std::find(wanted.begin(), wanted.end(), it->first) == wanted.end())
+				it = m_cache.erase(it);
+			else
+				++it;
+		}
+
+		auto missing = std::find_if(wanted.begin(), wanted.end(), [this](size_t idx) { return m_cache.count(idx) == 0; });
+
+		if (missing == wanted.end())
+		{
+			m_cv.wait(lock);
+			continue;
+		}
+
+		size_t idx = *missing;
+
+		lock.unlock();
+		PData data = decode(idx);
+		lock.lock();
+
+		// If the playhead moved meanwhile and it's not needed any more, the next round drops it
+		m_cache[idx] = data;
+	}
+}
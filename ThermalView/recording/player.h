@@ -0,0 +1,136 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "recording/format.h"
+#include "stage_timing.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/signals2.hpp>
+
+// Plays back a recording, delivering the frames the same way SeekThermal does.
+// The file is memory mapped and frames are located through the index, so seeking is instant no matter how long
+// the recording is. A prefetch thread decodes the frames ahead of the playhead, the playback thread delivers them
+// at the recorded pace, scaled by the playback speed.
+class Player
+{
+public:
+	typedef std::shared_ptr<const std::vector<uint16_t>> PData;
+
+private:
+	boost::interprocess::file_mapping	m_mapping;
+	boost::interprocess::mapped_region	m_region;
+	const uint8_t *						m_data;
+	size_t								m_size;
+
+	recording::FileHeader				m_header;
+	std::vector<recording::IndexEntry>	m_index;
+	std::vector<size_t>					m_gain_records;		// Records of the gain calibration frames
+	std::vector<size_t>					m_offset_records;	// Records of the offset calibration frames
+
+	std::thread					m_play_thread;
+	std::thread					m_prefetch_thread;
+
+	mutable std::mutex			m_mx;
+	std::condition_variable		m_cv;
+	bool						m_stop;
+	bool						m_playing;
+	double						m_speed;
+	size_t						m_pos;			// Next record to deliver
+	std::deque<size_t>			m_pending;		// Records to deliver before m_pos, without waiting - the calibration for a seek
+	int							m_steps;		// Regular frames left to deliver while paused
+	uint64_t					m_generation;	// Changes whenever the playhead, the state or the speed changes
+	uint64_t					m_last_timestamp;	// Timestamp of the last delivered record
+	std::map<size_t, PData>		m_cache;		// Decoded records, around the playhead
+
+	// The last regular frame decoded, usually the reference of the next delta coded one
+	mutable std::mutex			m_reference_mx;
+	mutable size_t				m_reference_idx;
+	mutable PData				m_reference;
+
+	// The pace is measured from here
+	std::chrono::steady_clock::time_point	m_anchor_time;
+	uint64_t								m_anchor_timestamp;
+
+public:
+	Player();
+	~Player();
+
+	Player(const Player &) = delete;
+	Player & operator=(const Player &) = delete;
+
+	bool open(const std::string & file);
+	void close();
+	bool isOpen() const;
+
+	size_t getRecordCount() const;
+
+	// Decodes a record right away, without going through the playback. Null if it can't be decoded.
+	PData getRecord(size_t idx) const;
+	uint64_t getDuration() const;		// ns
+	uint64_t getPosition() const;		// Timestamp of the last delivered frame, in ns
+
+	void play();
+	void pause();
+	bool isPlaying() const;
+
+	// 1 is the recorded pace, higher is faster
+	void setSpeed(double speed);
+	double getSpeed() const;
+
+	// Moves the playhead to the last frame at or before the timestamp (ns), which gets delivered next
+	void seek(uint64_t timestamp);
+
+	// While paused, delivers the next regular frame or the one before the last delivered one
+	void stepForward();
+	void stepBack();
+
+	// Events, from the playback thread
+	// Played back frames count as captured when they're delivered
+	boost::signals2::signal<void(const std::vector<uint16_t> & data, const FrameTimes & times)> onNewFrame;
+	boost::signals2::signal<void()> onPlaybackStop;
+
+private:
+	bool hasIndex() const;
+	bool readIndex();
+	bool rebuildIndex();
+	PData decode(size_t idx, int depth = 0) const;
+	PData decodeReference(size_t idx, int depth) const;
+
+	void seekRecord(size_t idx);
+	void restartPace();
+
+	void playThread();
+	void prefetchThread();
+};
@@ -0,0 +1,416 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "recording/recorder.h"
+#include "recording/codec.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstddef>
+
+using namespace recording;
+
+static const size_t MAX_QUEUED_FRAMES = 512;	// About 32 MB of raw frames, or almost a minute at full rate
+static const size_t CHUNK_FRAMES = 64;			// A chunk is written as soon as this many frames are queued...
+static const int CHUNK_INTERVAL_MS = 1000;		// ...or when the oldest one waited this long
+static const int KEY_FRAME_INTERVAL = 16;		// Longest run of delta coded frames, which is how far back a seek decodes
+
+
+//////////////////////////////////////////////////////////////////////////
+/// Constructor
+//////////////////////////////////////////////////////////////////////////
+Recorder::Recorder()
+	: m_file(nullptr), m_codec(CODEC_RAW), m_open(false), m_stop(false), m_offset(0), m_delta_count(0),
+	m_frames_written(0), m_frames_dropped(0), m_bytes_written(0), m_raw_bytes(0), m_failed(false)
+{
+}
+
+Recorder::~Recorder()
+{
+	close();
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// open - Creates the file and starts the writer thread
+//////////////////////////////////////////////////////////////////////////
+bool Recorder::open(const std::string & file, Codec codec, std::chrono::steady_clock::time_point start)
+{
+	close();
+
+	m_file = std::fopen(file.c_str(), "wb");
+
+	if (!m_file)
+		return false;
+
+	// Every chunk goes out in one call, there's nothing to gain from another layer of buffering
+	std::setvbuf(m_file, nullptr, _IONBF, 0);
+
+	m_frames_written = 0;
+	m_frames_dropped = 0;
+	m_bytes_written = 0;
+	m_raw_bytes = 0;
+	m_failed = false;
+	m_latency.reset();
+	m_index.clear();
+	m_offset = 0;
+	m_codec = codec;
+	m_reference.clear();
+	m_delta_count = 0;
+
+	auto now = std::chrono::steady_clock::now();
+
+	if (start == std::chrono::steady_clock::time_point() || start > now)
+		start = now;
+
+	// The index fields are filled in by close()
+	FileHeader header;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, FILE_MAGIC, sizeof(header.magic));
+
+	header.version		= VERSION;
+	header.header_size	= sizeof(FileHeader);
+	header.frame_width	= 206;
+	header.frame_height	= 156;
+	header.start_time	= std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch() - (now - start)).count();
+
+	if (!write(&header, sizeof(header)))
+	{
+		std::fclose(m_file);
+		m_file = nullptr;
+
+		return false;
+	}
+
+	m_start = start;
+	m_stop = false;
+	m_open = true;
+
+	m_thread = std::thread(&Recorder::writerThread, this);
+
+	return true;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// close - Flushes the queue, writes the index and closes the file
+//////////////////////////////////////////////////////////////////////////
+void Recorder::close()
+{
+	if (!m_file)
+		return;
+
+	m_open = false;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mx);
+
+		m_stop = true;
+		m_cv.notify_one();
+		m_room_cv.notify_all();
+	}
+
+	m_thread.join();
+
+	if (!m_failed)
+		writeIndex();
+
+	std::fclose(m_file);
+	m_file = nullptr;
+
+	std::lock_guard<std::mutex> lock(m_mx);
+
+	m_queue.clear();
+	m_free.clear();
+}
+
+
+bool Recorder::isOpen() const
+{
+	return m_open;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// addFrame - Queues a copy of the frame for the writer thread
+//////////////////////////////////////////////////////////////////////////
+bool Recorder::addFrame(const std::vector<uint16_t> & data, uint64_t seq, std::chrono::steady_clock::time_point time, bool wait)
+{
+	if (!m_open || m_failed || time < m_start)
+		return false;
+
+	Frame frame;
+
+	{
+		std::unique_lock<std::mutex> lock(m_mx);
+
+		if (wait)
+			m_room_cv.wait(lock, [this] { return m_stop || m_failed || m_queue.size() < MAX_QUEUED_FRAMES; });
+
+		if (m_queue.size() >= MAX_QUEUED_FRAMES)
+		{
+			++m_frames_dropped;
+			return false;
+		}
+
+		// Reuse the buffer of a frame that was already written
+		if (!m_free.empty())
+		{
+			frame = std::move(m_free.back());
+			m_free.pop_back();
+		}
+	}
+
+	// The copy happens outside the lock, so the writer thread never waits for it
+	frame.timestamp	= std::chrono::duration_cast<std::chrono::nanoseconds>(time - m_start).count();
+	frame.seq		= seq;
+	frame.id		= data.size() > 10 ? static_cast<uint8_t>(data[10]) : 0;
+	frame.data.assign(data.begin(), data.end());
+
+	std::lock_guard<std::mutex> lock(m_mx);
+
+	// close() got called meanwhile
+	if (m_stop)
+		return false;
+
+	m_queue.push_back(std::move(frame));
+
+	if (m_queue.size() >= CHUNK_FRAMES)
+		m_cv.notify_one();
+
+	return true;
+}
+
+
+Recorder::Stats Recorder::getStats() const
+{
+	Stats stats;
+
+	stats.frames_written	= m_frames_written;
+	stats.frames_dropped	= m_frames_dropped;
+	stats.bytes_written		= m_bytes_written;
+	stats.raw_bytes			= m_raw_bytes;
+	stats.failed			= m_failed;
+	stats.latency			= m_latency.getSummary();
+
+	return stats;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// writerThread - Takes the queued frames in batches and writes them as chunks
+//////////////////////////////////////////////////////////////////////////
+void Recorder::writerThread()
+{
+	TRACE_THREAD_NAME("Recorder");
+
+	std::vector<Frame> frames;
+
+	std::unique_lock<std::mutex> lock(m_mx);
+
+	while (true)
+	{
+		m_cv.wait_for(lock, std::chrono::milliseconds(CHUNK_INTERVAL_MS), [this] { return m_stop || m_queue.size() >= CHUNK_FRAMES; });
+
+		bool stop = m_stop;
+
+		frames.swap(m_queue);
+		m_room_cv.notify_all();
+
+		lock.unlock();
+
+		if (!frames.empty() && !m_failed)
+			writeChunk(frames);
+
+		lock.lock();
+
+		// Hand the buffers back for reuse
+		for (auto & frame : frames)
+			m_free.push_back(std::move(frame));
+
+		frames.clear();
+
+		if (stop)
+			break;
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// writeChunk - Serializes the frames into one buffer, and writes it with a single call
+//////////////////////////////////////////////////////////////////////////
+void Recorder::writeChunk(const std::vector<Frame> & frames)
+{
+	m_payloads.resize(std::max(m_payloads.size(), frames.size()));
+
+	size_t size = 0;
+	size_t raw_size = 0;
+
+	for (size_t i = 0; i < frames.size(); ++i)
+	{
+		encode(frames[i], m_payloads[i]);
+
+		size_t payload = m_payloads[i].codec == CODEC_RAW ? frames[i].data.size() * sizeof(uint16_t) : m_payloads[i].data.size();
+
+		size += sizeof(RecordHeader) + padded(payload);
+		raw_size += frames[i].data.size() * sizeof(uint16_t);
+	}
+
+	m_buffer.resize(sizeof(ChunkHeader) + size);
+
+	uint8_t * p = &m_buffer[0];
+
+	ChunkHeader chunk;
+
+	chunk.magic			= CHUNK_MAGIC;
+	chunk.record_count	= static_cast<uint32_t>(frames.size());
+	chunk.size			= size;
+
+	memcpy(p, &chunk, sizeof(chunk));
+	p += sizeof(chunk);
+
+	for (size_t i = 0; i < frames.size(); ++i)
+	{
+		const Frame & frame = frames[i];
+		const Payload & encoded = m_payloads[i];
+
+		bool raw = encoded.codec == CODEC_RAW;
+		const void * payload = raw ? static_cast<const void *>(frame.data.data()) : encoded.data.data();
+
+		RecordHeader record;
+
+		record.timestamp	= frame.timestamp;
+		record.seq			= frame.seq;
+		record.size			= static_cast<uint32_t>(raw ? frame.data.size() * sizeof(uint16_t) : encoded.data.size());
+		record.frame_id		= frame.id;
+		record.codec		= static_cast<uint8_t>(encoded.codec);
+		record.reserved		= 0;
+
+		IndexEntry entry;
+
+		entry.timestamp	= record.timestamp;
+		entry.offset	= m_offset + (p - &m_buffer[0]);
+		entry.size		= record.size;
+		entry.frame_id	= record.frame_id;
+		entry.codec		= record.codec;
+		entry.reserved	= 0;
+
+		m_index.push_back(entry);
+
+		memcpy(p, &record, sizeof(record));
+		p += sizeof(record);
+
+		if (record.size)
+			memcpy(p, payload, record.size);
+
+		memset(p + record.size, 0, padded(record.size) - record.size);
+		p += padded(record.size);
+	}
+
+	if (write(&m_buffer[0], m_buffer.size()))
+	{
+		m_frames_written += frames.size();
+		m_raw_bytes += raw_size;
+
+		auto now = std::chrono::steady_clock::now();
+
+		for (auto & frame : frames)
+			m_latency.record(now - (m_start + std::chrono::nanoseconds(frame.timestamp)));
+	}
+	else
+		m_index.resize(m_index.size() - frames.size());
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// encode - Compresses a frame, regular frames are delta coded against the previous one
+//////////////////////////////////////////////////////////////////////////
+void Recorder::encode(const Frame & frame, Payload & out)
+{
+	const int width = 206;
+	const int height = 156;
+
+	// Frames of another size are stored as they are
+	if (m_codec == CODEC_RAW || frame.data.size() != static_cast<size_t>(width) * height)
+	{
+		out.codec = CODEC_RAW;
+		return;
+	}
+
+	out.codec = CODEC_THERMAL;
+
+	// Calibration frames look nothing like the regular ones, and seeking decodes them on their own
+	bool delta = frame.id == 3 && !m_reference.empty() && m_delta_count < KEY_FRAME_INTERVAL;
+
+	FrameCodec::encode(frame.data.data(), width, height, delta ? m_reference.data() : nullptr, out.data);
+
+	if (frame.id == 3)
+	{
+		FrameCodec::Header header;
+
+		if (FrameCodec::readHeader(out.data.data(), out.data.size(), header) && header.delta)
+			++m_delta_count;
+		else
+			m_delta_count = 0;
+
+		m_reference = frame.data;
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// writeIndex - Appends the index and the footer, then fills in the header
+//////////////////////////////////////////////////////////////////////////
+void Recorder::writeIndex()
+{
+	Footer footer;
+
+	footer.index_offset	= m_offset;
+	footer.record_count	= m_index.size();
+	memcpy(footer.magic, FOOTER_MAGIC, sizeof(footer.magic));
+
+	if ((!m_index.empty() && !write(&m_index[0], m_index.size() * sizeof(IndexEntry))) || !write(&footer, sizeof(footer)))
+		return;
+
+	// The header is at the start of the file, so there's no need for 64 bit seeking
+	if (std::fseek(m_file, offsetof(FileHeader, index_offset), SEEK_SET) == 0)
+	{
+		std::fwrite(&footer.index_offset, sizeof(footer.index_offset), 1, m_file);
+		std::fwrite(&footer.record_count, sizeof(footer.record_count), 1, m_file);
+	}
+}
+
+
+bool Recorder::write(const void * data, size_t size)
+{
+	if (std::fwrite(data, 1, size, m_file) != size)
+	{
+		m_failed = true;
+		return false;
+	}
+
+	m_offset += size;
+	m_bytes_written += size;
+
+	return true;
+}
@@ -0,0 +1,129 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "recording/format.h"
+#include "stage_timing.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/align/aligned_allocator.hpp>
+
+// Writes the camera frames into a recording. addFrame() only copies the frame into a queue, the file is written
+// by a thread of its own in large chunks, so the camera never waits for the disk. If the disk can't keep up,
+// frames get dropped instead, and counted.
+class Recorder
+{
+public:
+	struct Stats
+	{
+		uint64_t	frames_written;
+		uint64_t	frames_dropped;
+		uint64_t	bytes_written;
+		uint64_t	raw_bytes;		// What the written frames would take uncompressed
+		bool		failed;			// Writing failed, nothing is recorded any more
+
+		LatencyHistogram::Summary	latency;	// From the frame time to being written
+	};
+
+private:
+	struct Frame
+	{
+		uint64_t				timestamp;
+		uint64_t				seq;
+		uint8_t					id;
+		std::vector<uint16_t>	data;
+	};
+
+	// A frame as it goes into the file
+	struct Payload
+	{
+		recording::Codec		codec;
+		std::vector<uint8_t>	data;		// Unused for CODEC_RAW, the frame is written as it is
+	};
+
+	typedef std::vector<uint8_t, boost::alignment::aligned_allocator<uint8_t, 4096>> Buffer;
+
+	std::FILE *			m_file;
+	recording::Codec	m_codec;
+	std::thread			m_thread;
+	std::atomic<bool>	m_open;			// Checked by addFrame(), from the camera thread
+
+	std::mutex			m_mx;
+	std::condition_variable	m_cv;
+	std::condition_variable	m_room_cv;	// The writer thread took the queue
+	std::vector<Frame>	m_queue;		// Frames waiting to be written
+	std::vector<Frame>	m_free;			// Written frames, kept so their buffers can be reused
+	bool				m_stop;
+
+	std::chrono::steady_clock::time_point	m_start;
+
+	// Writer thread only
+	Buffer					m_buffer;	// One chunk
+	uint64_t				m_offset;	// Where the next chunk goes
+	std::vector<recording::IndexEntry>	m_index;
+	std::vector<Payload>	m_payloads;		// Encoded frames of the chunk
+	std::vector<uint16_t>	m_reference;	// Last regular frame, delta coding starts from it
+	int						m_delta_count;	// Delta coded frames since the last key frame
+
+	std::atomic<uint64_t>	m_frames_written;
+	std::atomic<uint64_t>	m_frames_dropped;
+	std::atomic<uint64_t>	m_bytes_written;
+	std::atomic<uint64_t>	m_raw_bytes;
+	std::atomic<bool>		m_failed;
+	LatencyHistogram		m_latency;		// Recorded by the writer thread
+
+public:
+	Recorder();
+	~Recorder();
+
+	Recorder(const Recorder &) = delete;
+	Recorder & operator=(const Recorder &) = delete;
+
+	// Timestamps are measured from start, which defaults to now. Frames can't be older than start.
+	bool open(const std::string & file, recording::Codec codec = recording::CODEC_THERMAL,
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::time_point());
+	void close();					// Writes whatever is still queued, then the index
+	bool isOpen() const;
+
+	// Queues a frame. Unless told to wait for room in the queue, it never waits and drops the frame if the queue is full.
+	// Returns false if the frame was dropped. The time is when the frame was captured, how long it takes from then
+	// to the disk is in the stats.
+	bool addFrame(const std::vector<uint16_t> & data, uint64_t seq, std::chrono::steady_clock::time_point time, bool wait = false);
+
+	Stats getStats() const;
+
+private:
+	void writerThread();
+	void writeChunk(const std::vector<Frame> & frames);
+	void encode(const Frame & frame, Payload & out);
+	void writeIndex();
+	bool write(const void * data, size_t size);
+};
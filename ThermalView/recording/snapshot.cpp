@@ -0,0 +1,196 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "recording/snapshot.h"
+#include <cstdio>
+
+using namespace snapshot;
+namespace bip = boost::interprocess;
+
+
+static size_t aligned(size_t size)
+{
+	return (size + SECTION_ALIGN - 1) & ~(SECTION_ALIGN - 1);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// Constructor
+//////////////////////////////////////////////////////////////////////////
+Snapshot::Snapshot()
+	: m_data(nullptr), m_size(0)
+{
+	memset(&m_header, 0, sizeof(m_header));
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// save - Header, section table, then the sections, each one aligned
+//////////////////////////////////////////////////////////////////////////
+bool Snapshot::save(const std::string & file, const SnapshotHeader & header, const std::vector<Section> & sections)
+{
+	SnapshotHeader out = header;
+
+	memcpy(out.magic, MAGIC, sizeof(out.magic));
+
+	out.version			= VERSION;
+	out.header_size		= sizeof(SnapshotHeader);
+	out.section_count	= static_cast<uint32_t>(sections.size());
+
+	// Lay the sections out after the table
+	std::vector<SectionEntry> table;
+	uint64_t offset = aligned(sizeof(SnapshotHeader) + sections.size() * sizeof(SectionEntry));
+
+	for (auto & section : sections)
+	{
+		SectionEntry entry;
+
+		entry.type			= section.type;
+		entry.element_size	= section.element_size;
+		entry.offset		= offset;
+		entry.size			= section.size;
+
+		table.push_back(entry);
+
+		offset += aligned(section.size);
+	}
+
+	std::FILE * f = std::fopen(file.c_str(), "wb");
+
+	if (!f)
+		return false;
+
+	static const uint8_t padding[SECTION_ALIGN] = {};
+
+	size_t table_size = sizeof(SnapshotHeader) + table.size() * sizeof(SectionEntry);
+
+	bool ok = std::fwrite(&out, sizeof(out), 1, f) == 1 &&
+		(table.empty() || std::fwrite(&table[0], sizeof(SectionEntry), table.size(), f) == table.size()) &&
+		std::fwrite(padding, 1, aligned(table_size) - table_size, f) == aligned(table_size) - table_size;
+
+	for (size_t i = 0; ok && i < sections.size(); ++i)
+	{
+		size_t size = sections[i].size;
+
+		ok = (!size || std::fwrite(sections[i].data, 1, size, f) == size) &&
+			std::fwrite(padding, 1, aligned(size) - size, f) == aligned(size) - size;
+	}
+
+	return std::fclose(f) == 0 && ok;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// open - Maps the file, and finds the sections
+//////////////////////////////////////////////////////////////////////////
+bool Snapshot::open(const std::string & file)
+{
+	close();
+
+	try
+	{
+		bip::file_mapping mapping(file.c_str(), bip::read_only);
+		bip::mapped_region region(mapping, bip::read_only);
+
+		m_mapping.swap(mapping);
+		m_region.swap(region);
+	}
+	catch (const bip::interprocess_exception &)
+	{
+		return false;
+	}
+
+	m_data = static_cast<const uint8_t *>(m_region.get_address());
+	m_size = m_region.get_size();
+
+	bool ok = m_size >= sizeof(SnapshotHeader);
+
+	if (ok)
+	{
+		memcpy(&m_header, m_data, sizeof(m_header));
+
+		ok = memcmp(m_header.magic, MAGIC, sizeof(m_header.magic)) == 0 && m_header.version == VERSION &&
+			m_header.header_size >= sizeof(SnapshotHeader) && m_header.header_size <= m_size &&
+			m_header.section_count <= (m_size - m_header.header_size) / sizeof(SectionEntry);
+	}
+
+	for (uint32_t i = 0; ok && i < m_header.section_count; ++i)
+	{
+		SectionEntry entry;
+
+		memcpy(&entry, m_data + m_header.header_size + i * sizeof(SectionEntry), sizeof(entry));
+
+		// Misaligned sections can't be used in place
+		ok = entry.offset % SECTION_ALIGN == 0 && entry.offset <= m_size && entry.size <= m_size - entry.offset &&
+			entry.element_size && entry.size % entry.element_size == 0;
+
+		if (ok)
+		{
+			Section section;
+
+			section.type			= entry.type;
+			section.element_size	= entry.element_size;
+			section.data			= m_data + entry.offset;
+			section.size			= static_cast<size_t>(entry.size);
+
+			m_sections.push_back(section);
+		}
+	}
+
+	if (!ok)
+		close();
+
+	return ok;
+}
+
+
+void Snapshot::close()
+{
+	m_sections.clear();
+
+	bip::mapped_region().swap(m_region);
+	bip::file_mapping().swap(m_mapping);
+
+	m_data = nullptr;
+	m_size = 0;
+
+	memset(&m_header, 0, sizeof(m_header));
+}
+
+
+bool Snapshot::isOpen() const
+{
+	return m_data != nullptr;
+}
+
+
+const SnapshotHeader & Snapshot::getHeader() const
+{
+	return m_header;
+}
+
+
+const std::vector<Snapshot::Section> & Snapshot::getSections() const
+{
+	return m_sections;
+}
@@ -0,0 +1,176 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+// ThermalView radiometric snapshots (.tvs)
+//
+//	[SnapshotHeader] [SectionEntry]... [Section]...
+//
+// A snapshot holds a single frame, with everything needed to calibrate and render it again: the raw camera words,
+// the calibration tables, the bad pixels and the lookup table it was displayed with. Every section starts at a
+// multiple of SECTION_ALIGN, so when the file is memory mapped the tables can be used in place.
+// Readers skip the sections they don't know, new ones can be added without changing the version.
+// All fields are little endian.
+namespace snapshot
+{
+	static const char		MAGIC[8]		= { 'T', 'V', 'S', 'N', 'A', 'P', 'S', 'H' };
+	static const uint32_t	VERSION			= 1;
+	static const size_t		SECTION_ALIGN	= 8;
+
+	enum SectionType
+	{
+		SECTION_RAW				= 1,	// uint16_t, the words as they came from the camera
+		SECTION_PIXELS			= 2,	// uint16_t, the calibrated frame as it was displayed
+		SECTION_GAIN			= 3,	// double, gain calibration, from frame ID 4
+		SECTION_UNKNOWN_GAIN	= 4,	// uint16_t, pixels without gain calibration, from frame ID 4
+		SECTION_OFFSET			= 5,	// int32_t, offset calibration, from frame ID 1
+		SECTION_EXTRA_OFFSET	= 6,	// int32_t, extra offset calibration, applied after the offset calibration
+		SECTION_BAD_PIXELS		= 7,	// uint8_t, 1 for the bad pixels, row by row
+		SECTION_LUT_RGB			= 8,	// uint8_t, 3 per value, for the values from SnapshotHeader::lut_first up
+		SECTION_LUT_BAND		= 9,	// uint8_t, 0 for the palette, otherwise the 1 based index of the isotherm
+		SECTION_PROFILE_NAME	= 10,	// char, the color profile, not null terminated
+		SECTION_ISOTHERMS		= 11,	// IsothermEntry
+	};
+
+	enum Flags
+	{
+		FLAG_AUTO_RANGE		= 1,	// The range followed the frame
+		FLAG_EXTRA_OFFSET	= 2,	// The extra offset calibration was applied to SECTION_PIXELS
+	};
+
+	struct SnapshotHeader
+	{
+		char		magic[8];
+		uint32_t	version;
+		uint32_t	header_size;	// sizeof(SnapshotHeader), the section table starts right after it
+		uint32_t	width;
+		uint32_t	height;
+		uint64_t	time;			// System time when the snapshot was taken, in ns since the epoch
+		uint64_t	seq;			// Sequence number of the frame
+		uint8_t		frame_id;
+		uint8_t		reserved;
+		uint16_t	flags;
+		uint16_t	range_min;		// The palette was stretched over [range_min, range_max]
+		uint16_t	range_max;
+		uint16_t	lut_first;		// Value of the first lookup table entry
+		uint16_t	reserved2;
+		uint32_t	section_count;
+	};
+
+	struct SectionEntry
+	{
+		uint32_t	type;
+		uint32_t	element_size;
+		uint64_t	offset;			// From the start of the file
+		uint64_t	size;			// Bytes, without the padding
+	};
+
+	struct IsothermEntry
+	{
+		uint16_t	low;
+		uint16_t	high;
+		uint8_t		r;
+		uint8_t		g;
+		uint8_t		b;
+		uint8_t		alpha;
+	};
+}
+
+
+// Writes and reads the snapshots
+class Snapshot
+{
+public:
+	struct Section
+	{
+		uint32_t		type;
+		uint32_t		element_size;
+		const void *	data;
+		size_t			size;		// Bytes
+	};
+
+private:
+	boost::interprocess::file_mapping	m_mapping;
+	boost::interprocess::mapped_region	m_region;
+	const uint8_t *						m_data;
+	size_t								m_size;
+
+	snapshot::SnapshotHeader			m_header;
+	std::vector<Section>				m_sections;
+
+public:
+	Snapshot();
+
+	Snapshot(const Snapshot &) = delete;
+	Snapshot & operator=(const Snapshot &) = delete;
+
+	// Writes the header and the sections, which point to the caller's data
+	static bool save(const std::string & file, const snapshot::SnapshotHeader & header, const std::vector<Section> & sections);
+
+	// Maps the file and checks the section table, the sections are used where they are
+	bool open(const std::string & file);
+	void close();
+	bool isOpen() const;
+
+	const snapshot::SnapshotHeader & getHeader() const;
+	const std::vector<Section> & getSections() const;
+
+	// The section of the given type, if it's there with elements of type T, otherwise null
+	template <typename T>
+	const T * getSection(uint32_t type, size_t & count) const
+	{
+		for (auto & section : m_sections)
+		{
+			if (section.type == type && section.element_size == sizeof(T))
+			{
+				count = section.size / sizeof(T);
+				return static_cast<const T *>(section.data);
+			}
+		}
+
+		count = 0;
+		return nullptr;
+	}
+
+	// Adds a section pointing to the vector, for save()
+	template <typename T>
+	static void addSection(std::vector<Section> & sections, uint32_t type, const std::vector<T> & data)
+	{
+		Section section;
+
+		section.type			= type;
+		section.element_size	= sizeof(T);
+		section.data			= data.empty() ? nullptr : &data[0];
+		section.size			= data.size() * sizeof(T);
+
+		sections.push_back(section);
+	}
+};
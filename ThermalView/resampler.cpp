@@ -0,0 +1,361 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "resampler.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+
+static const int WEIGHT_BITS = 12;	// Fixed point weights
+static const int TMP_BITS = 4;		// Extra precision kept between the two passes
+static const int VALUE_TMP_BITS = 2;	// Same thing for raw values, which are 16 bit wide
+
+
+//////////////////////////////////////////////////////////////////////////
+/// Constructor
+//////////////////////////////////////////////////////////////////////////
+Resampler::Resampler()
+{
+	m_src_width = 0;
+	m_src_height = 0;
+	m_crop_x = 0;
+	m_crop_y = 0;
+	m_crop_width = 0;
+	m_crop_height = 0;
+	m_dst_width = 0;
+	m_dst_height = 0;
+	m_quality = QUALITY_NEAREST;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// setup - (Re)builds the tables when any of the parameters changed
+//////////////////////////////////////////////////////////////////////////
+void Resampler::setup(int src_width, int src_height, int dst_width, int dst_height, Quality quality)
+{
+	setup(src_width, src_height, 0, 0, src_width, src_height, dst_width, dst_height, quality);
+}
+
+void Resampler::setup(int src_width, int src_height, double crop_x, double crop_y, double crop_width, double crop_height,
+	int dst_width, int dst_height, Quality quality)
+{
+	if (src_width == m_src_width && src_height == m_src_height &&
+		crop_x == m_crop_x && crop_y == m_crop_y && crop_width == m_crop_width && crop_height == m_crop_height &&
+		dst_width == m_dst_width && dst_height == m_dst_height && quality == m_quality)
+		return;
+
+	m_src_width = src_width;
+	m_src_height = src_height;
+	m_crop_x = crop_x;
+	m_crop_y = crop_y;
+	m_crop_width = crop_width;
+	m_crop_height = crop_height;
+	m_dst_width = dst_width;
+	m_dst_height = dst_height;
+	m_quality = quality;
+
+	buildMap(m_map_x, src_width, crop_x, crop_width, dst_width, quality);
+	buildMap(m_map_y, src_height, crop_y, crop_height, dst_height, quality);
+
+	// A tap without weight reads a row for nothing, point it at one that's read anyway
+	const size_t taps = m_map_y.taps;
+
+	for (int i = 0; i < dst_height; ++i)
+	{
+		uint32_t * index = &m_map_y.index[i * taps];
+		const int32_t * weight = &m_map_y.weight[i * taps];
+
+		size_t heaviest = std::max_element(weight, weight + taps) - weight;
+
+		for (size_t k = 0; k < taps; ++k)
+		{
+			if (weight[k] == 0)
+				index[k] = index[heaviest];
+		}
+	}
+
+	// Only the rows the vertical pass reads go through the horizontal pass, which skips the rows between the taps
+	// when shrinking. The vertical map then indexes the rows of the horizontal pass, in source order.
+	vector<int> slot(src_height, -1);
+
+	for (auto index : m_map_y.index)
+		slot[index] = 0;
+
+	m_rows.clear();
+
+	for (int y = 0; y < src_height; ++y)
+	{
+		if (slot[y] == 0)
+		{
+			slot[y] = static_cast<int>(m_rows.size());
+			m_rows.push_back(y);
+		}
+	}
+
+	for (auto & index : m_map_y.index)
+		index = slot[index];
+
+	m_tmp.resize(m_rows.size() * dst_width * 3);
+	m_tmp_values.resize(m_rows.size() * dst_width);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// buildMap - Source coordinates and weights along one axis
+//////////////////////////////////////////////////////////////////////////
+void Resampler::buildMap(Map & map, int src, double origin, double size, int dst, Quality quality)
+{
+	switch (quality)
+	{
+		case QUALITY_BILINEAR:	map.taps = 2; break;
+		case QUALITY_BICUBIC:	map.taps = 4; break;
+		default:				map.taps = 1; break;
+	}
+
+	map.index.resize(dst * map.taps);
+	map.weight.resize(dst * map.taps);
+
+	const double ratio = size / dst;
+
+	for (int i = 0; i < dst; ++i)
+	{
+		uint32_t * index = &map.index[i * map.taps];
+		int32_t * weight = &map.weight[i * map.taps];
+
+		if (map.taps == 1)
+		{
+			index[0] = std::min(std::max(static_cast<int>(std::floor(origin + i * ratio)), 0), src - 1);
+			weight[0] = 1 << WEIGHT_BITS;
+			continue;
+		}
+
+		// Center of the target pixel, in source coordinates
+		double pos = origin + (i + 0.5) * ratio - 0.5;
+		int base = static_cast<int>(std::floor(pos));
+		double t = pos - base;
+
+		double w[4];
+
+		if (map.taps == 2)
+		{
+			w[0] = 1 - t;
+			w[1] = t;
+		}
+		else
+		{
+			// Catmull-Rom
+			w[0] = ((-0.5 * t + 1.0) * t - 0.5) * t;
+			w[1] = (1.5 * t - 2.5) * t * t + 1.0;
+			w[2] = ((-1.5 * t + 2.0) * t + 0.5) * t;
+			w[3] = (0.5 * t - 0.5) * t * t;
+
+			--base;
+		}
+
+		// Make sure the fixed point weights add up to exactly one
+		int32_t total = 0;
+
+		for (size_t k = 0; k < map.taps; ++k)
+		{
+			index[k] = std::min(std::max(base + static_cast<int>(k), 0), src - 1);
+			weight[k] = static_cast<int32_t>(std::floor(w[k] * (1 << WEIGHT_BITS) + 0.5));
+
+			total += weight[k];
+		}
+
+		weight[map.taps / 2] += (1 << WEIGHT_BITS) - total;
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// The two passes, with the number of taps known at compile time
+//////////////////////////////////////////////////////////////////////////
+template <size_t TAPS>
+static void horizontal_pass(const unsigned char * src_row, int16_t * tmp_row, int dst_width, const uint32_t * index, const int32_t * weight)
+{
+	for (int x = 0; x < dst_width; ++x, index += TAPS, weight += TAPS, tmp_row += 3)
+	{
+		int32_t r = 0;
+		int32_t g = 0;
+		int32_t b = 0;
+
+		for (size_t k = 0; k < TAPS; ++k)
+		{
+			const unsigned char * p = src_row + index[k] * 3;
+
+			r += weight[k] * p[0];
+			g += weight[k] * p[1];
+			b += weight[k] * p[2];
+		}
+
+		tmp_row[0] = static_cast<int16_t>(r >> (WEIGHT_BITS - TMP_BITS));
+		tmp_row[1] = static_cast<int16_t>(g >> (WEIGHT_BITS - TMP_BITS));
+		tmp_row[2] = static_cast<int16_t>(b >> (WEIGHT_BITS - TMP_BITS));
+	}
+}
+
+template <size_t TAPS>
+static void vertical_pass(const int16_t * const * rows, unsigned char * dst_row, int count, const int32_t * weight)
+{
+	const int shift = WEIGHT_BITS + TMP_BITS;
+	const int32_t round = 1 << (shift - 1);
+
+	for (int x = 0; x < count; ++x)
+	{
+		int32_t v = round;
+
+		for (size_t k = 0; k < TAPS; ++k)
+			v += weight[k] * rows[k][x];
+
+		v >>= shift;
+
+		dst_row[x] = static_cast<unsigned char>(std::min(std::max(v, 0), 255));
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// scale - Horizontal pass into m_tmp, then the vertical pass into dst
+//////////////////////////////////////////////////////////////////////////
+void Resampler::scale(const unsigned char * src, unsigned char * dst)
+{
+	const size_t taps_x = m_map_x.taps;
+	const size_t taps_y = m_map_y.taps;
+
+	for (size_t y = 0; y < m_rows.size(); ++y)
+	{
+		const unsigned char * src_row = src + static_cast<size_t>(m_rows[y]) * m_src_width * 3;
+		int16_t * tmp_row = &m_tmp[y * m_dst_width * 3];
+
+		switch (taps_x)
+		{
+			case 1:	horizontal_pass<1>(src_row, tmp_row, m_dst_width, &m_map_x.index[0], &m_map_x.weight[0]); break;
+			case 2:	horizontal_pass<2>(src_row, tmp_row, m_dst_width, &m_map_x.index[0], &m_map_x.weight[0]); break;
+			default:	horizontal_pass<4>(src_row, tmp_row, m_dst_width, &m_map_x.index[0], &m_map_x.weight[0]); break;
+		}
+	}
+
+	for (int y = 0; y < m_dst_height; ++y)
+	{
+		const uint32_t * index = &m_map_y.index[y * taps_y];
+		const int32_t * weight = &m_map_y.weight[y * taps_y];
+
+		unsigned char * dst_row = dst + static_cast<size_t>(y) * m_dst_width * 3;
+
+		const int16_t * rows[4];
+
+		for (size_t k = 0; k < taps_y; ++k)
+			rows[k] = &m_tmp[static_cast<size_t>(index[k]) * m_dst_width * 3];
+
+		switch (taps_y)
+		{
+			case 1:	vertical_pass<1>(rows, dst_row, m_dst_width * 3, weight); break;
+			case 2:	vertical_pass<2>(rows, dst_row, m_dst_width * 3, weight); break;
+			default:	vertical_pass<4>(rows, dst_row, m_dst_width * 3, weight); break;
+		}
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// prepareValues - Horizontal pass over raw values
+//////////////////////////////////////////////////////////////////////////
+void Resampler::prepareValues(const uint16_t * src)
+{
+	const size_t taps = m_map_x.taps;
+
+	for (size_t y = 0; y < m_rows.size(); ++y)
+	{
+		const uint16_t * src_row = src + static_cast<size_t>(m_rows[y]) * m_src_width;
+		int32_t * tmp_row = &m_tmp_values[y * m_dst_width];
+
+		const uint32_t * index = &m_map_x.index[0];
+		const int32_t * weight = &m_map_x.weight[0];
+
+		for (int x = 0; x < m_dst_width; ++x, index += taps, weight += taps)
+		{
+			int32_t v = 0;
+
+			for (size_t k = 0; k < taps; ++k)
+				v += weight[k] * src_row[index[k]];
+
+			tmp_row[x] = v >> (WEIGHT_BITS - VALUE_TMP_BITS);
+		}
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// getValueRow - Vertical pass and lookup for one target row
+//////////////////////////////////////////////////////////////////////////
+void Resampler::getValueRow(int y, const uint8_t * lut, uint16_t lut_first, size_t lut_size, unsigned char * dst) const
+{
+	const size_t taps = m_map_y.taps;
+	const uint32_t * index = &m_map_y.index[y * taps];
+	const int32_t * weight = &m_map_y.weight[y * taps];
+
+	const int shift = WEIGHT_BITS + VALUE_TMP_BITS;
+	const int32_t round = 1 << (shift - 1);
+	const int32_t last = static_cast<int32_t>(lut_size) - 1;
+
+	const int32_t * rows[4];
+
+	for (size_t k = 0; k < taps; ++k)
+		rows[k] = &m_tmp_values[static_cast<size_t>(index[k]) * m_dst_width];
+
+	for (int x = 0; x < m_dst_width; ++x, dst += 3)
+	{
+		int32_t v = round;
+
+		for (size_t k = 0; k < taps; ++k)
+			v += weight[k] * rows[k][x];
+
+		// Bicubic can overshoot, so clamp to the table
+		int32_t idx = (v >> shift) - lut_first;
+		idx = std::min(std::max(idx, 0), last);
+
+		const uint8_t * rgb = lut + idx * 3;
+
+		dst[0] = rgb[0];
+		dst[1] = rgb[1];
+		dst[2] = rgb[2];
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// isSameRow - Whether the vertical map of a target row matches the previous one
+//////////////////////////////////////////////////////////////////////////
+bool Resampler::isSameRow(int y) const
+{
+	if (y <= 0 || y >= m_dst_height)
+		return false;
+
+	const size_t taps = m_map_y.taps;
+
+	return equal(&m_map_y.index[y * taps], &m_map_y.index[y * taps] + taps, &m_map_y.index[(y - 1) * taps]) &&
+		equal(&m_map_y.weight[y * taps], &m_map_y.weight[y * taps] + taps, &m_map_y.weight[(y - 1) * taps]);
+}
@@ -0,0 +1,98 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Separable image scaler that keeps the source coordinates and the filter weights between calls.
+// The tables only depend on the source size, the cropped area, the target size and the quality, so every frame
+// after the first one is just a horizontal and a vertical pass over the pixels.
+// Only the source rows the vertical pass uses are ever read, so scaling a small area, or shrinking, costs less than
+// going over the whole source.
+class Resampler
+{
+public:
+	enum Quality { QUALITY_NEAREST, QUALITY_BILINEAR, QUALITY_BICUBIC };
+
+private:
+	// Source coordinates and weights for each target coordinate along one axis
+	struct Map
+	{
+		size_t					taps;		// Source pixels per target pixel
+		std::vector<uint32_t>	index;		// taps entries per target pixel
+		std::vector<int32_t>	weight;		// taps entries per target pixel, fixed point
+	};
+
+	int		m_src_width;
+	int		m_src_height;
+	double	m_crop_x;
+	double	m_crop_y;
+	double	m_crop_width;
+	double	m_crop_height;
+	int		m_dst_width;
+	int		m_dst_height;
+	Quality	m_quality;
+
+	std::vector<int>	m_rows;		// Source rows that go through the horizontal pass, the vertical map indexes this
+
+	Map		m_map_x;
+	Map		m_map_y;
+
+	std::vector<int16_t>	m_tmp;		// Result of the horizontal pass, one row per used source row
+	std::vector<int32_t>	m_tmp_values;	// Same thing, for raw values
+
+public:
+	Resampler();
+
+	// Builds the tables, unless they're already built for the same parameters
+	void setup(int src_width, int src_height, int dst_width, int dst_height, Quality quality);
+
+	// Same thing, for scaling only the area that starts at (crop_x, crop_y), in source pixels.
+	// The area doesn't have to be pixel aligned, so it can be moved around smoothly.
+	void setup(int src_width, int src_height, double crop_x, double crop_y, double crop_width, double crop_height,
+		int dst_width, int dst_height, Quality quality);
+
+	// Scales an RGB buffer of the configured source size into an RGB buffer of the configured target size
+	void scale(const unsigned char * src, unsigned char * dst);
+
+	// Scales raw values and maps them through a lookup table (3 bytes per value, covering [lut_first, lut_first + lut_size)).
+	// The values are interpolated before the mapping, so there's never a colored copy of the source.
+	// prepareValues() does the horizontal pass, then getValueRow() produces one RGB row of the target at a time.
+	void prepareValues(const uint16_t * src);
+	void getValueRow(int y, const uint8_t * lut, uint16_t lut_first, size_t lut_size, unsigned char * dst) const;
+
+	// True when target row y comes out exactly like row y - 1, which happens a lot when zooming in
+	bool isSameRow(int y) const;
+
+	int getSrcWidth() const { return m_src_width; }
+	int getSrcHeight() const { return m_src_height; }
+	int getDstWidth() const { return m_dst_width; }
+	int getDstHeight() const { return m_dst_height; }
+
+private:
+	// Builds the map for the source range [origin, origin + size)
+	static void buildMap(Map & map, int src, double origin, double size, int dst, Quality quality);
+};
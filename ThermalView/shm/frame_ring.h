@@ -0,0 +1,101 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// The frames ThermalView shares with other processes: a POSIX shared memory object holding two rings of frame
+// slots, one for the frames as they came from the camera and one for the calibrated frames. Each ring has one
+// writer and any number of readers, and nobody ever waits for anybody.
+//
+//	[Header] [raw slot]... [calibrated slot]...
+//
+// A slot is a SlotHeader followed by width * height pixels, row by row, and padded to SLOT_ALIGN bytes. It's
+// guarded by its version, seqlock style: odd while the writer is in it, and bumped again when it's done. A reader
+// takes the version, reads what it needs right in the mapping, and only trusts it if the version is still the
+// same even number afterwards. Nothing is copied on either side beyond the writer filling the slot, and no system
+// call is made per frame.
+//
+// Only the two processes' byte order and alignment have to match, they're on the same host anyway.
+namespace ring
+{
+	static const char		MAGIC[8]		= { 'T', 'V', 'F', 'R', 'A', 'M', 'E', 'S' };
+	static const uint32_t	VERSION			= 1;
+	static const size_t		SLOT_ALIGN		= 64;	// A cache line, so two slots never share one
+	static const char		DEFAULT_NAME[]	= "/thermalview";
+
+	enum Kind
+	{
+		KIND_RAW = 0,			// Every frame from the camera, calibration frames included
+		KIND_CALIBRATED = 1,	// The regular frames, calibrated, with the extra calibration if it was on
+		KIND_COUNT
+	};
+
+	enum SlotFlags
+	{
+		FLAG_EXTRA_CAL = 1,		// The extra calibration was applied
+	};
+
+	struct Header
+	{
+		char					magic[8];
+		uint32_t				version;
+		uint32_t				header_size;			// sizeof(Header)
+		uint32_t				width;
+		uint32_t				height;
+		uint32_t				slot_count;				// In each ring
+		uint32_t				slot_size;				// In bytes, header and padding included
+		uint64_t				ring_offset[KIND_COUNT];	// Where the first slot of each ring is, from the start
+		uint64_t				start_time;				// System time the writer opened it, in ns since the epoch
+		uint32_t				writer_pid;
+		std::atomic<uint32_t>	open;					// Cleared when the writer closes it, it's never used again
+
+		// Frames written to each ring so far. The latest one is write written - 1, in slot (written - 1) % slot_count.
+		std::atomic<uint64_t>	written[KIND_COUNT];
+	};
+
+	struct SlotHeader
+	{
+		std::atomic<uint64_t>	version;		// Odd while it's being written
+		uint64_t				index;			// Which write of the ring it holds
+		uint64_t				seq;			// Sequence number of the camera frame
+		int64_t					captured_ns;	// When its USB transfer completed, on CLOCK_MONOTONIC, 0 if unknown
+		uint16_t				id;				// Frame type, 3 for the regular frames
+		uint16_t				counter;		// The camera's own frame counter
+		uint16_t				min_val;		// Of the good pixels, 0 in the raw frames
+		uint16_t				max_val;
+		uint16_t				avg_val;
+		uint16_t				flags;			// SlotFlags
+		uint8_t					reserved[20];
+	};
+
+	static_assert(sizeof(SlotHeader) == 64, "The pixels start a cache line after the slot");
+
+	inline size_t slotSize(uint32_t width, uint32_t height)
+	{
+		return (sizeof(SlotHeader) + width * height * sizeof(uint16_t) + SLOT_ALIGN - 1) / SLOT_ALIGN * SLOT_ALIGN;
+	}
+}
@@ -0,0 +1,247 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "shm/ring_reader.h"
+
+#include <cstring>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+RingReader::RingReader()
+	: m_data(nullptr),
+	m_size(0),
+	m_header(nullptr)
+{
+}
+
+
+RingReader::~RingReader()
+{
+	close();
+}
+
+
+bool RingReader::open(const std::string & name)
+{
+	close();
+
+#ifndef _WIN32
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+
+	if (fd < 0)
+	{
+		m_error = "Can't open " + name + ": " + strerror(errno);
+		return false;
+	}
+
+	struct stat st;
+
+	if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(ring::Header))
+	{
+		m_error = name + " isn't ready yet";
+		::close(fd);
+		return false;
+	}
+
+	m_size = static_cast<size_t>(st.st_size);
+	m_data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+
+	if (m_data == MAP_FAILED)
+	{
+		m_error = "Can't map " + name + ": " + strerror(errno);
+		m_data = nullptr;
+		return false;
+	}
+
+	const ring::Header * header = static_cast<const ring::Header *>(m_data);
+
+	// The magic is written last
+	bool ready = memcmp(header->magic, ring::MAGIC, sizeof(ring::MAGIC)) == 0;
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	if (!ready || header->version != ring::VERSION || header->header_size != sizeof(ring::Header))
+	{
+		m_error = ready ? name + " was written by another version of ThermalView" : name + " isn't ready yet";
+		close();
+		return false;
+	}
+
+	for (int kind = 0; kind < ring::KIND_COUNT; kind++)
+	{
+		if (header->ring_offset[kind] + static_cast<uint64_t>(header->slot_count) * header->slot_size > m_size ||
+			header->slot_size < ring::slotSize(header->width, header->height))
+		{
+			m_error = name + " is damaged";
+			close();
+			return false;
+		}
+	}
+
+	m_header = header;
+	m_error.clear();
+
+	return true;
+#else
+	m_error = "frames are only shared where there's POSIX shared memory";
+	return false;
+#endif
+}
+
+
+void RingReader::close()
+{
+#ifndef _WIN32
+	if (m_data)
+		munmap(m_data, m_size);
+#endif
+
+	m_data = nullptr;
+	m_size = 0;
+	m_header = nullptr;
+}
+
+
+bool RingReader::isOpen() const
+{
+	return m_header != nullptr;
+}
+
+
+const std::string & RingReader::getError() const
+{
+	return m_error;
+}
+
+
+bool RingReader::isClosed() const
+{
+	return !m_header || !m_header->open.load(std::memory_order_acquire);
+}
+
+
+uint32_t RingReader::getWidth() const
+{
+	return m_header ? m_header->width : 0;
+}
+
+
+uint32_t RingReader::getHeight() const
+{
+	return m_header ? m_header->height : 0;
+}
+
+
+uint32_t RingReader::getSlotCount() const
+{
+	return m_header ? m_header->slot_count : 0;
+}
+
+
+uint32_t RingReader::getWriterPid() const
+{
+	return m_header ? m_header->writer_pid : 0;
+}
+
+
+uint64_t RingReader::getWritten(ring::Kind kind) const
+{
+	return m_header ? m_header->written[kind].load(std::memory_order_acquire) : 0;
+}
+
+
+bool RingReader::view(ring::Kind kind, uint64_t index, View & view) const
+{
+	if (!m_header || index >= getWritten(kind))
+		return false;
+
+	const uint8_t * slot = static_cast<const uint8_t *>(m_data) + m_header->ring_offset[kind] + (index % m_header->slot_count) * m_header->slot_size;
+
+	view.slot	= reinterpret_cast<const ring::SlotHeader *>(slot);
+	view.pixels	= reinterpret_cast<const uint16_t *>(view.slot + 1);
+	view.version = view.slot->version.load(std::memory_order_acquire);
+
+	// Being written, or already holding a later write
+	return !(view.version & 1) && view.slot->index == index && isValid(view);
+}
+
+
+bool RingReader::isValid(const View & view) const
+{
+	// Everything read before this stays before the version is read again
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	return view.slot->version.load(std::memory_order_relaxed) == view.version;
+}
+
+
+bool RingReader::read(ring::Kind kind, uint64_t index, Frame & frame) const
+{
+	View slot;
+
+	if (!view(kind, index, slot))
+		return false;
+
+	size_t pixels = static_cast<size_t>(m_header->width) * m_header->height;
+
+	frame.pixels.resize(pixels);
+
+	frame.index			= slot.slot->index;
+	frame.seq			= slot.slot->seq;
+	frame.captured_ns	= slot.slot->captured_ns;
+	frame.id			= slot.slot->id;
+	frame.counter		= slot.slot->counter;
+	frame.min_val		= slot.slot->min_val;
+	frame.max_val		= slot.slot->max_val;
+	frame.avg_val		= slot.slot->avg_val;
+	frame.flags			= slot.slot->flags;
+
+	memcpy(frame.pixels.data(), slot.pixels, pixels * sizeof(uint16_t));
+
+	return isValid(slot);
+}
+
+
+bool RingReader::readLatest(ring::Kind kind, Frame & frame) const
+{
+	// The writer can lap the reader, the next latest one is worth a try then
+	for (int attempt = 0; attempt < 3; attempt++)
+	{
+		uint64_t written = getWritten(kind);
+
+		if (!written)
+			return false;
+
+		if (read(kind, written - 1, frame))
+			return true;
+	}
+
+	return false;
+}
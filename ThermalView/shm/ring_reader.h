@@ -0,0 +1,114 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "shm/frame_ring.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// Reads the frames a ThermalView process shares, see frame_ring.h. It only needs that header and this class,
+// so it can be built into any program on the same host, with nothing else of ThermalView's.
+//
+// Zero copy, in the mapping:
+//
+//   RingReader::View view;
+//
+//   if (reader.view(ring::KIND_CALIBRATED, reader.getWritten(ring::KIND_CALIBRATED) - 1, view))
+//   {
+//       ... use view.slot and view.pixels ...
+//
+//       if (!reader.isValid(view))
+//           ... the writer got to the slot in the meantime, throw away what came out of it ...
+//   }
+//
+// Or with a copy, which is checked already. Neither waits for the writer or makes a system call.
+class RingReader
+{
+public:
+	struct View
+	{
+		const ring::SlotHeader *	slot;
+		const uint16_t *			pixels;		// width * height, row by row
+		uint64_t					version;
+	};
+
+	// The fields of the slot header, see ring::SlotHeader
+	struct Frame
+	{
+		uint64_t				index;
+		uint64_t				seq;
+		int64_t					captured_ns;
+		uint16_t				id;
+		uint16_t				counter;
+		uint16_t				min_val;
+		uint16_t				max_val;
+		uint16_t				avg_val;
+		uint16_t				flags;
+		std::vector<uint16_t>	pixels;		// Only allocated the first time
+	};
+
+private:
+	void *					m_data;
+	size_t					m_size;
+	const ring::Header *	m_header;
+	std::string				m_error;
+
+public:
+	RingReader();
+	~RingReader();
+
+	RingReader(const RingReader &) = delete;
+	RingReader & operator=(const RingReader &) = delete;
+
+	bool open(const std::string & name = ring::DEFAULT_NAME);
+	void close();
+
+	bool isOpen() const;
+	const std::string & getError() const;
+
+	// The writer closed it. Opening it again gets the one the next writer creates.
+	bool isClosed() const;
+
+	uint32_t getWidth() const;
+	uint32_t getHeight() const;
+	uint32_t getSlotCount() const;
+	uint32_t getWriterPid() const;
+
+	// Frames written to the ring so far, the latest one is getWritten() - 1. The slot_count - 1 before it can
+	// still be read, unless the writer is faster than the reader.
+	uint64_t getWritten(ring::Kind kind) const;
+
+	// Starts reading the given write of the ring, gives false if it's not there (yet, or anymore)
+	bool view(ring::Kind kind, uint64_t index, View & view) const;
+
+	// What was read through the view is good, the writer didn't touch the slot since view()
+	bool isValid(const View & view) const;
+
+	// Copies the given write of the ring, or the latest one
+	bool read(ring::Kind kind, uint64_t index, Frame & frame) const;
+	bool readLatest(ring::Kind kind, Frame & frame) const;
+};
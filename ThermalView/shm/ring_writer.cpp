@@ -0,0 +1,256 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "shm/ring_writer.h"
+
+#include <cstring>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "The atomics in the shared memory can't take locks");
+#endif
+
+static const uint32_t WIDTH = 206;
+static const uint32_t HEIGHT = 156;
+
+
+struct RingWriter::Mapping
+{
+	std::string		name;
+	void *			data;
+	size_t			size;
+	ring::Header *	header;
+	uint64_t		calibrated_seq;		// Of the last calibrated frame written
+
+	Mapping() : data(nullptr), size(0), header(nullptr), calibrated_seq(0) {}
+
+	~Mapping()
+	{
+#ifndef _WIN32
+		if (data)
+			munmap(data, size);
+#endif
+	}
+
+	ring::SlotHeader * beginWrite(ring::Kind kind)
+	{
+		uint64_t index = header->written[kind].load(std::memory_order_relaxed);
+		uint8_t * slot = static_cast<uint8_t *>(data) + header->ring_offset[kind] + (index % header->slot_count) * header->slot_size;
+		ring::SlotHeader * slot_header = reinterpret_cast<ring::SlotHeader *>(slot);
+
+		// Odd: readers that started before this leave it alone from now on
+		uint64_t version = slot_header->version.load(std::memory_order_relaxed);
+
+		slot_header->version.store(version + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		slot_header->index = index;
+
+		return slot_header;
+	}
+
+	void endWrite(ring::Kind kind, ring::SlotHeader * slot_header)
+	{
+		slot_header->version.store(slot_header->version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		header->written[kind].store(slot_header->index + 1, std::memory_order_release);
+	}
+};
+
+
+RingWriter::RingWriter()
+{
+}
+
+
+RingWriter::~RingWriter()
+{
+	close();
+}
+
+
+bool RingWriter::open(const std::string & name, size_t slot_count)
+{
+	close();
+
+#ifndef _WIN32
+	auto mapping = std::make_shared<Mapping>();
+
+	size_t header_size = (sizeof(ring::Header) + ring::SLOT_ALIGN - 1) / ring::SLOT_ALIGN * ring::SLOT_ALIGN;
+	size_t slot_size = ring::slotSize(WIDTH, HEIGHT);
+
+	mapping->name = name;
+	mapping->size = header_size + ring::KIND_COUNT * slot_count * slot_size;
+
+	// A new object every time, so readers of an old one never see it change size or layout under them
+	shm_unlink(name.c_str());
+
+	int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+
+	if (fd < 0)
+	{
+		m_error = "Can't create " + name + ": " + strerror(errno);
+		return false;
+	}
+
+	if (ftruncate(fd, mapping->size) != 0)
+	{
+		m_error = "Can't size " + name + ": " + strerror(errno);
+		::close(fd);
+		shm_unlink(name.c_str());
+		return false;
+	}
+
+	mapping->data = mmap(nullptr, mapping->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+
+	if (mapping->data == MAP_FAILED)
+	{
+		m_error = "Can't map " + name + ": " + strerror(errno);
+		mapping->data = nullptr;
+		return false;
+	}
+
+	// It comes zeroed, so the versions and the counts start at 0. The magic goes last, it says the rest is there.
+	ring::Header * header = static_cast<ring::Header *>(mapping->data);
+
+	header->version		= ring::VERSION;
+	header->header_size	= sizeof(ring::Header);
+	header->width		= WIDTH;
+	header->height		= HEIGHT;
+	header->slot_count	= static_cast<uint32_t>(slot_count);
+	header->slot_size	= static_cast<uint32_t>(slot_size);
+	header->start_time	= std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	header->writer_pid	= static_cast<uint32_t>(getpid());
+
+	for (int kind = 0; kind < ring::KIND_COUNT; kind++)
+		header->ring_offset[kind] = header_size + kind * slot_count * slot_size;
+
+	header->open.store(1, std::memory_order_relaxed);
+
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(header->magic, ring::MAGIC, sizeof(ring::MAGIC));
+
+	mapping->header = header;
+
+	std::atomic_store(&m_mapping, mapping);
+	m_error.clear();
+
+	return true;
+#else
+	m_error = "frames are only shared where there's POSIX shared memory";
+	return false;
+#endif
+}
+
+
+void RingWriter::close()
+{
+	// Unmapped when the last write going on lets go of it
+	std::shared_ptr<Mapping> mapping = std::atomic_exchange(&m_mapping, std::shared_ptr<Mapping>());
+
+	if (!mapping)
+		return;
+
+#ifndef _WIN32
+	// Readers keep what they mapped, the name is free for the next writer
+	mapping->header->open.store(0, std::memory_order_release);
+	shm_unlink(mapping->name.c_str());
+#endif
+}
+
+
+bool RingWriter::isOpen() const
+{
+	return !!std::atomic_load(&m_mapping);
+}
+
+
+const std::string & RingWriter::getError() const
+{
+	return m_error;
+}
+
+
+void RingWriter::writeRaw(const std::vector<uint16_t> & data, uint64_t seq, std::chrono::steady_clock::time_point captured)
+{
+	std::shared_ptr<Mapping> mapping = std::atomic_load(&m_mapping);
+
+	if (!mapping || data.size() != WIDTH * HEIGHT)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_write_mutex[ring::KIND_RAW]);
+
+	ring::SlotHeader * slot = mapping->beginWrite(ring::KIND_RAW);
+
+	slot->seq			= seq;
+	slot->captured_ns	= captured == std::chrono::steady_clock::time_point() ? 0 :
+		std::chrono::duration_cast<std::chrono::nanoseconds>(captured.time_since_epoch()).count();
+	slot->id			= static_cast<uint8_t>(data[10]);
+	slot->counter		= data[1];
+	slot->min_val		= 0;
+	slot->max_val		= 0;
+	slot->avg_val		= 0;
+	slot->flags			= 0;
+
+	memcpy(reinterpret_cast<uint16_t *>(slot + 1), data.data(), data.size() * sizeof(uint16_t));
+
+	mapping->endWrite(ring::KIND_RAW, slot);
+}
+
+
+void RingWriter::writeCalibrated(const ThermalFrame & frame, bool extra_cal)
+{
+	std::shared_ptr<Mapping> mapping = std::atomic_load(&m_mapping);
+
+	if (!mapping || frame.m_pixels.size() != WIDTH * HEIGHT)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_write_mutex[ring::KIND_CALIBRATED]);
+
+	if (frame.m_seq <= mapping->calibrated_seq)
+		return;
+
+	mapping->calibrated_seq = frame.m_seq;
+
+	ring::SlotHeader * slot = mapping->beginWrite(ring::KIND_CALIBRATED);
+
+	slot->seq			= frame.m_seq;
+	slot->captured_ns	= frame.m_captured == std::chrono::steady_clock::time_point() ? 0 :
+		std::chrono::duration_cast<std::chrono::nanoseconds>(frame.m_captured.time_since_epoch()).count();
+	slot->id			= frame.m_id;
+	slot->counter		= frame.m_counter;
+	slot->min_val		= frame.m_min_val;
+	slot->max_val		= frame.m_max_val;
+	slot->avg_val		= frame.m_avg_val;
+	slot->flags			= extra_cal ? ring::FLAG_EXTRA_CAL : 0;
+
+	memcpy(reinterpret_cast<uint16_t *>(slot + 1), frame.m_pixels.data(), frame.m_pixels.size() * sizeof(uint16_t));
+
+	mapping->endWrite(ring::KIND_CALIBRATED, slot);
+}
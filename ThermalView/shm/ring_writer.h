@@ -0,0 +1,72 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "shm/frame_ring.h"
+#include "frame.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+// Shares the frames with other processes, through the rings of frame_ring.h. RingReader reads them.
+//
+// The writes never wait for a reader. A ring's writes take turns with each other, which only matters for the
+// calibrated one: the dialog's re-renders come from the UI thread. Works where there's POSIX shared memory.
+class RingWriter
+{
+private:
+	struct Mapping;
+
+	// Shared between threads, only accessed through std::atomic_load / std::atomic_store
+	std::shared_ptr<Mapping>	m_mapping;
+
+	std::mutex					m_write_mutex[ring::KIND_COUNT];
+	std::string					m_error;
+
+public:
+	RingWriter();
+	~RingWriter();
+
+	RingWriter(const RingWriter &) = delete;
+	RingWriter & operator=(const RingWriter &) = delete;
+
+	// Creates the shared memory object, replacing one left by a writer that's gone. Readers that still have the
+	// old one see it closed.
+	bool open(const std::string & name = ring::DEFAULT_NAME, size_t slot_count = 8);
+	void close();
+
+	bool isOpen() const;
+	const std::string & getError() const;
+
+	// A frame as it came from the camera
+	void writeRaw(const std::vector<uint16_t> & data, uint64_t seq, std::chrono::steady_clock::time_point captured);
+
+	// A calibrated frame. Anything not newer than the last one is skipped, readers see every frame once.
+	void writeCalibrated(const ThermalFrame & frame, bool extra_cal);
+};
@@ -0,0 +1,250 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "stage_timing.h"
+
+#include <fstream>
+#include <iomanip>
+
+
+FrameTimes FrameTimes::arrived()
+{
+	FrameTimes times;
+
+	times.received = times.unpacked = TimingClock::now();
+
+	return times;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+/// LatencyHistogram
+//////////////////////////////////////////////////////////////////////////////
+LatencyHistogram::LatencyHistogram()
+	: m_count(0),
+	m_sum_ns(0),
+	m_max_ns(0)
+{
+	for (auto & bucket : m_buckets)
+		bucket.store(0, std::memory_order_relaxed);
+}
+
+
+void LatencyHistogram::record(TimingClock::duration duration)
+{
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+	uint64_t value = ns > 0 ? static_cast<uint64_t>(ns) : 0;
+
+	// There's only one writer, so there's no need for the locked read-modify-write instructions
+	std::atomic<uint64_t> & bucket = m_buckets[bucketOf(value)];
+
+	bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	m_sum_ns.store(m_sum_ns.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+
+	if (value > m_max_ns.load(std::memory_order_relaxed))
+		m_max_ns.store(value, std::memory_order_relaxed);
+
+	m_count.store(m_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+
+void LatencyHistogram::reset()
+{
+	for (auto & bucket : m_buckets)
+		bucket.store(0, std::memory_order_relaxed);
+
+	m_count.store(0, std::memory_order_relaxed);
+	m_sum_ns.store(0, std::memory_order_relaxed);
+	m_max_ns.store(0, std::memory_order_relaxed);
+}
+
+
+LatencyHistogram::Summary LatencyHistogram::getSummary() const
+{
+	Summary summary;
+
+	// Read while it's being recorded into, so the buckets may be a frame ahead of the count
+	summary.count = m_count.load(std::memory_order_relaxed);
+
+	uint64_t max_ns = m_max_ns.load(std::memory_order_relaxed);
+
+	summary.mean_us	= summary.count ? m_sum_ns.load(std::memory_order_relaxed) / 1e3 / summary.count : 0;
+	summary.p50_us	= percentile(0.5, summary.count, max_ns);
+	summary.p99_us	= percentile(0.99, summary.count, max_ns);
+	summary.max_us	= max_ns / 1e3;
+
+	return summary;
+}
+
+
+uint64_t LatencyHistogram::getBucket(unsigned bucket) const
+{
+	return bucket < BUCKETS ? m_buckets[bucket].load(std::memory_order_relaxed) : 0;
+}
+
+
+uint64_t LatencyHistogram::getBucketLow(unsigned bucket)
+{
+	if (bucket < SUB)
+		return bucket;
+
+	unsigned group = bucket / SUB;
+
+	return static_cast<uint64_t>(SUB + bucket % SUB) << (group - 1);
+}
+
+
+uint64_t LatencyHistogram::getBucketHigh(unsigned bucket)
+{
+	if (bucket < SUB)
+		return bucket + 1;
+
+	return getBucketLow(bucket) + (static_cast<uint64_t>(1) << (bucket / SUB - 1));
+}
+
+
+unsigned LatencyHistogram::bucketOf(uint64_t ns)
+{
+	if (ns < SUB)
+		return static_cast<unsigned>(ns);
+
+	// Position of the highest bit, without relying on compiler intrinsics
+	unsigned msb = 0;
+	uint64_t v = ns;
+
+	if (v >> 32) { v >>= 32; msb += 32; }
+	if (v >> 16) { v >>= 16; msb += 16; }
+	if (v >> 8) { v >>= 8; msb += 8; }
+	if (v >> 4) { v >>= 4; msb += 4; }
+	if (v >> 2) { v >>= 2; msb += 2; }
+	if (v >> 1) { msb += 1; }
+
+	// The highest bit picks the group, the next SUB_BITS bits the bucket within it
+	unsigned bucket = (msb - SUB_BITS + 1) * SUB + static_cast<unsigned>((ns >> (msb - SUB_BITS)) & (SUB - 1));
+
+	return bucket < BUCKETS ? bucket : BUCKETS - 1;
+}
+
+
+double LatencyHistogram::percentile(double fraction, uint64_t count, uint64_t max_ns) const
+{
+	if (!count)
+		return 0;
+
+	uint64_t target = static_cast<uint64_t>(fraction * (count - 1)) + 1;
+	uint64_t seen = 0;
+
+	for (unsigned i = 0; i < BUCKETS; i++)
+	{
+		seen += m_buckets[i].load(std::memory_order_relaxed);
+
+		if (seen >= target)
+		{
+			// The middle of the bucket, but never past the longest one seen
+			uint64_t mid = (getBucketLow(i) + getBucketHigh(i)) / 2;
+
+			return (mid < max_ns ? mid : max_ns) / 1e3;
+		}
+	}
+
+	return max_ns / 1e3;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+/// StageTimings
+//////////////////////////////////////////////////////////////////////////////
+const char * StageTimings::getName(Stage stage)
+{
+	switch (stage)
+	{
+	case STAGE_UNPACK:		return "Unpack";
+	case STAGE_CALIBRATE:	return "Calibrate";
+	case STAGE_COLORIZE:	return "Colorize";
+	case STAGE_PAINT:		return "Paint";
+	case STAGE_TOTAL:		return "Total";
+	case STAGE_ALARM:		return "Alarm";
+	default:				return "";
+	}
+}
+
+
+void StageTimings::record(Stage stage, TimingClock::time_point from, TimingClock::time_point to)
+{
+	if (from == TimingClock::time_point() || to == TimingClock::time_point())
+		return;
+
+	m_stages[stage].record(to - from);
+}
+
+
+const LatencyHistogram & StageTimings::get(Stage stage) const
+{
+	return m_stages[stage];
+}
+
+
+void StageTimings::write(std::ostream & out) const
+{
+	out << std::left << std::setw(10) << "stage" << std::right << std::setw(11) << "frames" << std::setw(11) << "mean_us"
+		<< std::setw(11) << "p50_us" << std::setw(11) << "p99_us" << std::setw(11) << "max_us" << "\n";
+
+	out << std::fixed << std::setprecision(1);
+
+	for (int i = 0; i < STAGE_COUNT; i++)
+	{
+		auto summary = m_stages[i].getSummary();
+
+		out << std::left << std::setw(10) << getName(static_cast<Stage>(i)) << std::right << std::setw(11) << summary.count
+			<< std::setw(11) << summary.mean_us << std::setw(11) << summary.p50_us << std::setw(11) << summary.p99_us
+			<< std::setw(11) << summary.max_us << "\n";
+	}
+
+	out << std::setprecision(3);
+
+	for (int i = 0; i < STAGE_COUNT; i++)
+	{
+		out << "\n" << getName(static_cast<Stage>(i)) << " buckets (us_from us_to frames)\n";
+
+		for (unsigned b = 0; b < LatencyHistogram::BUCKETS; b++)
+		{
+			uint64_t count = m_stages[i].getBucket(b);
+
+			if (count)
+				out << LatencyHistogram::getBucketLow(b) / 1e3 << " " << LatencyHistogram::getBucketHigh(b) / 1e3 << " " << count << "\n";
+		}
+	}
+}
+
+
+bool StageTimings::dump(const std::string & file) const
+{
+	std::ofstream out(file.c_str());
+
+	if (!out)
+		return false;
+
+	write(out);
+
+	return static_cast<bool>(out);
+}
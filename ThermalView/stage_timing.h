@@ -0,0 +1,128 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+
+typedef std::chrono::steady_clock TimingClock;
+
+
+// When a camera frame went past each point on its way to the screen. Left at the epoch for the points it
+// didn't go through, like a re-rendered frame that never came off the bus.
+struct FrameTimes
+{
+	TimingClock::time_point		received;		// The USB transfer completed
+	TimingClock::time_point		unpacked;		// The transfer was turned into a frame
+	TimingClock::time_point		calibrated;
+	TimingClock::time_point		colorized;
+
+	// For frames that don't come from a camera, they arrive already unpacked
+	static FrameTimes arrived();
+};
+
+
+// Log-scale histogram of durations, 4 buckets per power of two (within 19%). Each histogram has one thread
+// recording into it, so recording is a few relaxed loads and stores; any thread can read it meanwhile.
+class LatencyHistogram
+{
+public:
+	struct Summary
+	{
+		uint64_t	count;
+		double		mean_us;
+		double		p50_us;
+		double		p99_us;
+		double		max_us;
+	};
+
+	static const unsigned SUB_BITS	= 2;
+	static const unsigned SUB		= 1 << SUB_BITS;
+	static const unsigned BUCKETS	= (40 - SUB_BITS + 1) * SUB + SUB;		// Up to 2^40 ns, about 18 minutes
+
+private:
+	std::atomic<uint64_t>	m_buckets[BUCKETS];
+	std::atomic<uint64_t>	m_count;
+	std::atomic<uint64_t>	m_sum_ns;
+	std::atomic<uint64_t>	m_max_ns;
+
+public:
+	LatencyHistogram();
+
+	LatencyHistogram(const LatencyHistogram &) = delete;
+	LatencyHistogram & operator=(const LatencyHistogram &) = delete;
+
+	// From the one thread that owns the histogram
+	void record(TimingClock::duration duration);
+
+	// Only while nothing records into it
+	void reset();
+
+	Summary getSummary() const;
+	uint64_t getBucket(unsigned bucket) const;
+
+	// The range of durations that end up in a bucket, in ns
+	static uint64_t getBucketLow(unsigned bucket);
+	static uint64_t getBucketHigh(unsigned bucket);
+
+private:
+	static unsigned bucketOf(uint64_t ns);
+	double percentile(double fraction, uint64_t count, uint64_t max_ns) const;
+};
+
+
+// How long the frames take between the points of FrameTimes, and from the bus to the screen and to the alarms
+class StageTimings
+{
+public:
+	enum Stage
+	{
+		STAGE_UNPACK,			// received -> unpacked
+		STAGE_CALIBRATE,		// unpacked -> calibrated, including the wait for the calibration thread
+		STAGE_COLORIZE,			// calibrated -> colorized, including the analysis
+		STAGE_PAINT,			// colorized -> on screen
+		STAGE_TOTAL,			// received -> on screen
+		STAGE_ALARM,			// received -> a highlight alarm raised for the frame
+		STAGE_COUNT
+	};
+
+private:
+	LatencyHistogram	m_stages[STAGE_COUNT];
+
+public:
+	static const char * getName(Stage stage);
+
+	// Each stage has to be recorded from one thread. Points that weren't stamped are skipped.
+	void record(Stage stage, TimingClock::time_point from, TimingClock::time_point to);
+
+	const LatencyHistogram & get(Stage stage) const;
+
+	// A summary line for each stage followed by the non-empty buckets, as text
+	void write(std::ostream & out) const;
+	bool dump(const std::string & file) const;
+};
@@ -0,0 +1,145 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Frame stages: custom processing that runs on every calibrated frame, after the bad pixels are fixed and before
+// the histogram and the colors, so whatever a stage changes is what gets displayed and counted. A stage sees the
+// frame through views into the pipeline's own buffers, so nothing is copied for it, and gets scratch space the
+// pipeline keeps from frame to frame, so it doesn't have to allocate either.
+//
+// Stages are registered with StageRegistry, in code or from a shared object, and put together at run time with
+// StageChain. This header is all a shared object needs, it doesn't link against anything of ThermalView's:
+//
+//   class MyStage : public FrameStage { ... };
+//
+//   static FrameStage * createMyStage(const char * args) { return new MyStage(args); }
+//
+//   static const FrameStageInfo stages[] = { { "my-stage", createMyStage } };
+//
+//   THERMALVIEW_STAGE_EXPORT const FrameStageInfo * thermalview_stages(int api, size_t * count)
+//   {
+//       *count = sizeof(stages) / sizeof(stages[0]);
+//       return api == THERMALVIEW_STAGE_API ? stages : nullptr;
+//   }
+//
+// The shared object has to be built with the same compiler as ThermalView, the stages are C++ objects.
+
+// Changes whenever anything in here does, a shared object built against another version isn't loaded
+#define THERMALVIEW_STAGE_API	1
+
+#ifdef _WIN32
+#define THERMALVIEW_STAGE_EXPORT	extern "C" __declspec(dllexport)
+#else
+#define THERMALVIEW_STAGE_EXPORT	extern "C" __attribute__((visibility("default")))
+#endif
+
+
+// A run of T owned by someone else
+template <typename T>
+class Span
+{
+private:
+	T *		m_data;
+	size_t	m_size;
+
+public:
+	Span() : m_data(nullptr), m_size(0) {}
+	Span(T * data, size_t size) : m_data(data), m_size(size) {}
+
+	T * data() const		{ return m_data; }
+	size_t size() const		{ return m_size; }
+	bool empty() const		{ return m_size == 0; }
+
+	T * begin() const		{ return m_data; }
+	T * end() const			{ return m_data + m_size; }
+
+	T & operator[](size_t i) const	{ return m_data[i]; }
+
+	// The same memory as a run of U, for scratch space. It's aligned for anything up to 8 bytes.
+	template <typename U>
+	Span<U> as() const		{ return Span<U>(reinterpret_cast<U *>(m_data), m_size * sizeof(T) / sizeof(U)); }
+};
+
+
+// What's known about the frame besides its pixels
+struct FrameMetadata
+{
+	uint64_t	seq;			// Sequence number of the camera frame
+	uint16_t	counter;		// The camera's own frame counter
+	int64_t		captured_ns;	// When its USB transfer completed, on the steady clock, 0 if unknown
+
+	// Before the stages ran, they're computed again after the last one
+	uint16_t	min_val;
+	uint16_t	max_val;
+	uint16_t	avg_val;
+};
+
+
+// A calibrated frame, as a stage sees it
+struct FrameView
+{
+	static const size_t WIDTH = 206;
+	static const size_t HEIGHT = 156;
+
+	Span<uint16_t>			pixels;			// Row by row, pixels[y * WIDTH + x]. Stages can change them in place.
+	Span<const bool>		bad_pixels;		// Column by column, bad_pixels[x * HEIGHT + y]. Fixed in pixels before
+											// the first stage and again after the last one.
+	const FrameMetadata *	meta;
+
+	uint16_t & at(size_t x, size_t y) const	{ return pixels[y * WIDTH + x]; }
+	bool isBad(size_t x, size_t y) const	{ return bad_pixels[x * HEIGHT + y]; }
+};
+
+
+class FrameStage
+{
+public:
+	virtual ~FrameStage() {}
+
+	virtual const char * getName() const = 0;
+
+	// The scratch space process() gets, in bytes. Asked once, when the stage is put in a chain.
+	virtual size_t getScratchSize() const { return 0; }
+
+	// Called for every frame, from one thread, in frame order. The scratch space holds whatever the last call
+	// left in it. Returning false drops the frame, it's not displayed and the stages after this one don't see it.
+	virtual bool process(const FrameView & frame, Span<uint8_t> scratch) = 0;
+};
+
+
+// A stage a shared object provides. create() gets the arguments the stage was given, an empty string if none, and
+// gives null if they're no good. The stage is deleted by ThermalView, through its virtual destructor.
+struct FrameStageInfo
+{
+	const char *	name;
+	FrameStage *	(*create)(const char * args);
+};
+
+// What a shared object exports, under THERMALVIEW_STAGE_ENTRY: its stages, when built for the given API version
+extern "C" typedef const FrameStageInfo * (*FrameStageEntry)(int api, size_t * count);
+
+#define THERMALVIEW_STAGE_ENTRY	"thermalview_stages"
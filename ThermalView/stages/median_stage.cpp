@@ -0,0 +1,72 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "stages/median_stage.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+const char * MedianStage::getName() const
+{
+	return "median";
+}
+
+
+size_t MedianStage::getScratchSize() const
+{
+	// A copy of the frame, to read the neighbours from while the pixels are overwritten
+	return FrameView::WIDTH * FrameView::HEIGHT * sizeof(uint16_t);
+}
+
+
+bool MedianStage::process(const FrameView & frame, Span<uint8_t> scratch)
+{
+	Span<uint16_t> source = scratch.as<uint16_t>();
+
+	memcpy(source.data(), frame.pixels.data(), frame.pixels.size() * sizeof(uint16_t));
+
+	const int width = static_cast<int>(FrameView::WIDTH);
+	const int height = static_cast<int>(FrameView::HEIGHT);
+
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			uint16_t window[9];
+			int count = 0;
+
+			for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, height - 1); ++ny)
+			{
+				for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, width - 1); ++nx)
+					window[count++] = source[ny * width + nx];
+			}
+
+			std::nth_element(window, window + count / 2, window + count);
+
+			frame.pixels[y * width + x] = window[count / 2];
+		}
+	}
+
+	return true;
+}
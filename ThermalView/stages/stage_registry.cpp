@@ -0,0 +1,295 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "stages/stage_registry.h"
+#include "stages/median_stage.h"
+#include "frame.h"
+#include "trace.h"
+
+#include <array>
+#include <boost/filesystem.hpp>
+#include <map>
+#include <mutex>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+namespace fs = boost::filesystem;
+
+static_assert(sizeof(std::array<std::array<bool, FrameView::HEIGHT>, FrameView::WIDTH>) == FrameView::WIDTH * FrameView::HEIGHT,
+	"The bad pixels have to be contiguous to be seen as a span");
+
+
+//////////////////////////////////////////////////////////////////////////
+/// StageRegistry
+//////////////////////////////////////////////////////////////////////////
+namespace
+{
+	struct Registry
+	{
+		std::mutex							mutex;
+		std::map<std::string, StageRegistry::Factory>	factories;
+
+		Registry()
+		{
+			factories["median"] = [](const std::string & args) -> std::unique_ptr<FrameStage>
+			{
+				return args.empty() ? std::unique_ptr<FrameStage>(new MedianStage()) : nullptr;
+			};
+		}
+	};
+
+	Registry & getRegistry()
+	{
+		static Registry registry;
+		return registry;
+	}
+}
+
+
+void StageRegistry::add(const std::string & name, const Factory & factory)
+{
+	Registry & registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	registry.factories[name] = factory;
+}
+
+
+bool StageRegistry::load(const std::string & file, std::string & error)
+{
+	// Never unloaded, the stages' code and vtables live in there
+#ifdef _WIN32
+	HMODULE library = LoadLibraryA(file.c_str());
+
+	if (!library)
+	{
+		error = file + ": can't load it (error " + std::to_string(GetLastError()) + ")";
+		return false;
+	}
+
+	FrameStageEntry entry = reinterpret_cast<FrameStageEntry>(GetProcAddress(library, THERMALVIEW_STAGE_ENTRY));
+#else
+	void * library = dlopen(file.c_str(), RTLD_NOW | RTLD_LOCAL);
+
+	if (!library)
+	{
+		error = dlerror();
+		return false;
+	}
+
+	FrameStageEntry entry = reinterpret_cast<FrameStageEntry>(dlsym(library, THERMALVIEW_STAGE_ENTRY));
+#endif
+
+	if (!entry)
+	{
+		error = file + ": no " THERMALVIEW_STAGE_ENTRY " in it";
+		return false;
+	}
+
+	size_t count = 0;
+	const FrameStageInfo * stages = entry(THERMALVIEW_STAGE_API, &count);
+
+	if (!stages)
+	{
+		error = file + ": built for another version of ThermalView";
+		return false;
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		auto create = stages[i].create;
+
+		add(stages[i].name, [create](const std::string & args)
+		{
+			return std::unique_ptr<FrameStage>(create(args.c_str()));
+		});
+	}
+
+	return true;
+}
+
+
+size_t StageRegistry::loadDirectory(const std::string & dir, std::string & errors)
+{
+#if defined(_WIN32)
+	const char * extension = ".dll";
+#elif defined(__APPLE__)
+	const char * extension = ".dylib";
+#else
+	const char * extension = ".so";
+#endif
+
+	size_t loaded = 0;
+	boost::system::error_code ec;
+
+	if (!fs::is_directory(dir, ec))
+		return 0;
+
+	for (auto & file : fs::directory_iterator(dir))
+	{
+		if (!fs::is_regular_file(file) || file.path().extension() != extension)
+			continue;
+
+		std::string error;
+
+		if (load(file.path().string(), error))
+			loaded++;
+		else
+			errors += error + "\n";
+	}
+
+	return loaded;
+}
+
+
+std::unique_ptr<FrameStage> StageRegistry::create(const std::string & name, const std::string & args, std::string & error)
+{
+	Factory factory;
+
+	{
+		Registry & registry = getRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+
+		auto it = registry.factories.find(name);
+
+		if (it == registry.factories.end())
+		{
+			error = "No stage called " + name;
+			return nullptr;
+		}
+
+		factory = it->second;
+	}
+
+	std::unique_ptr<FrameStage> stage = factory(args);
+
+	if (!stage)
+		error = "Bad arguments for " + name + ": " + args;
+
+	return stage;
+}
+
+
+std::vector<std::string> StageRegistry::getNames()
+{
+	Registry & registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	std::vector<std::string> names;
+
+	for (auto & factory : registry.factories)
+		names.push_back(factory.first);
+
+	return names;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// StageChain
+//////////////////////////////////////////////////////////////////////////
+void StageChain::add(std::unique_ptr<FrameStage> stage)
+{
+	Slot slot;
+
+	// Allocated once, here, process() hands the same space to the stage on every frame
+	slot.scratch_size = stage->getScratchSize();
+	slot.scratch.resize((slot.scratch_size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+	slot.stage = std::move(stage);
+
+	m_stages.push_back(std::move(slot));
+}
+
+
+bool StageChain::add(const std::string & spec, std::string & error)
+{
+	size_t colon = spec.find(':');
+	std::string name = spec.substr(0, colon);
+	std::string args = colon == std::string::npos ? std::string() : spec.substr(colon + 1);
+
+	std::unique_ptr<FrameStage> stage = StageRegistry::create(name, args, error);
+
+	if (!stage)
+		return false;
+
+	add(std::move(stage));
+
+	return true;
+}
+
+
+bool StageChain::empty() const
+{
+	return m_stages.empty();
+}
+
+
+std::vector<std::string> StageChain::getNames() const
+{
+	std::vector<std::string> names;
+
+	for (auto & slot : m_stages)
+		names.push_back(slot.stage->getName());
+
+	return names;
+}
+
+
+bool StageChain::process(ThermalFrame & frame)
+{
+	TRACE_SCOPE("Stages");
+
+	if (frame.m_pixels.size() != FrameView::WIDTH * FrameView::HEIGHT)
+		return true;
+
+	FrameMetadata meta;
+
+	meta.seq			= frame.m_seq;
+	meta.counter		= frame.m_counter;
+	meta.captured_ns	= frame.m_captured == std::chrono::steady_clock::time_point() ? 0 :
+		std::chrono::duration_cast<std::chrono::nanoseconds>(frame.m_captured.time_since_epoch()).count();
+	meta.min_val		= frame.m_min_val;
+	meta.max_val		= frame.m_max_val;
+	meta.avg_val		= frame.m_avg_val;
+
+	FrameView view;
+
+	view.pixels		= Span<uint16_t>(frame.m_pixels.data(), frame.m_pixels.size());
+	view.bad_pixels	= Span<const bool>(frame.m_bad_pixels[0].data(), FrameView::WIDTH * FrameView::HEIGHT);
+	view.meta		= &meta;
+
+	for (auto & slot : m_stages)
+	{
+		if (!slot.stage->process(view, Span<uint8_t>(reinterpret_cast<uint8_t *>(slot.scratch.data()), slot.scratch_size)))
+			return false;
+	}
+
+	// As calibrate() leaves it: the range of the good pixels, and the bad ones within it
+	frame.computeMinMax();
+	frame.fixBadPixels();
+
+	return true;
+}
@@ -0,0 +1,89 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "stages/frame_stage.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class ThermalFrame;
+
+
+// The stages that can be put in a chain, by name. The built in ones are always there, the rest are registered by
+// the program or loaded from shared objects. Can be used from any thread.
+class StageRegistry
+{
+public:
+	// Makes a stage from its arguments, null if they're no good
+	typedef std::function<std::unique_ptr<FrameStage>(const std::string & args)> Factory;
+
+	// Replaces any stage registered under the same name
+	static void add(const std::string & name, const Factory & factory);
+
+	// Registers the stages of a shared object. It stays loaded until the program exits.
+	static bool load(const std::string & file, std::string & error);
+
+	// Loads every shared object in the directory, gives how many. The errors are one per line.
+	static size_t loadDirectory(const std::string & dir, std::string & errors);
+
+	static std::unique_ptr<FrameStage> create(const std::string & name, const std::string & args, std::string & error);
+
+	static std::vector<std::string> getNames();
+};
+
+
+// Stages run one after the other on a frame, each with scratch space of its own. Only used from one thread at a
+// time, the pipeline replaces a chain as a whole rather than changing the one it's running.
+class StageChain
+{
+private:
+	struct Slot
+	{
+		std::unique_ptr<FrameStage>	stage;
+		std::vector<uint64_t>		scratch;		// uint64_t, to keep it aligned
+		size_t						scratch_size;	// In bytes
+	};
+
+	std::vector<Slot>	m_stages;
+
+public:
+	StageChain() {}
+
+	StageChain(const StageChain &) = delete;
+	StageChain & operator=(const StageChain &) = delete;
+
+	void add(std::unique_ptr<FrameStage> stage);
+
+	// Adds a registered stage, given as NAME or NAME:ARGS
+	bool add(const std::string & spec, std::string & error);
+
+	bool empty() const;
+	std::vector<std::string> getNames() const;
+
+	// Runs the stages on the frame in place, gives false if one of them dropped it
+	bool process(ThermalFrame & frame);
+};
@@ -0,0 +1,225 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "tests/test.h"
+#include "recording/codec.h"
+
+#include <algorithm>
+#include <random>
+
+
+static const int WIDTH = 206;
+static const int HEIGHT = 156;
+
+
+// Something like a camera frame: a smooth scene with a little noise
+static std::vector<uint16_t> sceneFrame(unsigned seed)
+{
+	std::mt19937 rng(seed);
+	std::normal_distribution<double> noise(0, 20);
+	std::vector<uint16_t> frame(WIDTH * HEIGHT);
+
+	for (int y = 0; y < HEIGHT; ++y)
+	{
+		for (int x = 0; x < WIDTH; ++x)
+			frame[y * WIDTH + x] = static_cast<uint16_t>(std::max(0.0, 8000 + 30 * x + 10 * y + noise(rng)));
+	}
+
+	return frame;
+}
+
+
+// The worst case for the predictors, with the extremes in it
+static std::vector<uint16_t> noiseFrame(unsigned seed)
+{
+	std::mt19937 rng(seed);
+	std::vector<uint16_t> frame(WIDTH * HEIGHT);
+
+	for (auto & v : frame)
+		v = static_cast<uint16_t>(rng());
+
+	frame[0] = 0;
+	frame[1] = 0xffff;
+	frame[WIDTH] = 0xffff;
+	frame[WIDTH + 1] = 0;
+
+	return frame;
+}
+
+
+static bool roundTrip(const std::vector<uint16_t> & frame, const std::vector<uint16_t> * previous, int width, int height, int slices)
+{
+	const uint16_t * prev = previous ? previous->data() : nullptr;
+
+	std::vector<uint8_t> encoded;
+	std::vector<uint8_t> encoded_parallel;
+	std::vector<uint16_t> decoded;
+	std::vector<uint16_t> decoded_parallel;
+
+	FrameCodec::encode(frame.data(), width, height, prev, encoded, slices);
+	FrameCodec::encode(frame.data(), width, height, prev, encoded_parallel, slices, true);
+
+	return encoded == encoded_parallel &&
+		FrameCodec::decode(encoded.data(), encoded.size(), prev, decoded) && decoded == frame &&
+		FrameCodec::decode(encoded.data(), encoded.size(), prev, decoded_parallel, true) && decoded_parallel == frame;
+}
+
+
+TEST(codec_round_trip)
+{
+	std::vector<uint16_t> scene = sceneFrame(1);
+	std::vector<uint16_t> noise = noiseFrame(2);
+
+	CHECK(roundTrip(scene, nullptr, WIDTH, HEIGHT, 4));
+	CHECK(roundTrip(noise, nullptr, WIDTH, HEIGHT, 4));
+
+	for (int slices : { 1, 2, 3, 7, 255 })
+		CHECK(roundTrip(scene, nullptr, WIDTH, HEIGHT, slices));
+
+	// More slices than rows
+	std::vector<uint16_t> strip(scene.begin(), scene.begin() + WIDTH * 3);
+
+	CHECK(roundTrip(strip, nullptr, WIDTH, 3, 8));
+
+	std::vector<uint16_t> constant(WIDTH * HEIGHT, 1234);
+
+	CHECK(roundTrip(constant, nullptr, WIDTH, HEIGHT, 4));
+
+	// Smooth frames compress, noise doesn't grow much
+	std::vector<uint8_t> encoded;
+
+	FrameCodec::encode(scene.data(), WIDTH, HEIGHT, nullptr, encoded);
+	CHECK(encoded.size() < scene.size() * sizeof(uint16_t) / 2);
+
+	FrameCodec::encode(noise.data(), WIDTH, HEIGHT, nullptr, encoded);
+	CHECK(encoded.size() < noise.size() * sizeof(uint16_t) * 11 / 10);
+}
+
+
+TEST(codec_delta)
+{
+	std::vector<uint16_t> previous = sceneFrame(3);
+	std::vector<uint16_t> frame = previous;
+
+	// A few pixels changed, the rest is the same
+	for (size_t i = 0; i < frame.size(); i += 97)
+		frame[i] += 5;
+
+	CHECK(roundTrip(frame, &previous, WIDTH, HEIGHT, 4));
+
+	std::vector<uint8_t> encoded;
+	FrameCodec::Header header;
+
+	FrameCodec::encode(frame.data(), WIDTH, HEIGHT, previous.data(), encoded);
+
+	REQUIRE(FrameCodec::readHeader(encoded.data(), encoded.size(), header));
+	CHECK(header.width == WIDTH && header.height == HEIGHT && header.delta);
+
+	// It can't be decoded without the frame it was predicted from
+	std::vector<uint16_t> decoded;
+
+	CHECK(!FrameCodec::decode(encoded.data(), encoded.size(), nullptr, decoded));
+
+	// Without a previous frame it's a key frame
+	FrameCodec::encode(frame.data(), WIDTH, HEIGHT, nullptr, encoded);
+
+	REQUIRE(FrameCodec::readHeader(encoded.data(), encoded.size(), header));
+	CHECK(!header.delta);
+	CHECK(FrameCodec::decode(encoded.data(), encoded.size(), nullptr, decoded) && decoded == frame);
+}
+
+
+TEST(codec_corrupt)
+{
+	std::vector<uint16_t> frame = sceneFrame(4);
+	std::vector<uint8_t> encoded;
+	std::vector<uint16_t> decoded;
+
+	FrameCodec::encode(frame.data(), WIDTH, HEIGHT, nullptr, encoded);
+
+	// Cut anywhere, it's refused, and nothing is read past the end
+	for (size_t size = 0; size < encoded.size(); size += (size < 256 ? 1 : 97))
+	{
+		std::vector<uint8_t> cut(encoded.begin(), encoded.begin() + size);
+
+		CHECK(!FrameCodec::decode(cut.data(), cut.size(), nullptr, decoded));
+	}
+
+	// Damaged bits decode to something or are refused, but never read or write out of bounds
+	std::mt19937 rng(5);
+
+	for (int i = 0; i < 200; ++i)
+	{
+		std::vector<uint8_t> damaged = encoded;
+
+		damaged[rng() % damaged.size()] ^= static_cast<uint8_t>(1 << (rng() % 8));
+
+		if (FrameCodec::decode(damaged.data(), damaged.size(), nullptr, decoded))
+		{
+			FrameCodec::Header header;
+
+			CHECK(FrameCodec::readHeader(damaged.data(), damaged.size(), header));
+			CHECK(decoded.size() == static_cast<size_t>(header.width) * header.height);
+		}
+	}
+}
+
+
+TEST(codec_oversized)
+{
+	std::vector<uint16_t> frame = sceneFrame(6);
+	std::vector<uint8_t> encoded;
+	std::vector<uint16_t> decoded;
+
+	FrameCodec::encode(frame.data(), WIDTH, HEIGHT, nullptr, encoded);
+
+	// A header claiming 65535 x 65535 in front of the camera frame, which would take 8 GB
+	std::vector<uint8_t> damaged = encoded;
+
+	damaged[2] = damaged[3] = damaged[4] = damaged[5] = 0xff;
+
+	FrameCodec::Header header;
+
+	CHECK(FrameCodec::readHeader(damaged.data(), damaged.size(), header));
+	CHECK(header.width == 65535 && header.height == 65535);
+	CHECK(!FrameCodec::decode(damaged.data(), damaged.size(), nullptr, decoded));
+	CHECK(decoded.capacity() < 65535u * 65535u);
+
+	// Only the width, or only the height
+	damaged = encoded;
+	damaged[2] = damaged[3] = 0xff;
+
+	CHECK(!FrameCodec::decode(damaged.data(), damaged.size(), nullptr, decoded));
+
+	damaged = encoded;
+	damaged[4] = damaged[5] = 0xff;
+
+	CHECK(!FrameCodec::decode(damaged.data(), damaged.size(), nullptr, decoded));
+
+	// Just the header and the slice sizes, with nothing behind them
+	uint8_t empty[12] = { encoded[0], 0, 0xff, 0xff, 0xff, 0xff, 1, 0, 0, 0, 0, 0 };
+
+	CHECK(!FrameCodec::decode(empty, sizeof(empty), nullptr, decoded));
+
+	CHECK(FrameCodec::decode(encoded.data(), encoded.size(), nullptr, decoded) && decoded == frame);
+}
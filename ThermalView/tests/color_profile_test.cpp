@@ -0,0 +1,164 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "tests/test.h"
+#include "color_profile/gradient.h"
+
+
+TEST(isotherm_bounds)
+{
+	ColorProfile::Isotherm band(9000, 9500, 1, 2, 3, 4);
+
+	CHECK(band.low == 9000 && band.high == 9500);
+	CHECK(band.r == 1 && band.g == 2 && band.b == 3 && band.alpha == 4);
+
+	// Given the other way around, it still covers the same values
+	ColorProfile::Isotherm inverted(9500, 9000, 1, 2, 3);
+
+	CHECK(inverted.low == 9000 && inverted.high == 9500);
+	CHECK(inverted.alpha == 255);
+
+	ColorProfile::Isotherm single(7, 7, 0, 0, 0);
+
+	CHECK(single.low == 7 && single.high == 7);
+}
+
+
+// Black to white, with a red band given the other way around, and a blue one on top of its upper end
+static std::shared_ptr<ColorProfile> bandedProfile(std::shared_ptr<ColorProfile> & plain)
+{
+	GradientProfile::Pattern pattern;
+
+	pattern.push_back(std::make_pair(0.0f, GradientProfile::gpRGB(0, 0, 0)));
+	pattern.push_back(std::make_pair(1.0f, GradientProfile::gpRGB(255, 255, 255)));
+
+	plain = std::make_shared<GradientProfile>("", "Gray", pattern, 256);
+
+	std::shared_ptr<ColorProfile> banded = plain->clone();
+
+	ColorProfile::Isotherms isotherms;
+
+	isotherms.push_back(ColorProfile::Isotherm(1500, 1400, 255, 0, 0));
+	isotherms.push_back(ColorProfile::Isotherm(1490, 1520, 0, 0, 255));
+
+	banded->setIsotherms(isotherms);
+
+	return banded;
+}
+
+
+// The band a value should fall in, the last isotherm that covers it wins
+static uint8_t expectedBand(size_t val)
+{
+	if (val >= 1490 && val <= 1520)
+		return 2;
+
+	if (val >= 1400 && val <= 1500)
+		return 1;
+
+	return 0;
+}
+
+
+TEST(isotherm_lut)
+{
+	std::shared_ptr<ColorProfile> plain;
+	std::shared_ptr<ColorProfile> banded = bandedProfile(plain);
+
+	ThermalFrame frame;
+
+	frame.m_min_val = 1000;
+	frame.m_max_val = 1999;
+
+	ColorProfile::Lut gradient = plain->getLut(frame, 1000, 1999);
+	ColorProfile::Lut lut = banded->getLut(frame, 1000, 1999);
+
+	REQUIRE(lut.first == 1000 && lut.band.size() == 1000 && lut.rgb.size() == 3000);
+	REQUIRE(gradient.first == lut.first && gradient.rgb.size() == lut.rgb.size());
+
+	for (size_t i = 0; i < lut.band.size(); ++i)
+	{
+		uint8_t band = expectedBand(lut.first + i);
+		const uint8_t * rgb = &lut.rgb[i * 3];
+
+		CHECK(lut.band[i] == band);
+
+		if (band == 1)
+			CHECK(rgb[0] == 255 && rgb[1] == 0 && rgb[2] == 0);
+		else if (band == 2)
+			CHECK(rgb[0] == 0 && rgb[1] == 0 && rgb[2] == 255);
+		else
+			CHECK(std::equal(rgb, rgb + 3, &gradient.rgb[i * 3]));
+	}
+
+	// The gradient itself changes over the range, so the values outside the bands were compared to something
+	CHECK(gradient.rgb[0] < gradient.rgb[gradient.rgb.size() - 1]);
+}
+
+
+TEST(isotherm_counts)
+{
+	std::shared_ptr<ColorProfile> plain;
+	std::shared_ptr<ColorProfile> banded = bandedProfile(plain);
+
+	ThermalFrame frame;
+
+	frame.m_min_val = 1000;
+	frame.m_max_val = 1999;
+
+	ColorProfile::Lut lut = banded->getLut(frame, 1000, 1999);
+
+	// The histogram reaches past the table on both ends, those values count like the ends of the table
+	const uint16_t histogram_first = 900;
+
+	std::vector<uint16_t> histogram(1300);
+	std::vector<uint32_t> expected(2, 0);
+
+	for (size_t i = 0; i < histogram.size(); ++i)
+	{
+		histogram[i] = static_cast<uint16_t>((i * 37) % 11);
+
+		size_t val = std::min<size_t>(std::max<size_t>(histogram_first + i, 1000), 1999);
+		uint8_t band = expectedBand(val);
+
+		if (band)
+			expected[band - 1] += histogram[i];
+	}
+
+	std::vector<uint32_t> counts;
+
+	banded->countIsotherms(histogram, histogram_first, lut, counts);
+
+	CHECK(counts == expected);
+
+	// Rendering the pixels the histogram stands for gives the same counts
+	for (size_t i = 0; i < histogram.size(); ++i)
+		frame.m_pixels.insert(frame.m_pixels.end(), histogram[i], static_cast<uint16_t>(histogram_first + i));
+
+	std::vector<uint8_t> rgb(frame.m_pixels.size() * 3);
+	std::vector<uint32_t> rendered;
+
+	banded->render(frame, lut, rgb.data(), &rendered);
+
+	CHECK(rendered == expected);
+}
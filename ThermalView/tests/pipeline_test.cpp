@@ -0,0 +1,78 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "tests/test.h"
+#include "pipeline.h"
+
+#include <atomic>
+#include <thread>
+
+
+TEST(pipeline_try_push)
+{
+	// The stage holds on to the first item until it's let go, so the queue fills up behind it
+	std::atomic<bool> release(false);
+	std::atomic<int> handled(0);
+
+	Pipeline<int> pipeline;
+
+	pipeline.addStage("Hold", [&](int &)
+	{
+		while (!release)
+			std::this_thread::yield();
+
+		++handled;
+		return true;
+	}, 2);
+
+	pipeline.start();
+
+	CHECK(pipeline.push(1));
+
+	// Taken by the stage, the queue is empty again
+	while (pipeline.getStats()[0].queued)
+		std::this_thread::yield();
+
+	CHECK(pipeline.tryPush(2));
+	CHECK(pipeline.tryPush(3));
+	CHECK(!pipeline.tryPush(4));
+	CHECK(!pipeline.tryPush(5));
+
+	auto stats = pipeline.getStats();
+
+	CHECK(stats[0].queued == 2);
+	CHECK(stats[0].skipped == 2);
+
+	release = true;
+
+	pipeline.stop();
+
+	stats = pipeline.getStats();
+
+	CHECK(handled == 3);
+	CHECK(stats[0].processed == 3);
+	CHECK(stats[0].skipped == 2);
+
+	// Not running, nothing is queued
+	CHECK(!pipeline.tryPush(6));
+}
@@ -0,0 +1,393 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "tests/test.h"
+#include "recording/player.h"
+#include "recording/recorder.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+
+using namespace recording;
+
+
+static std::vector<char> readFile(const std::string & file)
+{
+	std::ifstream in(file, std::ios::binary);
+	return std::vector<char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+
+static void writeFile(const std::string & file, const std::vector<char> & data, size_t size)
+{
+	std::ofstream out(file, std::ios::binary | std::ios::trunc);
+	out.write(data.data(), size);
+}
+
+
+// A gain and an offset calibration frame, then regular frames 1 ms apart, enough of them for a few key frames.
+// The frame id is the 11th word, as it comes from the camera.
+static bool recordSample(const std::string & file, std::vector<std::vector<uint16_t>> & frames)
+{
+	static const size_t REGULAR_FRAMES = 40;
+
+	frames.clear();
+
+	for (size_t f = 0; f < REGULAR_FRAMES + 2; ++f)
+	{
+		std::vector<uint16_t> frame(206 * 156);
+
+		for (size_t i = 0; i < frame.size(); ++i)
+			frame[i] = static_cast<uint16_t>(5000 + (i % 206) * 3 + (i / 206) * 2 + f * 11);
+
+		frame[10] = f == 0 ? 4 : f == 1 ? 1 : 3;
+		frames.push_back(frame);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	Recorder recorder;
+
+	if (!recorder.open(file, CODEC_THERMAL, start))
+		return false;
+
+	for (size_t f = 0; f < frames.size(); ++f)
+		recorder.addFrame(frames[f], f + 1, start + std::chrono::milliseconds(f < 2 ? 0 : f - 1), true);
+
+	recorder.close();
+
+	return !recorder.getStats().failed && recorder.getStats().frames_written == frames.size();
+}
+
+
+// Collects what the player delivers
+struct Delivered
+{
+	std::mutex							mx;
+	std::condition_variable				cv;
+	std::vector<std::vector<uint16_t>>	frames;
+	bool								stopped;
+
+	Delivered(Player & player)
+		: stopped(false)
+	{
+		player.onNewFrame.connect([this](const std::vector<uint16_t> & data, const FrameTimes &)
+		{
+			std::lock_guard<std::mutex> lock(mx);
+			frames.push_back(data);
+			cv.notify_all();
+		});
+
+		player.onPlaybackStop.connect([this]
+		{
+			std::lock_guard<std::mutex> lock(mx);
+			stopped = true;
+			cv.notify_all();
+		});
+	}
+
+	bool waitFor(size_t count)
+	{
+		std::unique_lock<std::mutex> lock(mx);
+		return cv.wait_for(lock, std::chrono::seconds(10), [&] { return frames.size() >= count; });
+	}
+
+	bool waitForStop()
+	{
+		std::unique_lock<std::mutex> lock(mx);
+		return cv.wait_for(lock, std::chrono::seconds(10), [&] { return stopped; });
+	}
+};
+
+
+TEST(player_round_trip)
+{
+	std::string file = test::tempPath("round_trip.tvr");
+	std::vector<std::vector<uint16_t>> frames;
+
+	REQUIRE(recordSample(file, frames));
+
+	Player player;
+
+	REQUIRE(player.open(file));
+	REQUIRE(player.getRecordCount() == frames.size());
+	CHECK(player.getDuration() == 40000000);
+
+	// Backwards, so every delta coded record has to go back to its key frame
+	for (size_t i = frames.size(); i-- > 0; )
+	{
+		Player::PData data = player.getRecord(i);
+
+		CHECK(data && *data == frames[i]);
+	}
+
+	CHECK(!player.getRecord(frames.size()));
+
+	Delivered delivered(player);
+
+	// The whole recording, ten times faster than it was recorded
+	player.setSpeed(10);
+	player.play();
+
+	REQUIRE(delivered.waitForStop());
+	CHECK(!player.isPlaying());
+
+	{
+		std::lock_guard<std::mutex> lock(delivered.mx);
+
+		CHECK(delivered.frames == frames);
+		delivered.frames.clear();
+	}
+
+	// Seeking while paused delivers the calibration the frame depends on, then the frame
+	player.seek(20000000);
+
+	REQUIRE(delivered.waitFor(3));
+
+	{
+		std::lock_guard<std::mutex> lock(delivered.mx);
+
+		REQUIRE(delivered.frames.size() == 3);
+		CHECK(delivered.frames[0] == frames[0]);
+		CHECK(delivered.frames[1] == frames[1]);
+		CHECK(delivered.frames[2] == frames[21]);
+	}
+
+	CHECK(player.getPosition() == 20000000);
+
+	player.close();
+
+	CHECK(!player.isOpen());
+	CHECK(player.getRecordCount() == 0);
+}
+
+
+TEST(player_truncated)
+{
+	std::string file = test::tempPath("full.tvr");
+	std::string cut = test::tempPath("truncated.tvr");
+	std::vector<std::vector<uint16_t>> frames;
+
+	REQUIRE(recordSample(file, frames));
+
+	std::vector<char> data = readFile(file);
+	FileHeader header;
+	ChunkHeader chunk;
+
+	REQUIRE(data.size() > sizeof(header) + sizeof(chunk));
+
+	memcpy(&header, data.data(), sizeof(header));
+	memcpy(&chunk, data.data() + header.header_size, sizeof(chunk));
+
+	size_t first_chunk_end = header.header_size + sizeof(chunk) + chunk.size;
+
+	REQUIRE(chunk.magic == CHUNK_MAGIC && first_chunk_end < data.size());
+
+	// Without the footer, the complete chunks are still played, nothing before the end of the first one can be
+	for (size_t size = 0; size < data.size(); size += (size < 512 ? 1 : 4093))
+	{
+		writeFile(cut, data, size);
+
+		Player player;
+
+		if (!player.open(cut))
+		{
+			CHECK(!player.isOpen());
+			CHECK(size < first_chunk_end || size >= data.size() - sizeof(Footer));
+			continue;
+		}
+
+		CHECK(size >= first_chunk_end);
+		CHECK(player.getRecordCount() <= frames.size());
+
+		for (size_t i = 0; i < player.getRecordCount(); ++i)
+		{
+			Player::PData record = player.getRecord(i);
+
+			CHECK(record && *record == frames[i]);
+		}
+	}
+}
+
+
+TEST(player_bad_index)
+{
+	std::string file = test::tempPath("index.tvr");
+	std::string bad = test::tempPath("bad_index.tvr");
+	std::vector<std::vector<uint16_t>> frames;
+
+	REQUIRE(recordSample(file, frames));
+
+	std::vector<char> data = readFile(file);
+	Footer footer;
+
+	REQUIRE(data.size() > sizeof(FileHeader) + sizeof(footer));
+
+	memcpy(&footer, data.data() + data.size() - sizeof(footer), sizeof(footer));
+
+	REQUIRE(footer.record_count == frames.size());
+
+	// A file with a footer is trusted to have an index, when it doesn't add up the file is damaged
+	auto opens = [&](const Footer & changed, size_t entry_idx, const IndexEntry * entry)
+	{
+		std::vector<char> out = data;
+
+		memcpy(out.data() + out.size() - sizeof(changed), &changed, sizeof(changed));
+
+		if (entry)
+			memcpy(out.data() + footer.index_offset + entry_idx * sizeof(IndexEntry), entry, sizeof(*entry));
+
+		writeFile(bad, out, out.size());
+
+		Player player;
+
+		return player.open(bad);
+	};
+
+	CHECK(opens(footer, 0, nullptr));
+
+	// A record count that overflows when it's multiplied by the entry size
+	{
+		Footer changed = footer;
+
+		changed.record_count = 1ULL << 61;
+		CHECK(!opens(changed, 0, nullptr));
+
+		changed.record_count = footer.record_count + 1;
+		CHECK(!opens(changed, 0, nullptr));
+
+		changed.record_count = 0;
+		CHECK(!opens(changed, 0, nullptr));
+	}
+
+	// An index that starts in the header, or past the footer
+	{
+		Footer changed = footer;
+
+		changed.index_offset = 8;
+		CHECK(!opens(changed, 0, nullptr));
+
+		changed.index_offset = ~0ULL - 16;
+		CHECK(!opens(changed, 0, nullptr));
+	}
+
+	// Entries pointing out of the records
+	{
+		IndexEntry entry;
+
+		memcpy(&entry, data.data() + footer.index_offset + 5 * sizeof(entry), sizeof(entry));
+
+		IndexEntry changed = entry;
+
+		changed.offset = footer.index_offset - 8;
+		CHECK(!opens(footer, 5, &changed));
+
+		changed.offset = ~0ULL - 8;
+		CHECK(!opens(footer, 5, &changed));
+
+		changed = entry;
+		changed.size = 0xffffffff;
+		CHECK(!opens(footer, 5, &changed));
+
+		changed.offset = 0;
+		changed.size = 0;
+		CHECK(!opens(footer, 5, &changed));
+	}
+}
+
+
+TEST(player_bad_records)
+{
+	std::string file = test::tempPath("records.tvr");
+	std::string bad = test::tempPath("bad_records.tvr");
+	std::vector<std::vector<uint16_t>> frames;
+
+	REQUIRE(recordSample(file, frames));
+
+	std::vector<char> data = readFile(file);
+	FileHeader header;
+	Footer footer;
+
+	memcpy(&header, data.data(), sizeof(header));
+	memcpy(&footer, data.data() + data.size() - sizeof(footer), sizeof(footer));
+
+	// Frames of another size than the camera's
+	{
+		FileHeader changed = header;
+
+		changed.frame_width = 65535;
+		changed.frame_height = 65535;
+
+		std::vector<char> out = data;
+
+		memcpy(out.data(), &changed, sizeof(changed));
+		writeFile(bad, out, out.size());
+
+		Player player;
+
+		CHECK(!player.open(bad));
+	}
+
+	// A coded record claimed to be raw has the wrong size, it's skipped rather than read past or handed on
+	{
+		std::vector<char> out = data;
+		IndexEntry entry;
+
+		size_t at = footer.index_offset + 5 * sizeof(entry);
+
+		memcpy(&entry, out.data() + at, sizeof(entry));
+		entry.codec = CODEC_RAW;
+		memcpy(out.data() + at, &entry, sizeof(entry));
+		writeFile(bad, out, out.size());
+
+		Player player;
+
+		REQUIRE(player.open(bad));
+		CHECK(!player.getRecord(5));
+		CHECK(player.getRecord(4) && *player.getRecord(4) == frames[4]);
+	}
+
+	// A coded record of other dimensions than the file's
+	{
+		std::vector<char> out = data;
+		IndexEntry entry;
+
+		memcpy(&entry, out.data() + footer.index_offset, sizeof(entry));
+
+		// The width, after the version and the flags of the codec header
+		uint8_t * payload = reinterpret_cast<uint8_t *>(out.data() + entry.offset + sizeof(RecordHeader));
+
+		payload[2] = 0xff;
+		payload[3] = 0xff;
+		writeFile(bad, out, out.size());
+
+		Player player;
+
+		REQUIRE(player.open(bad));
+		CHECK(!player.getRecord(0));
+		CHECK(player.getRecord(1) && *player.getRecord(1) == frames[1]);
+	}
+}
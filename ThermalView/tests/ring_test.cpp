@@ -0,0 +1,249 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "tests/test.h"
+
+#ifndef _WIN32
+
+#include "shm/ring_reader.h"
+#include "shm/ring_writer.h"
+#include "frame.h"
+
+#include <algorithm>
+#include <chrono>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+static const size_t PIXELS = 206 * 156;
+
+
+static std::string ringName(const char * test)
+{
+	return std::string("/thermalview-") + test + "-" + std::to_string(getpid());
+}
+
+
+// Every pixel of frame seq is seq, so a frame mixed from two writes shows
+static std::vector<uint16_t> rawFrame(uint64_t seq)
+{
+	return std::vector<uint16_t>(PIXELS, static_cast<uint16_t>(seq));
+}
+
+
+TEST(ring_round_trip)
+{
+	std::string name = ringName("round_trip");
+
+	RingWriter writer;
+
+	REQUIRE(writer.open(name, 4));
+
+	RingReader reader;
+
+	REQUIRE(reader.open(name));
+	CHECK(reader.getWidth() == 206 && reader.getHeight() == 156);
+	CHECK(reader.getSlotCount() == 4);
+	CHECK(reader.getWriterPid() == static_cast<uint32_t>(getpid()));
+	CHECK(reader.getWritten(ring::KIND_RAW) == 0);
+
+	RingReader::Frame frame;
+
+	CHECK(!reader.readLatest(ring::KIND_RAW, frame));
+
+	auto captured = std::chrono::steady_clock::now();
+
+	for (uint64_t seq = 1; seq <= 10; ++seq)
+		writer.writeRaw(rawFrame(seq), seq, captured);
+
+	CHECK(reader.getWritten(ring::KIND_RAW) == 10);
+
+	REQUIRE(reader.readLatest(ring::KIND_RAW, frame));
+	CHECK(frame.index == 9 && frame.seq == 10);
+	CHECK(frame.captured_ns == std::chrono::duration_cast<std::chrono::nanoseconds>(captured.time_since_epoch()).count());
+	CHECK(frame.pixels == rawFrame(10));
+
+	// The last slot_count writes can be read, the ones before were written over
+	CHECK(reader.read(ring::KIND_RAW, 6, frame) && frame.seq == 7);
+	CHECK(!reader.read(ring::KIND_RAW, 5, frame));
+	CHECK(!reader.read(ring::KIND_RAW, 10, frame));
+
+	// A view is good until its slot is written again
+	RingReader::View view;
+
+	REQUIRE(reader.view(ring::KIND_RAW, 9, view));
+	CHECK(view.slot->seq == 10 && view.pixels[0] == 10);
+	CHECK(reader.isValid(view));
+
+	for (uint64_t seq = 11; seq <= 14; ++seq)
+		writer.writeRaw(rawFrame(seq), seq, captured);
+
+	CHECK(!reader.isValid(view));
+
+	// A re-render of a calibrated frame that's there already isn't written again
+	ThermalFrame calibrated;
+
+	calibrated.m_pixels.assign(PIXELS, 7);
+	calibrated.m_seq = 5;
+
+	writer.writeCalibrated(calibrated, true);
+	writer.writeCalibrated(calibrated, true);
+
+	calibrated.m_seq = 6;
+	writer.writeCalibrated(calibrated, false);
+
+	calibrated.m_seq = 4;
+	writer.writeCalibrated(calibrated, false);
+
+	CHECK(reader.getWritten(ring::KIND_CALIBRATED) == 2);
+	CHECK(reader.readLatest(ring::KIND_CALIBRATED, frame) && frame.seq == 6 && frame.flags == 0 && frame.pixels[0] == 7);
+	CHECK(reader.read(ring::KIND_CALIBRATED, 0, frame) && frame.seq == 5 && frame.flags == ring::FLAG_EXTRA_CAL);
+
+	// Closing unlinks it, the readers that have it see it's closed
+	CHECK(!reader.isClosed());
+
+	writer.close();
+
+	CHECK(reader.isClosed());
+	CHECK(reader.readLatest(ring::KIND_RAW, frame));
+
+	RingReader late;
+
+	CHECK(!late.open(name));
+}
+
+
+// Reads the latest frames until the writer closes the ring. Gives 0 if no mixed frame was taken for a good one.
+static int readUntilClosed(const std::string & name, bool zero_copy, int ready)
+{
+	RingReader reader;
+	bool opened = reader.open(name);
+
+	// The writer waits for every reader to have it open
+	char c = opened ? 1 : 0;
+
+	if (write(ready, &c, 1) != 1 || !opened)
+		return 2;
+
+	uint64_t good = 0;
+	uint64_t bad = 0;
+	RingReader::Frame frame;
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+
+	while (!reader.isClosed() && std::chrono::steady_clock::now() < deadline)
+	{
+		uint64_t written = reader.getWritten(ring::KIND_RAW);
+
+		if (!written)
+			continue;
+
+		if (zero_copy)
+		{
+			RingReader::View view;
+
+			if (!reader.view(ring::KIND_RAW, written - 1, view))
+				continue;
+
+			uint64_t seq = view.slot->seq;
+			bool same = std::all_of(view.pixels, view.pixels + PIXELS, [&](uint16_t v) { return v == static_cast<uint16_t>(seq); });
+
+			// Torn reads are fine, as long as they're caught
+			if (!reader.isValid(view))
+				continue;
+
+			same ? ++good : ++bad;
+		}
+		else if (reader.readLatest(ring::KIND_RAW, frame))
+		{
+			bool same = std::all_of(frame.pixels.begin(), frame.pixels.end(), [&](uint16_t v) { return v == static_cast<uint16_t>(frame.seq); });
+
+			same ? ++good : ++bad;
+		}
+	}
+
+	return bad || !good || !reader.isClosed() ? 1 : 0;
+}
+
+
+TEST(ring_readers_in_other_processes)
+{
+	static const uint64_t FRAMES = 20000;
+	static const int READERS = 3;
+
+	std::string name = ringName("processes");
+
+	RingWriter writer;
+
+	REQUIRE(writer.open(name, 4));
+
+	int ready[2];
+
+	REQUIRE(pipe(ready) == 0);
+
+	std::vector<pid_t> readers;
+
+	for (int i = 0; i < READERS; ++i)
+	{
+		pid_t pid = fork();
+
+		// The children leave without running the parent's cleanup
+		if (pid == 0)
+			_exit(readUntilClosed(name, i > 0, ready[1]));
+
+		if (pid > 0)
+			readers.push_back(pid);
+	}
+
+	CHECK(readers.size() == READERS);
+
+	int opened = 0;
+
+	for (size_t i = 0; i < readers.size(); ++i)
+	{
+		char c = 0;
+
+		if (read(ready[0], &c, 1) == 1 && c)
+			++opened;
+	}
+
+	CHECK(opened == READERS);
+
+	for (uint64_t seq = 1; seq <= FRAMES; ++seq)
+		writer.writeRaw(rawFrame(seq), seq, std::chrono::steady_clock::now());
+
+	writer.close();
+
+	for (pid_t pid : readers)
+	{
+		int status = 0;
+
+		CHECK(waitpid(pid, &status, 0) == pid);
+		CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	}
+
+	::close(ready[0]);
+	::close(ready[1]);
+}
+
+#endif
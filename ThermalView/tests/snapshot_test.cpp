@@ -0,0 +1,251 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "tests/test.h"
+#include "recording/snapshot.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+
+static std::vector<char> readFile(const std::string & file)
+{
+	std::ifstream in(file, std::ios::binary);
+	return std::vector<char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+
+static void writeFile(const std::string & file, const std::vector<char> & data, size_t size)
+{
+	std::ofstream out(file, std::ios::binary | std::ios::trunc);
+	out.write(data.data(), size);
+}
+
+
+// A snapshot with a few sections of different element sizes, as FrameProcessor::saveSnapshot writes them
+static bool saveSample(const std::string & file, std::vector<uint16_t> & raw, std::vector<double> & gain, std::vector<char> & name)
+{
+	snapshot::SnapshotHeader header;
+
+	memset(&header, 0, sizeof(header));
+
+	header.width		= 206;
+	header.height		= 156;
+	header.time			= 1234567890123ULL;
+	header.seq			= 42;
+	header.frame_id		= 3;
+	header.flags		= snapshot::FLAG_AUTO_RANGE;
+	header.range_min	= 100;
+	header.range_max	= 9000;
+	header.lut_first	= 90;
+
+	raw.resize(206 * 156);
+	gain.resize(206 * 156);
+
+	for (size_t i = 0; i < raw.size(); ++i)
+	{
+		raw[i]	= static_cast<uint16_t>(i * 7);
+		gain[i]	= 1.0 + i / 1000.0;
+	}
+
+	name.assign({ 'I', 'r', 'o', 'n', '!' });
+
+	std::vector<Snapshot::Section> sections;
+
+	Snapshot::addSection(sections, snapshot::SECTION_RAW, raw);
+	Snapshot::addSection(sections, snapshot::SECTION_PROFILE_NAME, name);
+	Snapshot::addSection(sections, snapshot::SECTION_GAIN, gain);
+
+	return Snapshot::save(file, header, sections);
+}
+
+
+TEST(snapshot_round_trip)
+{
+	std::string file = test::tempPath("round_trip.tvs");
+
+	std::vector<uint16_t> raw;
+	std::vector<double> gain;
+	std::vector<char> name;
+
+	REQUIRE(saveSample(file, raw, gain, name));
+
+	Snapshot snapshot;
+
+	REQUIRE(snapshot.open(file));
+
+	const snapshot::SnapshotHeader & header = snapshot.getHeader();
+
+	CHECK(header.width == 206 && header.height == 156);
+	CHECK(header.time == 1234567890123ULL);
+	CHECK(header.seq == 42);
+	CHECK(header.frame_id == 3);
+	CHECK(header.flags == snapshot::FLAG_AUTO_RANGE);
+	CHECK(header.range_min == 100 && header.range_max == 9000 && header.lut_first == 90);
+	CHECK(header.section_count == 3);
+	CHECK(snapshot.getSections().size() == 3);
+
+	size_t count;
+
+	const uint16_t * raw_in = snapshot.getSection<uint16_t>(snapshot::SECTION_RAW, count);
+
+	REQUIRE(raw_in);
+	CHECK(count == raw.size() && std::equal(raw.begin(), raw.end(), raw_in));
+
+	// Used in place, so it has to be aligned after the odd sized name
+	const double * gain_in = snapshot.getSection<double>(snapshot::SECTION_GAIN, count);
+
+	REQUIRE(gain_in);
+	CHECK(reinterpret_cast<uintptr_t>(gain_in) % snapshot::SECTION_ALIGN == 0);
+	CHECK(count == gain.size() && std::equal(gain.begin(), gain.end(), gain_in));
+
+	const char * name_in = snapshot.getSection<char>(snapshot::SECTION_PROFILE_NAME, count);
+
+	REQUIRE(name_in);
+	CHECK(std::string(name_in, count) == "Iron!");
+
+	// Missing sections and other element types aren't found
+	CHECK(!snapshot.getSection<uint16_t>(snapshot::SECTION_OFFSET, count) && count == 0);
+	CHECK(!snapshot.getSection<int32_t>(snapshot::SECTION_RAW, count) && count == 0);
+
+	snapshot.close();
+
+	CHECK(!snapshot.isOpen());
+	CHECK(snapshot.getSections().empty());
+}
+
+
+TEST(snapshot_truncated)
+{
+	std::string file = test::tempPath("full.tvs");
+	std::string cut = test::tempPath("truncated.tvs");
+
+	std::vector<uint16_t> raw;
+	std::vector<double> gain;
+	std::vector<char> name;
+
+	REQUIRE(saveSample(file, raw, gain, name));
+
+	std::vector<char> data = readFile(file);
+
+	REQUIRE(data.size() > sizeof(snapshot::SnapshotHeader));
+
+	// Every cut falls in the header, the section table or one of the sections, none of them can be opened
+	for (size_t size = 0; size < data.size(); size += (size < 512 ? 1 : 509))
+	{
+		writeFile(cut, data, size);
+
+		Snapshot snapshot;
+
+		CHECK(!snapshot.open(cut));
+		CHECK(!snapshot.isOpen());
+	}
+
+	writeFile(cut, data, data.size());
+
+	Snapshot snapshot;
+
+	CHECK(snapshot.open(cut));
+}
+
+
+TEST(snapshot_bad_header)
+{
+	std::string file = test::tempPath("header.tvs");
+	std::string bad = test::tempPath("bad_header.tvs");
+
+	std::vector<uint16_t> raw;
+	std::vector<double> gain;
+	std::vector<char> name;
+
+	REQUIRE(saveSample(file, raw, gain, name));
+
+	std::vector<char> data = readFile(file);
+	snapshot::SnapshotHeader header;
+
+	REQUIRE(data.size() > sizeof(header));
+
+	memcpy(&header, data.data(), sizeof(header));
+
+	// The section table past the end of the file
+	{
+		snapshot::SnapshotHeader changed = header;
+
+		changed.header_size = 1u << 30;
+
+		std::vector<char> out = data;
+
+		memcpy(out.data(), &changed, sizeof(changed));
+		writeFile(bad, out, out.size());
+
+		Snapshot snapshot;
+
+		CHECK(!snapshot.open(bad));
+	}
+
+	// More sections than the file has room for
+	{
+		snapshot::SnapshotHeader changed = header;
+
+		changed.section_count = 0x7fffffff;
+
+		std::vector<char> out = data;
+
+		memcpy(out.data(), &changed, sizeof(changed));
+		writeFile(bad, out, out.size());
+
+		Snapshot snapshot;
+
+		CHECK(!snapshot.open(bad));
+	}
+
+	// Another format
+	{
+		std::vector<char> out = data;
+
+		out[0] = 'X';
+		writeFile(bad, out, out.size());
+
+		Snapshot snapshot;
+
+		CHECK(!snapshot.open(bad));
+	}
+
+	// A section that ends past the end of the file
+	{
+		std::vector<char> out = data;
+		snapshot::SectionEntry entry;
+
+		memcpy(&entry, out.data() + header.header_size, sizeof(entry));
+		entry.size = out.size();
+		memcpy(out.data() + header.header_size, &entry, sizeof(entry));
+		writeFile(bad, out, out.size());
+
+		Snapshot snapshot;
+
+		CHECK(!snapshot.open(bad));
+	}
+
+	CHECK(!Snapshot().open(test::tempPath("missing.tvs")));
+}
@@ -0,0 +1,69 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// The smallest test runner that does the job: TEST(name) { ... } registers a test, CHECK(expr) reports a failure
+// and carries on, REQUIRE(expr) reports it and leaves the test. tests.cpp runs them all, or the ones named on the
+// command line, and fails when any check did.
+
+namespace test
+{
+	struct Case
+	{
+		const char *	name;
+		void			(*run)();
+	};
+
+	std::vector<Case> & cases();
+
+	// Counts and prints a failed check
+	void fail(const char * file, int line, const char * expr);
+
+	// A path for a test file in the temporary directory, unique to the run
+	std::string tempPath(const std::string & name);
+
+	struct Registrar
+	{
+		Registrar(const char * name, void (*run)())
+		{
+			Case c = { name, run };
+			cases().push_back(c);
+		}
+	};
+}
+
+#define TEST(name) \
+	static void test_##name(); \
+	static test::Registrar registrar_##name(#name, test_##name); \
+	static void test_##name()
+
+#define CHECK(expr) \
+	do { if (!(expr)) test::fail(__FILE__, __LINE__, #expr); } while (false)
+
+#define REQUIRE(expr) \
+	do { if (!(expr)) { test::fail(__FILE__, __LINE__, #expr); return; } } while (false)
@@ -0,0 +1,104 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Runs the tests:
+//
+//   ThermalViewTests [NAME]...
+//
+// Without names every test runs. The exit code is 1 when any check failed.
+
+#include "tests/test.h"
+
+#include <boost/filesystem.hpp>
+#include <cstring>
+
+namespace fs = boost::filesystem;
+
+
+static int failures = 0;
+
+
+static const fs::path & tempDir()
+{
+	static const fs::path dir = fs::temp_directory_path() / fs::unique_path("thermalview-%%%%-%%%%");
+	return dir;
+}
+
+
+std::vector<test::Case> & test::cases()
+{
+	static std::vector<Case> all;
+	return all;
+}
+
+
+void test::fail(const char * file, int line, const char * expr)
+{
+	std::printf("  %s:%d: CHECK(%s) failed\n", file, line, expr);
+	++failures;
+}
+
+
+std::string test::tempPath(const std::string & name)
+{
+	fs::create_directories(tempDir());
+
+	return (tempDir() / name).string();
+}
+
+
+int main(int argc, char * argv[])
+{
+	int run = 0;
+
+	for (auto & c : test::cases())
+	{
+		bool selected = argc < 2;
+
+		for (int i = 1; i < argc; ++i)
+			selected = selected || std::strcmp(argv[i], c.name) == 0;
+
+		if (!selected)
+			continue;
+
+		int before = failures;
+
+		std::printf("%s\n", c.name);
+		std::fflush(stdout);
+
+		c.run();
+
+		if (failures != before)
+			std::printf("  FAILED\n");
+
+		++run;
+	}
+
+	std::printf("%d tests, %d failed checks\n", run, failures);
+
+	boost::system::error_code ec;
+
+	fs::remove_all(tempDir(), ec);
+
+	return failures ? 1 : 0;
+}
@@ -22,6 +22,7 @@
  */
 
 #include "thermal.h"
+#include "trace.h"
 #include <string>
 
 #define USB_TIMEOUT 1000
@@ -166,7 +167,17 @@ bool SeekThermal::initialize()
 			CTRL_OUT(0x56, 0, 0);
 
 			vector<uint8_t> data1 = ctrlIn(0x4e, 4);
-			vector<uint8_t> data2 = ctrlIn(0x36, 12);
+			vector<uint8_t> data2 = ctrlIn(0x36, 12);		// Chip ID
+
+			static const char hex[] = "0123456789abcdef";
+
+			m_device_id.clear();
+
+			for (uint8_t byte : data2)
+			{
+				m_device_id += hex[byte >> 4];
+				m_device_id += hex[byte & 0x0f];
+			}
 
 			CTRL_OUT(0x56, 0x06, 0x00, 0x08, 0x00, 0x00, 0x00);
 			vector<uint8_t> data3 = ctrlIn(0x58, 0x0c);
@@ -234,11 +245,22 @@ void SeekThermal::close()
 		libusb_close(m_handle);
 
 		m_handle = 0;
+		m_device_id.clear();
 	}
 	
 	onDisconnected();
 }
 
+//////////////////////////////////////////////////////////////////////////////
+/// getDeviceId - The chip ID of the camera, as hex
+//////////////////////////////////////////////////////////////////////////////
+string SeekThermal::getDeviceId()
+{
+	lock_guard<recursive_mutex> lck(m_mx);
+
+	return m_device_id;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 /// is_open - Indicates if the USB device is open
 //////////////////////////////////////////////////////////////////////////////
@@ -266,6 +288,8 @@ std::vector<uint16_t> SeekThermal::getFrame()
 
 	try
 	{
+		TRACE_SCOPE("USB transfer");
+
 		CTRL_OUT(0x53, 0xc0, 0x7e, 0, 0);
 
 		// Do the bulk in transfer
@@ -290,21 +314,13 @@ std::vector<uint16_t> SeekThermal::getFrame()
 		if (total != static_cast<int>(data.size()))
 			throw usb_failure();
 
+		m_frame_times = FrameTimes();
+		m_frame_times.received = TimingClock::now();
 
 		// Let's interpret the data
-		frame.resize(206 * 156);
+		unpackFrame(&data[0], frame);
 
-		for (size_t y = 0; y < 156; ++y)
-		{
-			for (size_t x = 0; x < 206; ++x)
-			{
-				uint16_t frame_pixel = y * 206 + x;
-				uint16_t data_pixel = y * 208 + x;
-				uint16_t val = (data[data_pixel * 2 + 1] << 8) | data[data_pixel * 2];
-
-				frame[frame_pixel] = val;
-			}
-		}
+		m_frame_times.unpacked = TimingClock::now();
 	}
 	catch (usb_failure &)
 	{
@@ -315,6 +331,29 @@ std::vector<uint16_t> SeekThermal::getFrame()
 }
 
 
+//////////////////////////////////////////////////////////////////////////////
+/// unpackFrame - The transfer has 208 little endian values per row, the last 2 are padding
+//////////////////////////////////////////////////////////////////////////////
+void SeekThermal::unpackFrame(const uint8_t * data, std::vector<uint16_t> & frame)
+{
+	TRACE_SCOPE("Unpack");
+
+	frame.resize(206 * 156);
+
+	for (size_t y = 0; y < 156; ++y)
+	{
+		for (size_t x = 0; x < 206; ++x)
+		{
+			uint16_t frame_pixel = y * 206 + x;
+			uint16_t data_pixel = y * 208 + x;
+			uint16_t val = (data[data_pixel * 2 + 1] << 8) | data[data_pixel * 2];
+
+			frame[frame_pixel] = val;
+		}
+	}
+}
+
+
 //////////////////////////////////////////////////////////////////////////////
 /// get_stream - Starts the thread and issues a continous stream of frames
 //////////////////////////////////////////////////////////////////////////////
@@ -394,12 +433,16 @@ bool SeekThermal::isStreaming()
 //////////////////////////////////////////////////////////////////////////////
 void SeekThermal::workerThread()
 {
+	TRACE_THREAD_NAME("Camera");
+
 	if (!m_thread_single)
 		onStreamingStart();
 	
 	while (m_thread_running && !m_thread_should_stop)
 	{
-		onNewFrame(getFrame());
+		std::vector<uint16_t> frame = getFrame();
+
+		onNewFrame(frame, m_frame_times);
 
 		if (m_thread_single)
 			break;
@@ -26,12 +26,15 @@
 #pragma warning (default: 4200)
 
 #include <cstdint>
+#include <string>
 #include <vector>
 #include <boost/thread.hpp>
 #include <mutex>
 #include <boost/signals2.hpp>
 #include <boost/thread/synchronized_value.hpp>
 
+#include "stage_timing.h"
+
 class SeekThermal
 {
 private:
@@ -39,12 +42,15 @@ private:
 
 	libusb_device_handle * m_handle;
 	bool m_ep_claimed;
+	std::string m_device_id;		// Chip ID, read when connecting
 
 	// Thread stuff
 	boost::thread m_thread;
 	boost::synchronized_value<bool> m_thread_running;
 	boost::synchronized_value<bool> m_thread_single;		// Single frame
 	boost::synchronized_value<bool> m_thread_should_stop;	// Indicates that close() was called from within the thread
+
+	FrameTimes m_frame_times;		// When the last frame from getFrame() came off the bus
 	
 public:
     SeekThermal();
@@ -56,8 +62,14 @@ public:
 	bool isOpen();
 	bool isStreaming();
 
+	// Identifies the camera, empty when not connected
+	std::string getDeviceId();
+
 	std::vector<uint16_t> getFrame();
 
+	// Turns a bulk transfer of 0x7ec0 values into a 206 x 156 frame
+	static void unpackFrame(const uint8_t * data, std::vector<uint16_t> & frame);
+
 	void getStream();
 	void getOne();
 	
@@ -70,7 +82,8 @@ public:
 	boost::signals2::signal<void()> onDisconnected;
 	boost::signals2::signal<void()> onStreamingStart;
 	boost::signals2::signal<void()> onStreamingStop;
-	boost::signals2::signal<void(const std::vector<uint16_t> & data)> onNewFrame;
+	// With when the frame came off the bus, and was unpacked
+	boost::signals2::signal<void(const std::vector<uint16_t> & data, const FrameTimes & times)> onNewFrame;
 
 private:
     bool initialize();
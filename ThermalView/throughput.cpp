@@ -0,0 +1,486 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// End to end throughput: replays a capture through the same FramePipeline the dialog uses, as fast as it takes
+// the frames, with a display thread standing in for the UI. The display works like the dialog's: it's told a
+// result is ready, shows the latest one and scales it into the view, so a slow display skips frames instead of
+// queueing them.
+//
+//   ThermalViewThroughput [--capture FILE.tvr] [--frames N] [--profile FILE.gppal]... [--filters LIST]
+//                         [--quality LIST] [--size WxH] [--json FILE] [--load FILE]...
+//
+// Every combination of palette, filters and scaling quality is run for --frames regular frames, and reported
+// with the sustained frames/s, the latency from the camera to the screen (p50, p99, max) and the frames the
+// display skipped. Filters are none, extra (extra calibration) and isotherms, or combinations such as
+// extra+isotherms; the default is none,extra. Any other filter is a custom stage, NAME or NAME:ARGS, such as
+// median or one from a shared object given with --load. Qualities are nearest, bilinear and bicubic, all by default.
+//
+// The capture loops: its gain calibration frame goes first, then the offset calibration frame and the regular
+// frames, over and over.
+
+#include "fixture.h"
+#include "frame_pipeline.h"
+#include "resampler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+typedef std::chrono::steady_clock Clock;
+
+struct Options
+{
+	std::string					capture;
+	size_t						frames;
+	std::vector<std::string>	profiles;
+	std::vector<std::string>	filters;
+	std::vector<std::string>	qualities;
+	int							width;
+	int							height;
+	std::string					json;
+	std::vector<std::string>	load;
+
+	Options() : frames(1000), width(824), height(624) {}
+};
+
+struct RunConfig
+{
+	std::shared_ptr<const ColorProfile>	profile;
+	bool								extra_cal;
+	bool								isotherms;
+	std::string							filters;
+	std::vector<std::string>			stages;		// Custom stages, in order
+	std::string							quality_name;
+	Resampler::Quality					quality;
+};
+
+struct RunResult
+{
+	double		fps;				// Regular frames through the pipeline, per second
+	uint64_t	shown;				// Frames the display got to
+	uint64_t	skipped;			// Frames that were replaced before the display got to them
+	double		latency_p50;		// ms, from the camera to the screen
+	double		latency_p99;
+	double		latency_max;
+	std::string	busiest;			// The stage that limits the throughput
+	double		busiest_load;
+};
+
+
+static std::vector<std::string> split(const std::string & text, char separator)
+{
+	std::vector<std::string> parts;
+	std::stringstream ss(text);
+	std::string part;
+
+	while (std::getline(ss, part, separator))
+	{
+		if (!part.empty())
+			parts.push_back(part);
+	}
+
+	return parts;
+}
+
+
+static double percentile(const std::vector<double> & sorted, double p)
+{
+	if (sorted.empty())
+		return 0;
+
+	size_t idx = static_cast<size_t>(p * sorted.size() + 0.5);
+
+	return sorted[std::min(idx ? idx - 1 : 0, sorted.size() - 1)];
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+/// run - Pushes the frames as fast as the pipeline takes them, while the display thread keeps up as it can
+//////////////////////////////////////////////////////////////////////////
+static RunResult run(const Fixture & fixture, const RunConfig & run_config, const Options & options)
+{
+	FramePipeline frames;
+
+	auto config = std::make_shared<RenderConfig>();
+
+	config->profile			= run_config.profile;
+	config->use_extra_cal	= run_config.extra_cal;
+	config->auto_range		= true;
+	config->filters			= true;
+	config->manual_min		= 0;
+	config->manual_max		= 0;
+
+	frames.setConfig(config);
+
+	auto stages = std::make_shared<StageChain>();
+	std::string error;
+
+	for (auto & spec : run_config.stages)
+		stages->add(spec, error);
+
+	frames.setStages(stages);
+
+	if (run_config.extra_cal)
+		frames.getProcessor().captureExtraCalibration();
+
+	// When each frame was handed over, by sequence number. Written before the push, so it's there before the result.
+	size_t records = 1 + options.frames + (options.frames / fixture.frames.size() + 1);
+	std::vector<Clock::time_point> pushed(records + 1);
+
+	// Stands in for the UI thread: a pending flag instead of the event queue, the latest result on each wake up
+	std::mutex mx;
+	std::condition_variable cv;
+	bool pending = false;
+	bool done = false;
+
+	frames.onResult.connect([&](const PFrameResult &)
+	{
+		std::lock_guard<std::mutex> lock(mx);
+
+		if (!pending)
+		{
+			pending = true;
+			cv.notify_one();
+		}
+	});
+
+	std::vector<double> latencies;
+	uint64_t shown = 0;
+
+	latencies.reserve(options.frames);
+
+	std::thread display([&]()
+	{
+		Resampler resampler;
+		std::vector<unsigned char> row(options.width * 3);
+		uint64_t last_seq = 0;
+
+		resampler.setup(206, 156, options.width, options.height, run_config.quality);
+
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mx);
+
+				cv.wait(lock, [&]() { return pending || done; });
+
+				if (!pending)
+					break;
+
+				pending = false;
+			}
+
+			PFrameResult result = frames.getResult();
+
+			if (!result || result->seq == last_seq)
+				continue;
+
+			last_seq = result->seq;
+
+			// What the view does with a new frame
+			const ThermalFrame & frame = *result->frame_extra;
+
+			resampler.prepareValues(frame.m_pixels.data());
+
+			for (int y = 0; y < options.height; ++y)
+			{
+				if (!resampler.isSameRow(y))
+					resampler.getValueRow(y, result->lut.rgb.data(), result->lut.first, result->lut.band.size(), row.data());
+			}
+
+			latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - pushed[result->seq]).count());
+			++shown;
+		}
+	});
+
+	frames.start();
+
+	auto start = Clock::now();
+	uint64_t seq = 0;
+	size_t regular = 0;
+
+	auto push = [&](const std::vector<uint16_t> & data)
+	{
+		pushed[++seq] = Clock::now();
+		frames.push(data);
+	};
+
+	push(fixture.gain);
+
+	while (regular < options.frames)
+	{
+		push(fixture.offset);
+
+		for (size_t i = 0; i < fixture.frames.size() && regular < options.frames; ++i, ++regular)
+			push(fixture.frames[i]);
+	}
+
+	// The load is only known while it's running
+	RunResult result;
+
+	result.busiest_load = 0;
+
+	for (auto & stage : frames.getStats())
+	{
+		if (stage.busy >= result.busiest_load)
+		{
+			result.busiest		= stage.name;
+			result.busiest_load	= stage.busy;
+		}
+	}
+
+	frames.stop();
+
+	double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+	{
+		std::lock_guard<std::mutex> lock(mx);
+
+		done = true;
+		cv.notify_one();
+	}
+
+	display.join();
+
+	std::sort(latencies.begin(), latencies.end());
+
+	result.fps			= regular / elapsed;
+	result.shown		= shown;
+	result.skipped		= regular - shown;
+	result.latency_p50	= percentile(latencies, 0.5);
+	result.latency_p99	= percentile(latencies, 0.99);
+	result.latency_max	= latencies.empty() ? 0 : latencies.back();
+
+	return result;
+}
+
+
+static void usage()
+{
+	std::cerr << "Usage: ThermalViewThroughput [--capture FILE.tvr] [--frames N] [--profile FILE.gppal]... [--filters LIST]" << std::endl
+			  << "                             [--quality LIST] [--size WxH] [--json FILE] [--load FILE]..." << std::endl;
+}
+
+
+static bool parseOptions(int argc, char * argv[], Options & options)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+
+		if (i + 1 >= argc)
+			return false;
+
+		if (arg == "--capture")
+			options.capture = argv[++i];
+		else if (arg == "--frames")
+			options.frames = std::max(1, atoi(argv[++i]));
+		else if (arg == "--profile")
+			options.profiles.push_back(argv[++i]);
+		else if (arg == "--filters")
+			options.filters = split(argv[++i], ',');
+		else if (arg == "--quality")
+			options.qualities = split(argv[++i], ',');
+		else if (arg == "--size")
+		{
+			if (sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2 || options.width < 1 || options.height < 1)
+				return false;
+		}
+		else if (arg == "--json")
+			options.json = argv[++i];
+		else if (arg == "--load")
+			options.load.push_back(argv[++i]);
+		else
+			return false;
+	}
+
+	if (options.filters.empty())
+		options.filters = split("none,extra", ',');
+
+	if (options.qualities.empty())
+		options.qualities = split("nearest,bilinear,bicubic", ',');
+
+	return true;
+}
+
+
+int main(int argc, char * argv[])
+{
+	Options options;
+
+	if (!parseOptions(argc, argv, options))
+	{
+		usage();
+		return 1;
+	}
+
+	for (auto & file : options.load)
+	{
+		std::string error;
+
+		if (!StageRegistry::load(file, error))
+		{
+			std::cerr << error << std::endl;
+			return 1;
+		}
+	}
+
+	Fixture fixture;
+
+	if (options.capture.empty())
+		fixture = Fixture::synthetic(64);
+	else if (!fixture.load(options.capture))
+	{
+		std::cerr << "No usable frames in " << options.capture << ", it needs a gain and an offset calibration frame before the regular ones" << std::endl;
+		return 1;
+	}
+
+	std::vector<std::shared_ptr<GradientProfile>> profiles;
+
+	for (auto & file : options.profiles)
+		profiles.push_back(std::make_shared<GradientProfile>(file));
+
+	if (profiles.empty())
+		profiles.push_back(Fixture::profile());
+
+	// Every combination
+	std::vector<RunConfig> configs;
+
+	for (auto & profile : profiles)
+	{
+		for (auto & filters : options.filters)
+		{
+			for (auto & quality : options.qualities)
+			{
+				RunConfig config;
+
+				config.extra_cal	= false;
+				config.isotherms	= false;
+				config.filters		= filters;
+				config.quality_name	= quality;
+
+				for (auto & filter : split(filters, '+'))
+				{
+					if (filter == "extra")
+						config.extra_cal = true;
+					else if (filter == "isotherms")
+						config.isotherms = true;
+					else if (filter != "none")
+					{
+						// Made once here to check it, every run gets a chain of its own
+						StageChain check;
+						std::string error;
+
+						if (!check.add(filter, error))
+						{
+							std::cerr << "Unknown filter " << filter << ": " << error << std::endl;
+							return 1;
+						}
+
+						config.stages.push_back(filter);
+					}
+				}
+
+				if (quality == "nearest")
+					config.quality = Resampler::QUALITY_NEAREST;
+				else if (quality == "bilinear")
+					config.quality = Resampler::QUALITY_BILINEAR;
+				else if (quality == "bicubic")
+					config.quality = Resampler::QUALITY_BICUBIC;
+				else
+				{
+					std::cerr << "Unknown quality " << quality << std::endl;
+					return 1;
+				}
+
+				// Two bands over the warm part of the scene, like highlighting from the picture menu does
+				if (config.isotherms)
+				{
+					auto copy = profile->clone();
+
+					copy->setIsotherms(ColorProfile::Isotherms { ColorProfile::Isotherm(9000, 9500, 0, 255, 0, 128),
+						ColorProfile::Isotherm(10000, 0xffff, 255, 0, 0) });
+
+					config.profile = copy;
+				}
+				else
+					config.profile = profile;
+
+				configs.push_back(config);
+			}
+		}
+	}
+
+	printf("%u frames per run from %s, %dx%d view\n\n", static_cast<unsigned>(options.frames),
+		options.capture.empty() ? "synthetic" : options.capture.c_str(), options.width, options.height);
+	printf("%-12s %-18s %-9s %9s %8s %8s %9s %9s %9s  %s\n", "palette", "filters", "quality", "frames/s", "shown", "skipped", "p50 ms", "p99 ms", "max ms", "busiest");
+
+	std::string json = "{\n  \"frames\": " + std::to_string(options.frames) + ",\n  \"runs\": [\n";
+
+	for (size_t i = 0; i < configs.size(); ++i)
+	{
+		const RunConfig & config = configs[i];
+		RunResult r = run(fixture, config, options);
+
+		printf("%-12s %-18s %-9s %9.1f %8llu %8llu %9.2f %9.2f %9.2f  %s %.0f%%\n", config.profile->getName().c_str(), config.filters.c_str(),
+			config.quality_name.c_str(), r.fps, static_cast<unsigned long long>(r.shown), static_cast<unsigned long long>(r.skipped),
+			r.latency_p50, r.latency_p99, r.latency_max, r.busiest.c_str(), r.busiest_load * 100);
+		fflush(stdout);
+
+		char line[512];
+
+		snprintf(line, sizeof(line), "    { \"palette\": \"%s\", \"filters\": \"%s\", \"quality\": \"%s\", \"width\": %d, \"height\": %d, "
+			"\"frames_per_second\": %.1f, \"shown\": %llu, \"skipped\": %llu, \"latency_p50_ms\": %.3f, \"latency_p99_ms\": %.3f, "
+			"\"latency_max_ms\": %.3f, \"busiest_stage\": \"%s\", \"busiest_load\": %.3f }%s\n",
+			config.profile->getName().c_str(), config.filters.c_str(), config.quality_name.c_str(), options.width, options.height,
+			r.fps, static_cast<unsigned long long>(r.shown), static_cast<unsigned long long>(r.skipped), r.latency_p50, r.latency_p99,
+			r.latency_max, r.busiest.c_str(), r.busiest_load, i + 1 < configs.size() ? "," : "");
+
+		json += line;
+	}
+
+	json += "  ]\n}\n";
+
+	if (!options.json.empty())
+	{
+		FILE * f = fopen(options.json.c_str(), "w");
+
+		if (!f || fputs(json.c_str(), f) < 0 || fclose(f) != 0)
+		{
+			std::cerr << "Can't write " << options.json << std::endl;
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,195 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "trace.h"
+
+#ifdef THERMALVIEW_TRACE
+
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <boost/thread/tss.hpp>
+
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	struct Event
+	{
+		const char *	name;
+		int64_t			begin_ns;		// Since the start of the process
+		int64_t			duration_ns;
+	};
+
+	// One thread records into it, Trace::write() reads it from any thread
+	struct ThreadBuffer
+	{
+		static const size_t CAPACITY = 32768;
+
+		unsigned				tid;
+		std::string				name;		// Under g_mx
+		std::vector<Event>		events;
+		std::atomic<uint64_t>	head;		// Events recorded so far, the newest is at (head - 1) % CAPACITY
+
+		explicit ThreadBuffer(unsigned tid) : tid(tid), events(CAPACITY), head(0) {}
+	};
+
+	const Clock::time_point g_start = Clock::now();
+
+	// The buffers are kept after their threads are gone, so their events still make it into the trace
+	std::mutex									g_mx;
+	std::vector<std::unique_ptr<ThreadBuffer>>	g_buffers;
+
+	// The buffers belong to g_buffers, so nothing is deleted when a thread ends
+	void keepBuffer(ThreadBuffer *) {}
+
+	boost::thread_specific_ptr<ThreadBuffer>	g_thread_buffer(keepBuffer);
+
+
+	ThreadBuffer & threadBuffer()
+	{
+		ThreadBuffer * buffer = g_thread_buffer.get();
+
+		if (!buffer)
+		{
+			std::lock_guard<std::mutex> lock(g_mx);
+
+			g_buffers.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer(static_cast<unsigned>(g_buffers.size() + 1))));
+			buffer = g_buffers.back().get();
+
+			g_thread_buffer.reset(buffer);
+		}
+
+		return *buffer;
+	}
+
+
+	void writeString(std::ostream & out, const std::string & str)
+	{
+		out << '"';
+
+		for (char c : str)
+		{
+			if (c == '"' || c == '\\')
+				out << '\\' << c;
+			else if (static_cast<unsigned char>(c) >= 0x20)
+				out << c;
+		}
+
+		out << '"';
+	}
+}
+
+
+void Trace::setThreadName(const std::string & name)
+{
+	ThreadBuffer & buffer = threadBuffer();
+
+	std::lock_guard<std::mutex> lock(g_mx);
+
+	buffer.name = name;
+}
+
+
+void Trace::record(const char * name, Clock::time_point begin, Clock::time_point end)
+{
+	ThreadBuffer & buffer = threadBuffer();
+
+	uint64_t head = buffer.head.load(std::memory_order_relaxed);
+	Event & event = buffer.events[head % ThreadBuffer::CAPACITY];
+
+	event.name			= name;
+	event.begin_ns		= std::chrono::duration_cast<std::chrono::nanoseconds>(begin - g_start).count();
+	event.duration_ns	= std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+
+	// Publishes the event to write()
+	buffer.head.store(head + 1, std::memory_order_release);
+}
+
+
+bool Trace::write(const std::string & file)
+{
+	std::ofstream out(file.c_str());
+
+	if (!out)
+		return false;
+
+	std::lock_guard<std::mutex> lock(g_mx);
+
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+	bool first = true;
+
+	for (auto & buffer : g_buffers)
+	{
+		if (!buffer->name.empty())
+		{
+			out << (first ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer->tid << ",\"args\":{\"name\":";
+			writeString(out, buffer->name);
+			out << "}}";
+
+			first = false;
+		}
+
+		// The thread keeps recording meanwhile, so the copy is only good up to where it had wrapped around by the end
+		uint64_t head = buffer->head.load(std::memory_order_acquire);
+		uint64_t tail = head > ThreadBuffer::CAPACITY ? head - ThreadBuffer::CAPACITY : 0;
+
+		std::vector<Event> events;
+
+		for (uint64_t i = tail; i < head; i++)
+			events.push_back(buffer->events[i % ThreadBuffer::CAPACITY]);
+
+		// The copy is done before head is read again. The slot of event head_after may be the one being written
+		// right now, so it goes too.
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		uint64_t head_after = buffer->head.load(std::memory_order_relaxed);
+		uint64_t valid_from = head_after + 1 > ThreadBuffer::CAPACITY ? head_after + 1 - ThreadBuffer::CAPACITY : 0;
+
+		for (uint64_t i = tail; i < head; i++)
+		{
+			if (i < valid_from)
+				continue;
+
+			const Event & event = events[static_cast<size_t>(i - tail)];
+
+			// Chrome wants microseconds
+			out << (first ? "" : ",\n") << "{\"ph\":\"X\",\"name\":";
+			writeString(out, event.name);
+			out << ",\"pid\":1,\"tid\":" << buffer->tid << ",\"ts\":" << event.begin_ns / 1000 << "." << (event.begin_ns % 1000) / 100
+				<< ",\"dur\":" << event.duration_ns / 1000 << "." << (event.duration_ns % 1000) / 100 << "}";
+
+			first = false;
+		}
+	}
+
+	out << "\n]}\n";
+
+	return static_cast<bool>(out);
+}
+
+#endif
@@ -0,0 +1,89 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Razvan C. Cojocariu (code@dumb.ro)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+// Scoped events in the Chrome trace format, for chrome://tracing or Perfetto, to see how the camera, the
+// pipeline and the UI threads interleave. It's only there when built with THERMALVIEW_TRACE defined, otherwise
+// the macros are empty and none of it is compiled in.
+//
+//   TRACE_SCOPE("Name");			An event from here to the end of the scope. The name has to be a literal.
+//   TRACE_THREAD_NAME(name);		Names the calling thread in the trace
+//
+// Every thread records into a ring buffer of its own, so it only ever waits for the clock. Trace::write() takes
+// the events of all of them, the oldest ones of a busy thread are overwritten.
+
+#ifdef THERMALVIEW_TRACE
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+
+class Trace
+{
+public:
+	static void setThreadName(const std::string & name);
+
+	// Writes the events in all the buffers so far, they're kept for the next write
+	static bool write(const std::string & file);
+
+	// A complete event, from the thread calling it
+	static void record(const char * name, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end);
+};
+
+
+class TraceScope
+{
+private:
+	const char *							m_name;
+	std::chrono::steady_clock::time_point	m_begin;
+
+public:
+	explicit TraceScope(const char * name)
+		: m_name(name),
+		m_begin(std::chrono::steady_clock::now())
+	{
+	}
+
+	~TraceScope()
+	{
+		Trace::record(m_name, m_begin, std::chrono::steady_clock::now());
+	}
+
+	TraceScope(const TraceScope &) = delete;
+	TraceScope & operator=(const TraceScope &) = delete;
+};
+
+
+#define TRACE_CONCAT_(a, b)			a##b
+#define TRACE_CONCAT(a, b)			TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name)			TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_THREAD_NAME(name)		Trace::setThreadName(name)
+
+#else
+
+#define TRACE_SCOPE(name)
+#define TRACE_THREAD_NAME(name)
+
+#endif
@@ -22,7 +22,14 @@
  */
 
 #include "wximageview.h"
+#include "trace.h"
 #include <wx/dcbuffer.h>
+#include <wx/rawbmp.h>
+#include <algorithm>
+#include <cmath>
+
+static const double MAX_ZOOM = 16;		// Source pixels get at most this much bigger than in the full view
+static const double ZOOM_STEP = 1.25;	// Zoom change for one mouse wheel notch
 
 IMPLEMENT_DYNAMIC_CLASS(wxImageView, wxControl);
 
@@ -30,12 +37,23 @@ BEGIN_EVENT_TABLE(wxImageView, wxControl)
 	EVT_ERASE_BACKGROUND(wxImageView::OnEraseBackground)
 	EVT_PAINT(wxImageView::OnPaint)
 	EVT_SIZE(wxImageView::OnSize)
+	EVT_MOUSEWHEEL(wxImageView::OnMouseWheel)
+	EVT_LEFT_DOWN(wxImageView::OnLeftDown)
+	EVT_LEFT_UP(wxImageView::OnLeftUp)
+	EVT_LEFT_DCLICK(wxImageView::OnLeftDClick)
+	EVT_MOTION(wxImageView::OnMotion)
+	EVT_MOUSE_CAPTURE_LOST(wxImageView::OnCaptureLost)
 END_EVENT_TABLE()
 
 wxImageView::wxImageView()
 {
 	m_zoom_type = ZOOM_KEEP_RATIO;
 	m_quality = wxIMAGE_QUALITY_NORMAL;
+	m_zoomable = false;
+	m_zoom = 1;
+	m_center_x = 0;
+	m_center_y = 0;
+	m_view = View();
 }
 
 wxImageView::wxImageView(wxWindow * parent, wxWindowID id)
@@ -43,6 +61,11 @@ wxImageView::wxImageView(wxWindow * parent, wxWindowID id)
 {
 	m_zoom_type = ZOOM_KEEP_RATIO;
 	m_quality = wxIMAGE_QUALITY_NORMAL;
+	m_zoomable = false;
+	m_zoom = 1;
+	m_center_x = 0;
+	m_center_y = 0;
+	m_view = View();
 }
 
 wxImageView::~wxImageView()
@@ -52,17 +75,40 @@ wxImageView::~wxImageView()
 void wxImageView::setImage(const wxImage & img)
 {
 	m_img = img;
+	m_values.clear();
 	
 	updateView();
 }
 
+void wxImageView::setFrame(const std::vector<uint16_t> & values, int width, int height, const ColorProfile::Lut & lut)
+{
+	m_img.Destroy();
+
+	m_values = values;
+	m_values_size = wxSize(width, height);
+	m_lut = lut;
+
+	updateView();
+}
+
 void wxImageView::clearImage()
 {
 	m_img.Destroy();
+	m_values.clear();
 	
 	updateView();
 }
 
+void wxImageView::setOverlay(const wxString & text)
+{
+	if (text == m_overlay)
+		return;
+
+	m_overlay = text;
+
+	Refresh(false);
+}
+
 void wxImageView::setZoomType(ZoomType zoom_type)
 {
 	m_zoom_type = zoom_type;
@@ -77,9 +123,116 @@ void wxImageView::setQuality(wxImageResizeQuality resize_quality)
 	updateView();
 }
 
+void wxImageView::setZoomable(bool zoomable)
+{
+	m_zoomable = zoomable;
+
+	if (!m_zoomable)
+		resetZoom();
+}
+
+void wxImageView::setZoom(double zoom, double center_x, double center_y)
+{
+	m_zoom = std::min(std::max(zoom, 1.0), MAX_ZOOM);
+	m_center_x = center_x;
+	m_center_y = center_y;
+
+	updateView();
+}
+
+void wxImageView::resetZoom()
+{
+	wxSize src = getSourceSize();
+
+	setZoom(1, src.GetWidth() / 2.0, src.GetHeight() / 2.0);
+}
+
+double wxImageView::getZoom() const
+{
+	return m_zoom;
+}
+
+bool wxImageView::screenToSource(const wxPoint & pos, double & x, double & y) const
+{
+	if (!hasContent() || m_view.screen.IsEmpty() || !m_view.screen.Contains(pos))
+		return false;
+
+	x = m_view.src_x + (pos.x - m_view.screen.x + 0.5) * m_view.src_width / m_view.screen.width;
+	y = m_view.src_y + (pos.y - m_view.screen.y + 0.5) * m_view.src_height / m_view.screen.height;
+
+	return true;
+}
+
+void wxImageView::OnMouseWheel(wxMouseEvent & event)
+{
+	double x;
+	double y;
+
+	if (!m_zoomable || !screenToSource(event.GetPosition(), x, y))
+	{
+		event.Skip();
+		return;
+	}
+
+	double zoom = m_zoom * std::pow(ZOOM_STEP, static_cast<double>(event.GetWheelRotation()) / event.GetWheelDelta());
+	zoom = std::min(std::max(zoom, 1.0), MAX_ZOOM);
+
+	// Keep the source point under the mouse where it is
+	double scale = m_zoom / zoom;
+
+	setZoom(zoom, x + (m_center_x - x) * scale, y + (m_center_y - y) * scale);
+}
+
+void wxImageView::OnLeftDown(wxMouseEvent & event)
+{
+	if (m_zoomable && m_zoom > 1)
+	{
+		m_drag_pos = event.GetPosition();
+		CaptureMouse();
+	}
+
+	event.Skip();
+}
+
+void wxImageView::OnLeftUp(wxMouseEvent & event)
+{
+	if (HasCapture())
+		ReleaseMouse();
+
+	event.Skip();
+}
+
+void wxImageView::OnLeftDClick(wxMouseEvent & event)
+{
+	if (m_zoomable)
+		resetZoom();
+
+	event.Skip();
+}
+
+void wxImageView::OnMotion(wxMouseEvent & event)
+{
+	if (HasCapture() && event.LeftIsDown() && !m_view.screen.IsEmpty())
+	{
+		wxPoint delta = event.GetPosition() - m_drag_pos;
+		m_drag_pos = event.GetPosition();
+
+		setZoom(m_zoom,
+			m_center_x - delta.x * m_view.src_width / m_view.screen.width,
+			m_center_y - delta.y * m_view.src_height / m_view.screen.height);
+	}
+
+	event.Skip();
+}
+
+void wxImageView::OnCaptureLost(wxMouseCaptureLostEvent & event)
+{
+	// Nothing to do, the drag simply ends
+}
+
 void wxImageView::OnSize(wxSizeEvent & event)
 {
-	if (m_img.IsOk())
+	if (hasContent())
 	{
 		updateView();
 	}
@@ -87,7 +240,7 @@ void wxImageView::OnSize(wxSizeEvent & event)
 
 void wxImageView::OnEraseBackground(wxEraseEvent & event)
 {
-	if (m_img.IsOk())
+	if (hasContent())
 		return;			// Don't do any erasing if the image is ok, we'll take care of it during the paint event
 	else
 		event.Skip();
@@ -95,28 +248,39 @@ void wxImageView::OnEraseBackground(wxEraseEvent & event)
 
 void wxImageView::OnPaint(wxPaintEvent & event)
 {
+	TRACE_SCOPE("Paint");
+
 	// If we don't have an image, don't paint it
-	if (m_img.IsOk())
+	if (hasContent())
 	{
 		wxBufferedPaintDC dc(this);
 
 		// Erase background
 		dc.SetBackground(wxBrush(GetBackgroundColour(), wxSOLID));
 		dc.Clear();
-		
-		// Get the client size
-		int client_width;
-		int client_height;
 
-		GetClientSize(&client_width, &client_height);
-		
-		// Get the image size
-		wxSize img_sz = m_img_scaled.GetSize();
+		if (!m_img_scaled.IsOk())
+			return;
 		
-		int padding_left = (client_width - img_sz.GetWidth()) / 2;
-		int padding_top = (client_height - img_sz.GetHeight()) / 2;
-		
-		dc.DrawBitmap(m_img_scaled, padding_left, padding_top);
+		dc.DrawBitmap(m_img_scaled, m_view.screen.x, m_view.screen.y);
+
+		if (!m_overlay.IsEmpty())
+		{
+			// On its own background, so it stays readable over any palette
+			dc.SetFont(*wxSMALL_FONT);
+			dc.SetTextForeground(*wxWHITE);
+			dc.SetTextBackground(*wxBLACK);
+			dc.SetBackgroundMode(wxSOLID);
+
+			wxArrayString lines = wxSplit(m_overlay, '\n', 0);
+			int y = m_view.screen.y + 4;
+
+			for (size_t i = 0; i < lines.size(); i++)
+			{
+				dc.DrawText(lines[i], m_view.screen.x + 4, y);
+				y += dc.GetCharHeight();
+			}
+		}
 	}
 	else
 		event.Skip();
@@ -125,7 +289,7 @@ void wxImageView::OnPaint(wxPaintEvent & event)
 
 void wxImageView::updateView()
 {
-	if (m_img.IsOk())
+	if (hasContent())
 	{
 		// Get the client area
 		int client_width;
@@ -133,15 +297,14 @@ void wxImageView::updateView()
 
 		GetClientSize(&client_width, &client_height);
 
+		int sz_x = client_width;
+		int sz_y = client_height;
 		
 		if (m_zoom_type == ZOOM_KEEP_RATIO)
 		{
 			// Figure out the size of the new image
-			wxSize bsz = m_img.GetSize();
+			wxSize bsz = getSourceSize();
 
-			int sz_x;
-			int sz_y;
-			
 			// If the height would fit in, when the width would FILL the client width
 			if ( bsz.GetHeight() * (static_cast<float>(client_width) / bsz.GetWidth()) <= client_height )
 			{
@@ -153,16 +316,139 @@ void wxImageView::updateView()
 				sz_x = bsz.GetWidth() * (static_cast<float>(client_height) / bsz.GetHeight());
 				sz_y = client_height;
 			}
+		}
+
+		// The visible part of the source, which is what gets mapped and scaled
+		wxSize src = getSourceSize();
+
+		clampView();
+
+		m_view.src_width = src.GetWidth() / m_zoom;
+		m_view.src_height = src.GetHeight() / m_zoom;
+		m_view.src_x = m_center_x - m_view.src_width / 2;
+		m_view.src_y = m_center_y - m_view.src_height / 2;
+		m_view.screen = wxRect((client_width - sz_x) / 2, (client_height - sz_y) / 2, sz_x, sz_y);
 
-			// Scale the image
-			m_img_scaled = wxBitmap(m_img.Scale(sz_x, sz_y, m_quality));
+		if (sz_x < 1 || sz_y < 1)
+			m_img_scaled = wxNullBitmap;
+		else if (!m_img.IsOk())
+			renderFrame(sz_x, sz_y);
+		else if (m_img.HasAlpha())
+		{
+			if (m_zoom > 1)
+			{
+				wxRect rect(static_cast<int>(m_view.src_x), static_cast<int>(m_view.src_y),
+					std::max(static_cast<int>(m_view.src_width), 1), std::max(static_cast<int>(m_view.src_height), 1));
+
+				m_img_scaled = wxBitmap(m_img.GetSubImage(rect).Scale(sz_x, sz_y, m_quality));
+			}
+			else
+				m_img_scaled = wxBitmap(m_img.Scale(sz_x, sz_y, m_quality));
 		}
 		else
 		{
-			m_img_scaled = wxBitmap(m_img.Scale(client_width, client_height, m_quality));
+			// The resampler keeps its tables until the view, the sizes or the quality change
+			m_resampler.setup(m_img.GetWidth(), m_img.GetHeight(), m_view.src_x, m_view.src_y, m_view.src_width, m_view.src_height,
+				sz_x, sz_y, getResamplerQuality());
+
+			if (!m_img_resampled.IsOk() || m_img_resampled.GetWidth() != sz_x || m_img_resampled.GetHeight() != sz_y)
+				m_img_resampled.Create(sz_x, sz_y, false);
+
+			m_resampler.scale(m_img.GetData(), m_img_resampled.GetData());
+
+			m_img_scaled = wxBitmap(m_img_resampled);
 		}
 	}
 	
 	// Refresh the control
 	Refresh();
-}
\ No newline at end of file
+}
+
+
+void wxImageView::renderFrame(int width, int height)
+{
+	TRACE_SCOPE("Scale");
+
+	if (m_lut.band.empty())
+		return;
+
+	m_resampler.setup(m_values_size.GetWidth(), m_values_size.GetHeight(), m_view.src_x, m_view.src_y, m_view.src_width, m_view.src_height,
+		width, height, getResamplerQuality());
+
+	// Keep drawing into the same bitmap, as long as the size doesn't change
+	if (!m_img_scaled.IsOk() || m_img_scaled.GetWidth() != width || m_img_scaled.GetHeight() != height || m_img_scaled.GetDepth() != 24)
+		m_img_scaled.Create(width, height, 24);
+
+	wxNativePixelData data(m_img_scaled);
+
+	if (!data)
+		return;
+
+	m_row.resize(width * 3);
+
+	m_resampler.prepareValues(&m_values[0]);
+
+	wxNativePixelData::Iterator p(data);
+
+	for (int y = 0; y < height; ++y)
+	{
+		// When zoomed in, many target rows come from the same source rows - m_row still holds the previous one
+		if (!m_resampler.isSameRow(y))
+			m_resampler.getValueRow(y, &m_lut.rgb[0], m_lut.first, m_lut.band.size(), &m_row[0]);
+
+		wxNativePixelData::Iterator px = p;
+		const unsigned char * rgb = &m_row[0];
+
+		for (int x = 0; x < width; ++x, ++px, rgb += 3)
+		{
+			px.Red() = rgb[0];
+			px.Green() = rgb[1];
+			px.Blue() = rgb[2];
+		}
+
+		p.OffsetY(data, 1);
+	}
+}
+
+
+bool wxImageView::hasContent() const
+{
+	return m_img.IsOk() || !m_values.empty();
+}
+
+
+wxSize wxImageView::getSourceSize() const
+{
+	return m_img.IsOk() ? m_img.GetSize() : m_values_size;
+}
+
+
+void wxImageView::clampView()
+{
+	wxSize src = getSourceSize();
+
+	// Keep the view inside the source
+	double half_width = src.GetWidth() / m_zoom / 2;
+	double half_height = src.GetHeight() / m_zoom / 2;
+
+	m_center_x = std::min(std::max(m_center_x, half_width), src.GetWidth() - half_width);
+	m_center_y = std::min(std::max(m_center_y, half_height), src.GetHeight() - half_height);
+}
+
+
+Resampler::Quality wxImageView::getResamplerQuality() const
+{
+	switch (m_quality)
+	{
+		case wxIMAGE_QUALITY_BILINEAR:
+			return Resampler::QUALITY_BILINEAR;
+
+		case wxIMAGE_QUALITY_BICUBIC:
+		case wxIMAGE_QUALITY_BOX_AVERAGE:
+		case wxIMAGE_QUALITY_HIGH:
+			return Resampler::QUALITY_BICUBIC;
+
+		default:
+			return Resampler::QUALITY_NEAREST;
+	}
+}
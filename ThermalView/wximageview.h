@@ -25,6 +25,9 @@
 #define wxImageView_H
 
 #include <wx/wx.h>
+#include "resampler.h"
+#include "color_profile/color_profile.h"
+#include <vector>
 
 class wxImageView : public wxControl
 {
@@ -33,11 +36,41 @@ public:
 	
 private:
 	wxImage		m_img;
+	wxImage		m_img_resampled;	// Reused target buffer for the resampler
 	wxBitmap	m_img_scaled;
 	ZoomType	m_zoom_type;
 
+	// Raw frame mode - the values get mapped and scaled straight into m_img_scaled
+	std::vector<uint16_t>		m_values;
+	wxSize						m_values_size;
+	ColorProfile::Lut			m_lut;
+	std::vector<unsigned char>	m_row;			// One RGB row of the target
+
+	Resampler	m_resampler;
+
 	wxImageResizeQuality	m_quality;
 
+	// Digital zoom - only the part of the source that's on display gets mapped and scaled
+	bool		m_zoomable;			// Mouse wheel zooms, dragging pans, double click resets
+	double		m_zoom;				// 1 shows the whole source
+	double		m_center_x;			// Center of the view, in source coordinates
+	double		m_center_y;
+	wxPoint		m_drag_pos;			// Last mouse position while panning
+
+	// Source to screen transform, as of the last updateView()
+	struct View
+	{
+		double	src_x;				// The visible part of the source
+		double	src_y;
+		double	src_width;
+		double	src_height;
+		wxRect	screen;				// Where it ends up in the client area
+	};
+
+	View		m_view;
+
+	wxString	m_overlay;			// Text drawn over the top left corner of the picture
+
 public:
 	DECLARE_DYNAMIC_CLASS(wxImageView);
 	
@@ -46,19 +79,43 @@ public:
 	virtual ~wxImageView();
 	
 	void setImage(const wxImage & img);
+	void setFrame(const std::vector<uint16_t> & values, int width, int height, const ColorProfile::Lut & lut);
 	void clearImage();
+
+	// Lines of text drawn over the picture, empty for none
+	void setOverlay(const wxString & text);
 	
 	void setZoomType(ZoomType zoom_type);
 	void setQuality(wxImageResizeQuality resize_quality);
+
+	void setZoomable(bool zoomable);
+	void setZoom(double zoom, double center_x, double center_y);
+	void resetZoom();
+	double getZoom() const;
+
+	// Maps a client position to source coordinates. Returns false if it's outside the picture.
+	bool screenToSource(const wxPoint & pos, double & x, double & y) const;
 	
 	void OnEraseBackground(wxEraseEvent & event);
 	void OnPaint(wxPaintEvent & event);
 	void OnSize(wxSizeEvent & event);
+	void OnMouseWheel(wxMouseEvent & event);
+	void OnLeftDown(wxMouseEvent & event);
+	void OnLeftUp(wxMouseEvent & event);
+	void OnLeftDClick(wxMouseEvent & event);
+	void OnMotion(wxMouseEvent & event);
+	void OnCaptureLost(wxMouseCaptureLostEvent & event);
 	
 	DECLARE_EVENT_TABLE();
 	
 private:
 	void updateView();
+	void renderFrame(int width, int height);
+
+	bool hasContent() const;
+	wxSize getSourceSize() const;
+	void clampView();
+	Resampler::Quality getResamplerQuality() const;
 };
 
 #endif // wxImageView_H